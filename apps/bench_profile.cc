@@ -0,0 +1,124 @@
+#include "bench_profile.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <new>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! \name Counting operator new and delete
+//!@{
+static atomic<uint64_t> allocation_count{0};
+static atomic<uint64_t> allocation_bytes{0};
+static atomic<int64_t> allocation_live{0};
+
+// not inlined, or GCC takes the replaced operators for a mismatched malloc/delete pair
+[[gnu::noinline]] void *operator new(size_t size) {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    allocation_bytes.fetch_add(size, memory_order_relaxed);
+    if (void *p = malloc(size == 0 ? 1 : size)) {
+        allocation_live.fetch_add(malloc_usable_size(p), memory_order_relaxed);
+        return p;
+    }
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    allocation_live.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+    free(p);
+}
+
+[[gnu::noinline]] void *operator new[](size_t size) { return operator new(size); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept { operator delete(p); }
+[[gnu::noinline]] void operator delete[](void *p) noexcept { operator delete(p); }
+[[gnu::noinline]] void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+//!@}
+
+AllocationStats AllocationStats::now() {
+    return {allocation_count.load(memory_order_relaxed),
+            allocation_bytes.load(memory_order_relaxed),
+            allocation_live.load(memory_order_relaxed)};
+}
+
+//! \details perf's hardware event for each PerfCounters::Event
+static constexpr array<uint64_t, PerfCounters::EVENTS> PERF_EVENTS = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+PerfCounters::PerfCounters() {
+    for (size_t e = 0; e < EVENTS; ++e) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_EVENTS[e];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd >= 0) {
+            _fds[e].emplace(static_cast<int>(fd));
+        }
+    }
+}
+
+PerfCounters::Sample PerfCounters::read() const {
+    Sample sample{};
+    for (size_t e = 0; e < EVENTS; ++e) {
+        uint64_t value = 0;
+        if (_fds[e] and ::read(_fds[e]->fd_num(), &value, sizeof(value)) == sizeof(value)) {
+            sample[e] = value;
+        }
+    }
+    return sample;
+}
+
+bool PerfCounters::available() const {
+    for (const auto &fd : _fds) {
+        if (fd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Profile::Profile() : _allocations_start(AllocationStats::now()), _perf_start(_perf.read()) {}
+
+PerfCounters::Sample Profile::counters() const {
+    PerfCounters::Sample sample = _perf.read();
+    for (size_t e = 0; e < PerfCounters::EVENTS; ++e) {
+        if (sample[e] and _perf_start[e]) {
+            sample[e] = *sample[e] - *_perf_start[e];
+        }
+    }
+    return sample;
+}
+
+//! \param[out] out receives one line of allocation rates and one of counter rates
+//! \param[in] bytes is the payload the region moved
+void Profile::report(ostream &out, const uint64_t bytes) const {
+    const AllocationStats a = allocations();
+    const double mb = bytes / 1e6;
+    out << fixed << setprecision(2) << "    heap: " << a.allocations / mb << " allocations and " << a.bytes / mb
+        << " bytes allocated per MB\n";
+
+    const PerfCounters::Sample c = counters();
+    out << "    cpu:";
+    if (not _perf.available()) {
+        out << " hardware counters unavailable (perf_event_open failed)\n";
+        return;
+    }
+    out << setprecision(4);
+    for (size_t e = 0; e < PerfCounters::EVENTS; ++e) {
+        out << " " << PerfCounters::NAMES[e] << "/B=";
+        if (c[e]) {
+            out << static_cast<double>(*c[e]) / bytes;
+        } else {
+            out << "n/a";
+        }
+    }
+    out << "\n";
+}
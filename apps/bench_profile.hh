@@ -0,0 +1,76 @@
+#ifndef BENCH_PROFILE
+#define BENCH_PROFILE
+
+#include "file_descriptor.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+
+//! \brief Heap allocations made through the global operator new, process-wide
+//! \details Linking bench_profile into a benchmark interposes a counting operator new; the library
+//! itself is never linked into anything else.
+struct AllocationStats {
+    uint64_t allocations{0};  //!< calls to operator new
+    uint64_t bytes{0};        //!< bytes requested from operator new
+    int64_t live_bytes{0};    //!< bytes held by blocks not yet deleted (as sized by malloc_usable_size)
+
+    //! Current totals
+    static AllocationStats now();
+
+    AllocationStats operator-(const AllocationStats &other) const {
+        return {allocations - other.allocations, bytes - other.bytes, live_bytes - other.live_bytes};
+    }
+};
+
+//! \brief Hardware counters of the calling thread, via [perf_event_open(2)](\ref man2::perf_event_open)
+//! \details Counts user-space events only. A counter the kernel refuses (no PMU, e.g. in a VM or a
+//! container, or a restrictive `perf_event_paranoid`) reads as empty rather than failing.
+class PerfCounters {
+  public:
+    enum Event { Cycles = 0, Instructions, CacheMisses, BranchMisses, EVENTS };
+
+    //! Event names, indexed by Event
+    static constexpr std::array<const char *, EVENTS> NAMES = {
+        "cycles", "instructions", "cache-misses", "branch-misses"};
+
+    //! One reading of each counter (empty if it couldn't be opened)
+    using Sample = std::array<std::optional<uint64_t>, EVENTS>;
+
+  private:
+    std::array<std::optional<FileDescriptor>, EVENTS> _fds{};
+
+  public:
+    //! Open and start the counters
+    PerfCounters();
+
+    //! Current counts since construction
+    Sample read() const;
+
+    //! Could any counter be opened?
+    bool available() const;
+};
+
+//! \brief Allocations and hardware counters of a region of a benchmark, from construction on
+class Profile {
+  private:
+    AllocationStats _allocations_start;
+    PerfCounters _perf{};
+    PerfCounters::Sample _perf_start;
+
+  public:
+    Profile();
+
+    //! What the region has allocated so far
+    AllocationStats allocations() const { return AllocationStats::now() - _allocations_start; }
+
+    //! What the counters have counted so far (an event that isn't available is empty)
+    PerfCounters::Sample counters() const;
+
+    //! \brief Print allocations per MB and counter events per byte, for `bytes` of payload moved
+    void report(std::ostream &out, const uint64_t bytes) const;
+};
+
+#endif /* BENCH_PROFILE */
@@ -23,13 +23,13 @@ int main(int argc,char* argv[]){
 
         string host = string(argv[1]);
         uint16_t port = static_cast<uint16_t>(atoi(argv[2]));
-        TUNSocket sock;
+        TUNSocket sock{"starfish_tun", TUNSocket::Transport::Ring};
 
         const auto first_time = high_resolution_clock::now();
 
         sock.connect(Address(host,port));
         for(int i = 0; i < batch ; ++i){
-            sock.write(message); 
+            sock.stream_write(message); 
         }
         sock.wait_until_closed();
 
@@ -0,0 +1,436 @@
+#include "bench_profile.hh"
+#include "byte_stream.hh"
+#include "eventfd.hh"
+#include "ephemeral_ports.hh"
+#include "eventloop.hh"
+#include "fast_parser.hh"
+#include "flow_key.hh"
+#include "isn_generator.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "stream_reassembler.hh"
+#include "tcp_connection.hh"
+#include "tcp_header.hh"
+#include "tcp_sender.hh"
+#include "tun_adapter.hh"
+#include "util.hh"
+#include "wrapping_integers.hh"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+//! Report `--profile` hardware counters too
+static bool profile_counters = false;
+
+//! \brief Reports what a benchmark's loop allocated (and, with `--profile`, counted) per iteration
+//! \details Every benchmark reports `allocs/op` and `alloc_bytes/op`, through the counting operator new
+//! of bench_profile.
+class ProfileCounters {
+    benchmark::State &_state;
+    Profile _profile{};
+
+  public:
+    explicit ProfileCounters(benchmark::State &state) : _state(state) {}
+    ~ProfileCounters() {
+        const auto per_op = [](const double total) {
+            return benchmark::Counter(total, benchmark::Counter::kAvgIterations);
+        };
+        const AllocationStats a = _profile.allocations();
+        _state.counters["allocs/op"] = per_op(a.allocations);
+        _state.counters["alloc_bytes/op"] = per_op(a.bytes);
+        if (profile_counters) {
+            const PerfCounters::Sample c = _profile.counters();
+            for (size_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                if (c[e]) {
+                    _state.counters[string(PerfCounters::NAMES[e]) + "/op"] = per_op(*c[e]);
+                }
+            }
+        }
+    }
+    ProfileCounters(const ProfileCounters &other) = delete;
+    ProfileCounters &operator=(const ProfileCounters &other) = delete;
+};
+
+static string random_bytes(const size_t len) {
+    auto rd = get_random_generator();
+    string s(len, 0);
+    generate(s.begin(), s.end(), [&] { return static_cast<char>(rd()); });
+    return s;
+}
+
+static void checksum(benchmark::State &state) {
+    const string data = random_bytes(state.range(0));
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        InternetChecksum sum;
+        sum.add(data);
+        benchmark::DoNotOptimize(sum.value());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(checksum)->Arg(20)->Arg(1500)->Arg(64 * 1024);
+
+static IPv4Header sample_ipv4_header() {
+    IPv4Header h;
+    h.src = 0xa9fe9009;
+    h.dst = 0xa9fe9001;
+    h.len = IPv4Header::LENGTH + TCPHeader::LENGTH + 1452;
+    h.cksum = 0;
+    return h;
+}
+
+static TCPHeader sample_tcp_header() {
+    TCPHeader h;
+    h.sport = 40000;
+    h.dport = 9090;
+    h.seqno = WrappingInt32{123456};
+    h.ackno = WrappingInt32{654321};
+    h.ack = true;
+    h.win = 64000;
+    return h;
+}
+
+static void ipv4_header_serialize(benchmark::State &state) {
+    const IPv4Header h = sample_ipv4_header();
+    char out[IPv4Header::LENGTH];
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        h.serialize(static_cast<char *>(out));
+        benchmark::DoNotOptimize(out);
+    }
+}
+BENCHMARK(ipv4_header_serialize);
+
+//! The generic NetParser (the slow path, used off the receive path)
+static void ipv4_header_parse_netparser(benchmark::State &state) {
+    const Buffer wire{sample_ipv4_header().serialize()};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        NetParser p{wire};
+        IPv4Header h;
+        benchmark::DoNotOptimize(h.parse(p));
+    }
+}
+BENCHMARK(ipv4_header_parse_netparser);
+
+//! FastParser, which the receive path uses
+static void ipv4_header_parse_fastparser(benchmark::State &state) {
+    const Buffer wire{sample_ipv4_header().serialize()};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        IPv4Header h;
+        benchmark::DoNotOptimize(FastParser::parse_ipv4(wire, h));
+        benchmark::DoNotOptimize(h);
+    }
+}
+BENCHMARK(ipv4_header_parse_fastparser);
+
+static void tcp_header_serialize(benchmark::State &state) {
+    const TCPHeader h = sample_tcp_header();
+    char out[TCPHeader::LENGTH];
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        h.serialize(static_cast<char *>(out));
+        benchmark::DoNotOptimize(out);
+    }
+}
+BENCHMARK(tcp_header_serialize);
+
+//! The generic NetParser (the slow path, used off the receive path)
+static void tcp_header_parse_netparser(benchmark::State &state) {
+    const Buffer wire{sample_tcp_header().serialize()};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        NetParser p{wire};
+        TCPHeader h;
+        benchmark::DoNotOptimize(h.parse(p));
+    }
+}
+BENCHMARK(tcp_header_parse_netparser);
+
+//! FastParser, which the receive path uses
+static void tcp_header_parse_fastparser(benchmark::State &state) {
+    const Buffer wire{sample_tcp_header().serialize()};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        TCPHeader h;
+        benchmark::DoNotOptimize(FastParser::parse_tcp(wire, h));
+        benchmark::DoNotOptimize(h);
+    }
+}
+BENCHMARK(tcp_header_parse_fastparser);
+
+//! Both headers of a pure ACK, written in place by an adapter (as TUNStack does for every segment);
+//! only the adapter's first call allocates, for the headroom later ACKs reuse
+static void wrap_ack_in_place(benchmark::State &state) {
+    FdAdapterConfig cfg;
+    cfg.source = {"169.254.144.9", 40000};
+    cfg.destination = {"169.254.144.1", 9090};
+    TCPOverIPv4Adapter adapter;
+    adapter.set_config(cfg);
+    TCPSegment ack;
+    ack.header() = sample_tcp_header();
+    const ProfileCounters profile{state};
+    const AllocationStats before = AllocationStats::now();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(adapter.wrap_tcp_in_ip_in_place(ack));
+    }
+    if ((AllocationStats::now() - before).allocations > 2) {  // (the headroom's string and its shared storage)
+        state.SkipWithError("pure ACKs not wrapped without allocating");
+    }
+}
+BENCHMARK(wrap_ack_in_place);
+
+static void seqno_wrap(benchmark::State &state) {
+    const WrappingInt32 isn{0xfffff000};
+    uint64_t n = 0;
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(wrap(n += 1452, isn));
+    }
+}
+BENCHMARK(seqno_wrap);
+
+static void seqno_unwrap(benchmark::State &state) {
+    const WrappingInt32 isn{0xfffff000};
+    uint64_t checkpoint = 0;
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        checkpoint = unwrap(wrap(checkpoint + 1452, isn), isn, checkpoint);
+        benchmark::DoNotOptimize(checkpoint);
+    }
+}
+BENCHMARK(seqno_unwrap);
+
+//! One write, peek and pop of `range(0)` bytes per iteration
+static void byte_stream(benchmark::State &state) {
+    const string chunk = random_bytes(state.range(0));
+    ByteStream stream{64 * 1024};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        stream.write(chunk);
+        benchmark::DoNotOptimize(stream.peek_output(chunk.size()));
+        stream.pop_output(chunk.size());
+    }
+    state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(byte_stream)->Arg(1)->Arg(64)->Arg(1452)->Arg(16 * 1024);
+
+//! Orders in which StreamReassembler receives the segments of a stream
+enum Pattern { InOrder, Reverse, Random, Duplicate };
+
+//! Reassemble 64 KiB, sent as 1452-byte segments in the order given by `range(0)` (a Pattern)
+static void stream_reassembler(benchmark::State &state) {
+    constexpr size_t STREAM = 64 * 1024;
+    constexpr size_t SEGMENT = 1452;
+    const string data = random_bytes(STREAM);
+
+    vector<size_t> order((STREAM + SEGMENT - 1) / SEGMENT);
+    iota(order.begin(), order.end(), 0);
+    switch (state.range(0)) {
+        case Reverse:
+            reverse(order.begin(), order.end());
+            break;
+        case Random:
+            shuffle(order.begin(), order.end(), mt19937{0});
+            break;
+        case Duplicate:  // every segment twice
+            order.insert(order.end(), order.begin(), order.end());
+            break;
+    }
+    vector<Buffer> segments;
+    for (size_t i = 0; i * SEGMENT < STREAM; ++i) {
+        segments.emplace_back(data.substr(i * SEGMENT, SEGMENT));
+    }
+
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        StreamReassembler reassembler{STREAM};
+        for (const size_t i : order) {
+            reassembler.push_substring(segments[i], i * SEGMENT, false);
+        }
+        benchmark::DoNotOptimize(reassembler.stream_out().read(STREAM));
+    }
+    state.SetBytesProcessed(state.iterations() * STREAM);
+}
+BENCHMARK(stream_reassembler)->Arg(InOrder)->Arg(Reverse)->Arg(Random)->Arg(Duplicate);
+
+//! Fill the window with `range(0)` segments, then acknowledge them all
+static void tcp_sender(benchmark::State &state) {
+    const size_t segments = state.range(0);
+    const string data = random_bytes(segments * TCPConfig::MAX_PAYLOAD_SIZE);
+    TCPSender sender{data.size(), TCPConfig::TIMEOUT_DFLT, WrappingInt32{0}};
+    sender.fill_window();  // SYN
+    sender.segments_out().pop();
+    sender.ack_received(sender.next_seqno(), 0xffff);
+
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        sender.stream_in().write(data);
+        sender.fill_window();
+        while (not sender.segments_out().empty()) {
+            sender.segments_out().pop();
+        }
+        sender.ack_received(sender.next_seqno(), 0xffff);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(tcp_sender)->Arg(1)->Arg(16);
+
+//! Find a segment's connection among `range(0)`, by the FlowKey of its headers
+static void flow_demux(benchmark::State &state) {
+    const size_t nflows = state.range(0);
+    unordered_map<FlowKey, size_t, FlowKeyHash> flows;
+    for (size_t i = 0; i < nflows; ++i) {
+        flows.emplace(FlowKey{0xa9fe9001, 0xa9fe9009, 9090, static_cast<uint16_t>(10000 + i)}, i);
+    }
+
+    size_t next = 0;
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        const FlowKey key{0xa9fe9001, 0xa9fe9009, 9090, static_cast<uint16_t>(10000 + next++ % nflows)};
+        benchmark::DoNotOptimize(flows.find(key));
+    }
+}
+BENCHMARK(flow_demux)->Arg(1)->Arg(1024)->Arg(65536);
+
+//! How a connection's ISNs and local port are chosen
+enum Setup { RandomDevice, Keyed };
+
+//! One ISN, drawn the way `range(0)` (a Setup) says
+static void isn(benchmark::State &state) {
+    const FlowKey flow{0xa9fe9009, 0xa9fe9001, 40000, 9090};
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        if (state.range(0) == RandomDevice) {
+            benchmark::DoNotOptimize(WrappingInt32{random_device()()});
+        } else {
+            benchmark::DoNotOptimize(ISNGenerator::global().isn(flow));
+        }
+    }
+}
+BENCHMARK(isn)->Arg(RandomDevice)->Arg(Keyed);
+
+//! Allocate and release an ephemeral port, with `range(0)` ports to the destination already in use; with
+//! none, the destination's bitmap is forgotten at each release, and only the first allocate() allocates it
+static void ephemeral_port(benchmark::State &state) {
+    EphemeralPorts ports;
+    const FlowKey flow{0xa9fe9009, 0xa9fe9001, 0, 9090};
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        ports.allocate(flow);
+    }
+    const ProfileCounters profile{state};
+    const AllocationStats before = AllocationStats::now();
+    for (auto _ : state) {
+        FlowKey taken = flow;
+        taken.local_port = ports.allocate(flow).value();
+        ports.release(taken);
+    }
+    if ((AllocationStats::now() - before).allocations > 2) {  // (the first bitmap, and the map's buckets)
+        state.SkipWithError("bitmap of a forgotten destination not reused");
+    }
+}
+BENCHMARK(ephemeral_port)->Arg(0)->Arg(EphemeralPorts::COUNT / 2)->Arg(EphemeralPorts::COUNT - 1);
+
+//! \brief Open (and reset) one connection between two in-memory TCPConnections per iteration
+//! \details With RandomDevice, each connection also pays what it used to before ISNGenerator and
+//! EphemeralPorts: std::random_device for the port and both ISNs, and a seeded std::mt19937 for
+//! each SYN received. The items/s counter is the connections per second.
+static void connection_setup(benchmark::State &state) {
+    const bool legacy = state.range(0) == RandomDevice;
+    EphemeralPorts ports;
+    FlowKey flow{0xa9fe9009, 0xa9fe9001, 0, 9090};
+    TCPSegment rst;
+    rst.header().rst = true;
+
+    const auto deliver = [](TCPConnection &from, TCPConnection &to) {
+        for (; not from.segments_out().empty(); from.segments_out().pop()) {
+            to.segment_received(from.segments_out().front());
+        }
+    };
+
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        TCPConfig client_cfg, server_cfg;
+        if (legacy) {
+            flow.local_port = uint16_t(random_device()());
+            client_cfg.fixed_isn = WrappingInt32{random_device()()};
+            server_cfg.fixed_isn = WrappingInt32{random_device()()};
+            for (int syn = 0; syn < 2; ++syn) {
+                benchmark::DoNotOptimize(get_random_generator()());
+            }
+        } else {
+            flow.local_port = ports.allocate(flow).value();
+            client_cfg.fixed_isn = ISNGenerator::global().isn(flow);
+            server_cfg.fixed_isn = ISNGenerator::global().isn(
+                {flow.remote_address, flow.local_address, flow.remote_port, flow.local_port});
+        }
+
+        TCPConnection client{client_cfg}, server{server_cfg};
+        client.connect();
+        deliver(client, server);  // SYN
+        deliver(server, client);  // SYN/ACK
+        deliver(client, server);  // ACK
+        if (client.state() != TCPState::State::ESTABLISHED or server.state() != TCPState::State::ESTABLISHED) {
+            state.SkipWithError("handshake failed");
+            break;
+        }
+
+        client.segment_received(rst);
+        server.segment_received(rst);
+        if (not legacy) {
+            ports.release(flow);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(connection_setup)->Arg(RandomDevice)->Arg(Keyed);
+
+//! Dispatch one ready fd among `range(0)` rules
+static void eventloop(benchmark::State &state) {
+    const size_t nrules = state.range(0);
+    vector<unique_ptr<EventFD>> fds;
+    EventLoop loop;
+    for (size_t i = 0; i < nrules; ++i) {
+        fds.push_back(make_unique<EventFD>());
+        loop.add_rule(*fds.back(), EventLoop::Direction::In, [fd = fds.back().get()] { fd->clear(); });
+    }
+
+    size_t next = 0;
+    const ProfileCounters profile{state};
+    for (auto _ : state) {
+        fds[next++ % nrules]->notify();
+        benchmark::DoNotOptimize(loop.wait_next_event(0));
+    }
+}
+BENCHMARK(eventloop)->Arg(1)->Arg(16)->Arg(256);
+
+//! Google Benchmark's main(), plus `--profile` to report hardware counters per iteration
+int main(int argc, char *argv[]) {
+    vector<char *> args;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            profile_counters = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int nargs = static_cast<int>(args.size());
+    benchmark::Initialize(&nargs, args.data());
+    if (benchmark::ReportUnrecognizedArguments(nargs, args.data())) {
+        return EXIT_FAILURE;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return EXIT_SUCCESS;
+}
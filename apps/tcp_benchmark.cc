@@ -1,10 +1,17 @@
+#include "bench_profile.hh"
+#include "link_emulator.hh"
 #include "tcp_connection.hh"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace std::chrono;
@@ -28,8 +35,9 @@ void move_segments(TCPConnection &x, TCPConnection &y, vector<TCPSegment> &segme
     segments.clear();
 }
 
-void main_loop(const bool reorder) {
+void main_loop(const bool reorder, const bool profile, const size_t mss = 0) {
     TCPConfig config;
+    config.mss = mss;
     TCPConnection x{config}, y{config};
 
     string string_to_send(len, 'x');
@@ -46,6 +54,7 @@ void main_loop(const bool reorder) {
     string string_received;
     string_received.reserve(len);
 
+    const auto region = profile ? make_unique<Profile>() : nullptr;
     const auto first_time = high_resolution_clock::now();
 
     auto loop = [&] {
@@ -95,18 +104,226 @@ void main_loop(const bool reorder) {
     const auto gigabits_per_second = len * 8.0 / double(duration);
 
     cout << fixed << setprecision(2);
-    cout << "CPU-limited throughput" << (reorder ? " with reordering: " : "                : ") << gigabits_per_second
-         << " Gbit/s\n";
+    const string variant = mss ? " with " + to_string(x.mss()) + " MSS" : reorder ? " with reordering" : "";
+    cout << "CPU-limited throughput" << left << setw(16) << variant << right << ": " << gigabits_per_second
+         << " Gbit/s (" << y.fast_path_hits() << " fast-path segments)\n";
+    if (region) {
+        region->report(cout, len);
+    }
 
     while (x.active() or y.active()) {
         loop();
     }
 }
 
-int main() {
+//! What one transfer over an emulated link measured
+struct TransferResult {
+    uint64_t completion_ms;    //!< simulated time until the receiver had every byte
+    uint64_t retransmissions;  //!< segments the sender retransmitted
+    uint64_t segments;         //!< segments the sender sent
+};
+
+//! Transfer `size` bytes from x to y over emulated links (`link` one way, the same link reseeded back)
+TransferResult emulated_transfer(const LinkConfig &link, const size_t size, const TCPConfig &config) {
+    constexpr uint64_t TICK_MS = 1;
+    constexpr uint64_t GIVE_UP_MS = 600 * 1000;
+
+    TCPConnection x{config}, y{config};
+    LinkEmulator forward{link};
+    LinkConfig back_cfg = link;
+    back_cfg.seed = ~link.seed;
+    LinkEmulator backward{back_cfg};
+
+    string to_send(size, 0);
+    for (auto &ch : to_send) {
+        ch = rand();
+    }
+    size_t written = 0;
+    string received;
+    x.connect();
+    y.end_input_stream();
+
+    TransferResult result{0, 0, 0};
+    for (uint64_t now_ms = 0; x.active() or y.active(); now_ms += TICK_MS) {
+        if (now_ms > GIVE_UP_MS) {
+            throw runtime_error("emulated transfer did not finish");
+        }
+        if (written < size) {
+            written += x.write(to_send.substr(written, x.remaining_outbound_capacity()));
+            if (written == size) {
+                x.end_input_stream();
+            }
+        }
+
+        const uint64_t now_us = now_ms * 1000;
+        for (; not x.segments_out().empty(); x.segments_out().pop()) {
+            forward.send(x.segments_out().front(), now_us);
+        }
+        for (; not y.segments_out().empty(); y.segments_out().pop()) {
+            backward.send(y.segments_out().front(), now_us);
+        }
+        for (const auto &seg : forward.receive(now_us)) {
+            y.segment_received(seg);
+        }
+        for (const auto &seg : backward.receive(now_us)) {
+            x.segment_received(seg);
+        }
+
+        received += y.inbound_stream().read(y.inbound_stream().buffer_size());
+        if (y.inbound_stream().eof() and result.completion_ms == 0) {
+            result.completion_ms = now_ms;
+        }
+
+        x.tick(TICK_MS);
+        y.tick(TICK_MS);
+    }
+
+    if (received != to_send) {
+        throw runtime_error("emulated transfer: strings sent vs. received don't match");
+    }
+    result.retransmissions = x.metrics().retransmissions;
+    result.segments = x.metrics().segments_out;
+    return result;
+}
+
+//! Run `runs` seeded transfers over `link`, and print goodput, retransmission ratio and completion times
+void emulated_scenario(const string &name, LinkConfig link, const size_t runs, const TCPConfig &config = {}) {
+    constexpr size_t size = 1024 * 1024;
+
+    vector<uint64_t> completion_ms;
+    uint64_t retransmissions = 0, segments = 0;
+    for (size_t run = 0; run < runs; ++run) {
+        link.seed = run + 1;
+        const TransferResult r = emulated_transfer(link, size, config);
+        completion_ms.push_back(r.completion_ms);
+        retransmissions += r.retransmissions;
+        segments += r.segments;
+    }
+    sort(completion_ms.begin(), completion_ms.end());
+    const auto percentile = [&](const size_t p) { return completion_ms[(completion_ms.size() - 1) * p / 100]; };
+
+    cout << fixed << setprecision(2);
+    cout << "  " << left << setw(16) << name << right << setw(8) << size * 8.0 / 1000 / percentile(50)
+         << " Mbit/s" << setw(8) << 100.0 * retransmissions / segments << "% retx"
+         << "   completion ms: min " << completion_ms.front() << ", p50 " << percentile(50) << ", p90 "
+         << percentile(90) << ", max " << completion_ms.back() << "\n";
+}
+
+//! 1 MiB transfers over a 100 Mbit/s link with a 20 ms round trip, with each kind of impairment
+void emulated_scenarios() {
+    constexpr size_t RUNS = 20;
+
+    LinkConfig clean;
+    clean.bandwidth_bps = 100 * 1000 * 1000;
+    clean.delay_us = 10 * 1000;
+    clean.queue_limit = 100;
+
+    cout << "Emulated 100 Mbit/s, 20 ms RTT, 1 MiB transfers (median goodput over " << RUNS << " seeds):\n";
+    emulated_scenario("clean", clean, RUNS);
+
+    // the same, starting from the smallest send capacity and letting autotuning grow it
+    TCPConfig autotuned;
+    autotuned.autotune = true;
+    autotuned.send_capacity = TCPConfig::AUTOTUNE_MIN_CAPACITY;
+    emulated_scenario("clean autotuned", clean, RUNS, autotuned);
+
+    LinkConfig random_loss = clean;
+    random_loss.loss = 0.01;
+    emulated_scenario("1% loss", random_loss, RUNS);
+
+    LinkConfig bursty_loss = clean;
+    bursty_loss.burst_enter = 0.005;
+    bursty_loss.burst_exit = 0.3;
+    bursty_loss.burst_loss = 0.5;
+    emulated_scenario("bursty loss", bursty_loss, RUNS);
+
+    LinkConfig reordering = clean;
+    reordering.jitter_us = 2000;
+    reordering.reorder = 0.05;
+    reordering.reorder_us = 5000;
+    emulated_scenario("jitter+reorder", reordering, RUNS);
+
+    LinkConfig duplication = clean;
+    duplication.duplicate = 0.02;
+    emulated_scenario("2% duplication", duplication, RUNS);
+
+    // a path narrower than the MSS: without PLPMTUD nothing larger than its MTU would get through
+    LinkConfig jumbo = clean;
+    jumbo.mtu = 9000;
+    TCPConfig plpmtud;
+    plpmtud.mss = TCPConfig::MAX_MSS;
+    plpmtud.plpmtud = true;
+    emulated_scenario("9000 MTU PLPMTUD", jumbo, RUNS, plpmtud);
+}
+
+//! Heap an idle connection should hold, in bytes (including the TCPConnection itself)
+constexpr double IDLE_CONNECTION_TARGET = 1536;
+
+//! \brief Open `n` connections between pairs of in-memory TCPConnections, and report the heap each holds while idle
+//! \details Whether IDLE_CONNECTION_TARGET is met is reported rather than thrown: the heap an allocator hands
+//! out for the same objects varies with the platform, and the other benchmarks should still run.
+void idle_connections(const size_t n) {
+    const TCPConfig config;
+    TCPSegment rst;
+    rst.header().rst = true;
+
+    const AllocationStats before = AllocationStats::now();
+    const auto first_time = high_resolution_clock::now();
+    vector<TCPConnection> clients, servers;
+    clients.reserve(n);
+    servers.reserve(n);
+    vector<TCPSegment> segments;
+    for (size_t i = 0; i < n; ++i) {
+        TCPConnection &x = clients.emplace_back(config);
+        TCPConnection &y = servers.emplace_back(config);
+        x.connect();
+        move_segments(x, y, segments, false);
+        move_segments(y, x, segments, false);
+        move_segments(x, y, segments, false);
+        if (x.state() != TCPState::State::ESTABLISHED or y.state() != TCPState::State::ESTABLISHED) {
+            throw runtime_error("idle connections: handshake failed");
+        }
+        x.tick(1);  // as their owner would, while they idle
+        y.tick(1);
+    }
+    const auto opened_time = high_resolution_clock::now();
+    const AllocationStats held = AllocationStats::now() - before;
+
+    const double per_connection = held.live_bytes / (2.0 * n);
+    cout << "Idle connections: " << n << " opened in " << duration_cast<milliseconds>(opened_time - first_time).count()
+         << " ms, holding " << per_connection << " bytes of heap per connection (" << sizeof(TCPConnection)
+         << " inline; target " << IDLE_CONNECTION_TARGET
+         << (per_connection > IDLE_CONNECTION_TARGET ? ", NOT MET" : ", met") << ")\n";
+
+    for (size_t i = 0; i < n; ++i) {
+        clients[i].segment_received(rst);
+        servers[i].segment_received(rst);
+    }
+}
+
+int main(int argc, char *argv[]) {
     try {
-        main_loop(false);
-        main_loop(true);
+        if (argc <= 0) {
+            abort();
+        }
+        const bool profile = argc == 2 and strcmp(argv[1], "--profile") == 0;
+        if (argc > 2 or (argc == 2 and not profile)) {
+            cerr << "Usage: " << argv[0] << " [--profile]\n";
+            cerr << "\t--profile: report heap allocations per MB and hardware counters per byte\n";
+            return EXIT_FAILURE;
+        }
+
+        main_loop(false, profile);
+        main_loop(true, profile);
+        main_loop(false, profile, TCPConfig::MAX_MSS);
+        emulated_scenarios();
+        idle_connections(100000);
+#ifdef STARFISH_TRACING
+        ofstream trace{"tcp_benchmark.trace", ios::binary};
+        const size_t records = Tracer::drain(trace);
+        cerr << "Wrote " << records << " trace records to tcp_benchmark.trace (" << Tracer::dropped()
+             << " dropped while the ring was full)\n";
+#endif
     } catch (const exception &e) {
         cerr << e.what() << "\n";
         return EXIT_FAILURE;
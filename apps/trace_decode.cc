@@ -0,0 +1,38 @@
+#include "tcp_trace.hh"
+#include "trace.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+
+        if (argc != 2) {
+            cerr << "Usage: " << argv[0] << " TRACE_FILE\n";
+            cerr << "\tRenders the records written by Tracer::drain() (in a build with -DSTARFISH_TRACING=ON)\n";
+            return EXIT_FAILURE;
+        }
+
+        ifstream in{argv[1], ios::binary};
+        if (not in) {
+            cerr << "Cannot open " << argv[1] << "\n";
+            return EXIT_FAILURE;
+        }
+
+        const auto records = Tracer::read(in);
+        for (const auto &rec : records) {
+            cout << TCPTrace::render(rec, records.front().timestamp_ns) << "\n";
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
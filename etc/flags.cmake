@@ -1,3 +1,9 @@
 # flags
 set (CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS} -std=c++17 -g -ggdb -pedantic -pedantic-errors -Werror -Wall -Wextra -Wshadow -Wpointer-arith -Wcast-qual -Wformat=2 -Weffc++ -Wold-style-cast")
-set (CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS} -std=c++2a -O3 -Wall" ) 
\ No newline at end of file
+set (CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS} -std=c++2a -O3 -Wall" ) 
+
+# tracepoints (see lib/util/trace.hh) compile to nothing unless enabled
+option (STARFISH_TRACING "Compile in the tracepoints of the TCP hot path" OFF)
+if (STARFISH_TRACING)
+    add_definitions (-DSTARFISH_TRACING)
+endif ()
@@ -5,9 +5,46 @@ enable_testing ()
 
 # add tests
 add_test(NAME t_send_connect        COMMAND send_connect)
+add_test(NAME t_send_retx           COMMAND send_retx)
 add_test(NAME t_recv_connect        COMMAND recv_connect)
 add_test(NAME t_strm_reassem_single COMMAND fsm_stream_reassembler_single)
 add_test(NAME t_winsize             COMMAND fsm_winsize)
+add_test(NAME t_header_fast_path    COMMAND header_fast_path)
+add_test(NAME t_fsm_fast_path       COMMAND fsm_fast_path)
+add_test(NAME t_byte_ring           COMMAND byte_ring)
+add_test(NAME t_tun_stack           COMMAND tun_stack)
+add_test(NAME t_tun_coro            COMMAND tun_coro)
+add_test(NAME t_work_pool           COMMAND work_pool)
+add_test(NAME t_metrics             COMMAND metrics)
+add_test(NAME t_trace               COMMAND trace)
+add_test(NAME t_pcap                COMMAND pcap)
+add_test(NAME t_link_emulator       COMMAND link_emulator)
+add_test(NAME t_flow_key            COMMAND flow_key)
+add_test(NAME t_isn_ports           COMMAND isn_ports)
+add_test(NAME t_time_wait           COMMAND time_wait)
+add_test(NAME t_lazy_deque          COMMAND lazy_deque)
+add_test(NAME t_tcp_memory          COMMAND tcp_memory)
+add_test(NAME t_window_update       COMMAND window_update)
+add_test(NAME t_persist             COMMAND persist)
+add_test(NAME t_path_mtu            COMMAND path_mtu)
+add_test(NAME t_segment_coalescer   COMMAND segment_coalescer)
+add_test(NAME t_header_template     COMMAND header_template)
+add_test(NAME t_autotune            COMMAND autotune)
+add_test(NAME t_tun_socket          COMMAND tun_socket)
+
+# the connection tracepoints compile to nothing by default: build and run their test in a second tree
+# that enables them (not a `t_` test, so `make check` leaves it out)
+if (NOT STARFISH_TRACING)
+    add_test(NAME tracing_enabled
+             COMMAND ${CMAKE_CTEST_COMMAND}
+                     --build-and-test "${PROJECT_SOURCE_DIR}" "${PROJECT_BINARY_DIR}/tracing_enabled"
+                     --build-generator "${CMAKE_GENERATOR}"
+                     --build-target trace
+                     --build-options -DSTARFISH_TRACING=ON "-DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}"
+                     --test-command "${PROJECT_BINARY_DIR}/tracing_enabled/tests/trace")
+    # (the first run builds the library from scratch, so a short default --timeout mustn't apply)
+    set_tests_properties (tracing_enabled PROPERTIES TIMEOUT 1800)
+endif ()
 
 # `make check` = check all tests
 add_custom_target ( check COMMAND "${PROJECT_SOURCE_DIR}/tun.sh" stop
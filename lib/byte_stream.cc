@@ -43,10 +43,12 @@ size_t ByteStream::write(BufferPlus& data) { // ! avoid copy
 }
 
 //! \param[in] len bytes will be copied from the output side of the buffer
-string ByteStream::peek_output(const size_t len) const {
+//! \param[in] headroom bytes are reserved (zero-filled) in front of the copy, e.g. for headers
+string ByteStream::peek_output(const size_t len, const size_t headroom) const {
     size_t len_ = min(len, buffer_size());
     string ret;
-    ret.reserve(len_);
+    ret.reserve(headroom + len_);
+    ret.resize(headroom);
     for (const auto &buffer : _buffer) {
         if (len_ >= buffer.size()) {
             ret.append(buffer); // ! avoid copy 
@@ -84,9 +86,10 @@ void ByteStream::pop_output(const size_t len) {
 
 //! Read (i.e., copy and then pop) the next "len" bytes of the stream
 //! \param[in] len bytes will be popped and returned
+//! \param[in] headroom bytes are reserved in front of the returned bytes
 //! \returns a string
-string ByteStream::read(const size_t len) {
-    string ans = peek_output(len);
+string ByteStream::read(const size_t len, const size_t headroom) {
+    string ans = peek_output(len, headroom);
     pop_output(len);
     return ans;
 }
@@ -106,3 +109,5 @@ size_t ByteStream::bytes_written() const { return _bytes_written; }
 size_t ByteStream::bytes_read() const { return _bytes_read; }
 
 size_t ByteStream::remaining_capacity() const { return _capacity - buffer_size(); }
+
+void ByteStream::set_capacity(const size_t capacity) { _capacity = max(capacity, buffer_size()); }
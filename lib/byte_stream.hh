@@ -1,8 +1,8 @@
 #ifndef BYTE_STREAM
 #define BYTE_STREAM
 
-#include "deque"
 #include "util/buffer.hh"
+#include "util/lazy_deque.hh"
 
 #include <string>
 
@@ -19,7 +19,7 @@ class ByteStream {
     size_t _capacity;
     size_t _bytes_written = 0;
     size_t _bytes_read = 0;
-    std::deque<BufferPlus> _buffer{};
+    LazyDeque<BufferPlus> _buffer{};  //!< allocated only while in use (see trim())
 
   public:
     //! Construct a stream with room for `capacity` bytes.
@@ -41,26 +41,35 @@ class ByteStream {
     //! \returns the number of additional bytes that the stream has space for
     size_t remaining_capacity() const;
 
+    //! \returns the number of bytes the stream can hold
+    size_t capacity() const { return _capacity; }
+
+    //! Grow or shrink the stream; it never shrinks below the bytes it already holds
+    void set_capacity(const size_t capacity);
+
     //! Signal that the byte stream has reached its ending
     void end_input();
 
     //! Indicate that the stream suffered an error.
     void set_error() { _error = true; }
+
+    //! Free the buffer's memory if it holds no bytes (e.g. when the stream goes idle)
+    void trim() { _buffer.trim(); }
     //!@}
 
     //! \name "Output" interface for the reader
     //!@{
 
-    //! Peek at next "len" bytes of the stream
+    //! Peek at next "len" bytes of the stream, preceded by `headroom` reserved bytes
     //! \returns a string
-    std::string peek_output(const size_t len) const;
+    std::string peek_output(const size_t len, const size_t headroom = 0) const;
 
     //! Remove bytes from the buffer
     void pop_output(const size_t len);
 
-    //! Read (i.e., copy and then pop) the next "len" bytes of the stream
+    //! Read (i.e., copy and then pop) the next "len" bytes of the stream, preceded by `headroom` reserved bytes
     //! \returns a string
-    std::string read(const size_t len);
+    std::string read(const size_t len, const size_t headroom = 0);
 
     //! \returns `true` if the stream input has ended
     bool input_ended() const;
@@ -66,6 +66,13 @@ void StreamReassembler::push_substring(const Buffer &data, const size_t index, c
     EOFcheck();
 }
 
+size_t StreamReassembler::push_in_order(const Buffer &data) {
+    BufferPlus to_write(data);
+    const size_t bytes_written = _output.write(to_write);
+    _bytes_waiting += bytes_written;
+    EOFcheck();
+    return bytes_written;
+}
 
 // Check if eof is written to the stream
 inline void StreamReassembler::EOFcheck() {
@@ -153,6 +160,13 @@ bool StreamReassembler::overlap(const StreamBlock &blk, const StreamBlock &new_b
 
 uint64_t StreamReassembler::first_unassembled() const { return _bytes_waiting; }
 
+size_t StreamReassembler::drop_unassembled() {
+    const size_t dropped = _unassembled_byte;
+    _blocks.clear();
+    _unassembled_byte = 0;
+    return dropped;
+}
+
 size_t StreamReassembler::unassembled_bytes() const { return _unassembled_byte; }
 
 bool StreamReassembler::empty() const { return _unassembled_byte == 0; }
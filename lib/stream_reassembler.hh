@@ -86,6 +86,13 @@ class StreamReassembler {
     void push_substring(const std::string &data, const uint64_t index, const bool eof);
     void push_substring(const Buffer &data, const size_t index, const bool eof);
 
+    //! \brief Append `data`, which begins exactly at first_unassembled(), straight to the stream
+    //! \note Fast path for in-order data: the caller guarantees no substrings are waiting
+    //! and no eof is carried, so nothing needs to be stored or merged. An eof stored earlier
+    //! still ends the stream once `data` reaches it.
+    //! \returns the number of bytes written
+    size_t push_in_order(const Buffer &data);
+
     //! \name Access the reassembled byte stream
     //!@{
     const ByteStream &stream_out() const { return _output; }
@@ -99,9 +106,16 @@ class StreamReassembler {
     //! should only be counted once for the purpose of this function.
     size_t unassembled_bytes() const;
 
+    //! \brief Drop the substrings stored but not yet reassembled (e.g. under memory pressure)
+    //! \returns the number of bytes dropped
+    size_t drop_unassembled();
+
     //! \brief Is the internal state empty (other than the output stream)?
     //! \returns `true` if no substrings are waiting to be assembled
     bool empty() const;
+
+    //! \brief Has the index of the end of the stream been received (with or without the bytes before it)?
+    bool eof_known() const { return _eof_set; }
 };
 
 
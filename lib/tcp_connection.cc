@@ -1,6 +1,8 @@
 #include "tcp_connection.hh"
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 
 using namespace std;
@@ -13,35 +15,136 @@ size_t TCPConnection::unassembled_bytes() const { return _receiver.unassembled_b
 
 size_t TCPConnection::time_since_last_segment_received() const { return _curr_time - _last_segment_time; }
 
+//! \details Under memory pressure (see TCPMemory), a SYN that would open a new connection is ignored,
+//! and out-of-order data is neither stored nor kept.
 void TCPConnection::segment_received(const TCPSegment &seg) {
-    // cerr << "-DEBUG: receive segment with" << seg.header().summary()  <<endl;
+    STARFISH_TRACE(TCPTrace::segment(TraceEvent::SegmentReceived, this, seg));
 
+    const MemoryPressure pressure = TCPMemory::pressure();
+    if (pressure == MemoryPressure::RefuseConnections && seg.header().syn && !_receiver.ackno().has_value() &&
+        _sender.next_seqno_absolute() == 0) {  // LISTEN
+        TCPMemory::count_refused();
+        return;
+    }
+
+    if (seg.header().syn && seg.header().mss) {  // (a tiny option would shred the stream into tiny segments)
+        _sender.set_peer_mss(max<size_t>(seg.header().mss, TCPConfig::MIN_MSS));
+    }
     _last_segment_time = _curr_time;
+    _metrics.segments_in++;
+    _metrics.bytes_in += seg.payload().size();
+    if (seg.header().ack && seg.header().win == 0) {
+        _metrics.zero_windows_received++;
+    }
+    if (header_prediction(seg)) {
+        _fast_path_hits++;
+        account();
+        return;
+    }
     if (seg.header().rst) {  // Unclean shutdown of TCPConnection
         _sender.stream_in().set_error();
         _receiver.stream_out().set_error();
     } else {  // normal routine
-        _receiver.segment_received(seg);
-        if (seg.header().ack) {
-            _sender.ack_received(seg.header().ackno, seg.header().win);
+        if (seg.payload().size() && _receiver.ackno().has_value() && seg.header().seqno != _receiver.ackno().value()) {
+            _metrics.out_of_order_bytes += seg.payload().size();
         }
-        if (_receiver.ackno().has_value()) {  // syn received
-            send_segment();
-            _sender.fill_window();
-            if (seg.length_in_sequence_space() &&
-                _sender.segments_out().empty()) {  // at least one segment is sent in reply
-                // cerr << "-DEBUG: send empty ACK " << endl;
-                _sender.send_empty_ack();
-            }
-            send_segment();
+        const bool in_order_only = pressure >= MemoryPressure::DropOutOfOrder;
+        if (in_order_only && _receiver.unassembled_bytes()) {
+            TCPMemory::count_dropped(_receiver.drop_unassembled());
+        }
+        _receiver.segment_received(seg, in_order_only);
+        reply(seg.header(), seg.length_in_sequence_space());
+    }
+    account();
+    STARFISH_TRACING_ONLY(trace_state();)
+}
+
+//! \details The run is handled as one segment whose payload is the whole chain: the ACK and window of
+//! its last segment are processed once, and at most one ACK is sent in reply. (Runs carry no SYN, FIN
+//! or RST, so the rest of segment_received() doesn't apply.)
+void TCPConnection::segment_received(const CoalescedSegment &run) {
+    if (run.segments() == 1) {
+        segment_received(run.first());
+        return;
+    }
+    STARFISH_TRACE(TCPTrace::segment(TraceEvent::SegmentReceived, this, run.first()));
+
+    _last_segment_time = _curr_time;
+    _metrics.segments_in += run.segments();
+    _metrics.coalesced_segments += run.segments() - 1;
+    _metrics.bytes_in += run.payload_size();
+    if (run.header().win == 0) {
+        _metrics.zero_windows_received++;
+    }
+    if (_receiver.ackno().has_value() && run.header().seqno != _receiver.ackno().value()) {
+        _metrics.out_of_order_bytes += run.payload_size();
+    }
+    const bool in_order_only = TCPMemory::pressure() >= MemoryPressure::DropOutOfOrder;
+    if (in_order_only && _receiver.unassembled_bytes()) {
+        TCPMemory::count_dropped(_receiver.drop_unassembled());
+    }
+    _receiver.segment_received(run, in_order_only);
+    reply(run.header(), run.payload_size());
+    account();
+    STARFISH_TRACING_ONLY(trace_state();)
+}
+
+void TCPConnection::reply(const TCPHeader &hdr, const size_t length) {
+    if (hdr.ack) {
+        const size_t in_flight = _sender.bytes_in_flight();
+        const size_t window = _sender.window_size();
+        _sender.ack_received(hdr.ackno, hdr.win);
+        // (as for fast retransmit, RFC 5681: a window update is not a duplicate ACK)
+        if (in_flight && _sender.bytes_in_flight() == in_flight && length == 0 && !hdr.syn && !hdr.fin &&
+            _sender.window_size() == window) {
+            _metrics.duplicate_acks++;
+        }
+        if (_sender.window_size() != window) {
+            STARFISH_TRACE(TCPTrace::window_updated(this, window, _sender.window_size()));
         }
-        if (_receiver.stream_out().input_ended() && !_sender.stream_in().eof()) {
-            // cerr << "-DEBUG: _linger_after_streams_finish set to false " << endl;
-            _linger_after_streams_finish = false;
+    }
+    if (_receiver.ackno().has_value()) {  // syn received
+        send_segment();
+        _sender.fill_window();
+        if (length && _sender.segments_out().empty()) {  // at least one segment is sent in reply
+            _sender.send_empty_ack();
         }
+        send_segment();
+    }
+    if (_receiver.stream_out().input_ended() && !_sender.stream_in().eof()) {
+        _linger_after_streams_finish = false;
     }
 }
 
+//! \details Van Jacobson's header prediction: once our SYN is acknowledged, a segment with only
+//! ACK (and maybe PSH) set that leaves the peer's window unchanged is either
+//! - a pure ACK for new data: the receiver has nothing to do, or
+//! - the next in-order data, acknowledging nothing new: the sender has nothing to do, and the
+//!   payload goes straight into the inbound stream (see TCPReceiver::segment_received_in_order).
+bool TCPConnection::header_prediction(const TCPSegment &seg) {
+    const TCPHeader &hdr = seg.header();
+    if (!hdr.ack || hdr.syn || hdr.fin || hdr.rst || hdr.urg || !_sender.syn_acked() ||
+        hdr.win != _sender.window_size()) {
+        return false;
+    }
+    const int32_t newly_acked = hdr.ackno - (_sender.next_seqno() - _sender.bytes_in_flight());
+    if (seg.payload().size() == 0) {  // pure ACK
+        if (newly_acked <= 0 || static_cast<size_t>(newly_acked) > _sender.bytes_in_flight() ||
+            !_receiver.ackno().has_value() || hdr.seqno != _receiver.ackno().value()) {
+            return false;
+        }
+        _sender.ack_received(hdr.ackno, hdr.win);
+        _sender.fill_window();
+    } else {  // pure data
+        if (newly_acked != 0 || !_receiver.segment_received_in_order(seg)) {
+            return false;
+        }
+        _sender.send_empty_ack();
+    }
+    send_segment();
+    return true;
+}
+
 void TCPConnection::send_segment() {
     while (!_sender.segments_out().empty()) {
         TCPSegment seg = _sender.segments_out().front();
@@ -50,74 +153,165 @@ void TCPConnection::send_segment() {
             seg.header().ack = true;
             seg.header().ackno = _receiver.ackno().value();
         }
-        seg.header().win =
-            static_cast<uint16_t>(min(_receiver.window_size(), static_cast<size_t>(numeric_limits<uint16_t>::max())));
-        //  cerr << "-DEBUG: send segment with  " << seg.header().summary()  <<endl;
+        seg.header().win = receive_window();
+        if (seg.header().syn) {
+            seg.header().mss = static_cast<uint16_t>(_cfg.effective_mss());
+            seg.header().doff = TCPHeader::MSS_LENGTH / 4;
+        }
+        if (seg.header().ack) {
+            _advertised_edge = seg.header().ackno + seg.header().win;
+        }
+        STARFISH_TRACE(TCPTrace::segment(TraceEvent::SegmentSent, this, seg));
+        _metrics.segments_out++;
+        _metrics.bytes_out += seg.payload().size();
+        if (seg.header().win == 0) {
+            _metrics.zero_windows_sent++;
+        }
         _segments_out.push(move(seg));
     }
 }
 
+#ifdef STARFISH_TRACING
+void TCPConnection::trace_state() {
+    const uint8_t code = TCPTrace::state_code(state());
+    if (code != _traced_state) {
+        STARFISH_TRACE(TCPTrace::state_changed(this, _traced_state, code));
+        _traced_state = code;
+    }
+}
+#endif
+
+TCPConnectionMetrics TCPConnection::metrics() const {
+    TCPConnectionMetrics m = _metrics;
+    m.retransmissions = _sender.retransmitted_segments();
+    m.zero_window_probes = _sender.zero_window_probes();
+    m.mtu_probes_lost = _sender.lost_mtu_probes();
+    m.rtt_ms = _sender.rtt_samples();
+    return m;
+}
+
+bool TCPConnection::streams_finished() const {
+    return _receiver.stream_out().input_ended() && _sender.stream_in().eof() &&
+           _sender.next_seqno_absolute() == _sender.stream_in().bytes_written() + 2 &&
+           _sender.bytes_in_flight() == 0;  // # 1 ~ # 3 satisfied
+}
+
 bool TCPConnection::active() const {
     if (_sender.stream_in().error() || _receiver.stream_out().error())  // unclean shutdown
         return false;
-    if (!_linger_after_streams_finish) {  // clean shut down
-        if (_receiver.stream_out().input_ended() && _sender.stream_in().eof() &&
-            _sender.next_seqno_absolute() == _sender.stream_in().bytes_written() + 2 &&
-            _sender.bytes_in_flight() == 0) {  // # 1 ~ # 3 satisfied ->connection done
-            // cerr << "-DEBUG: 1~3 satified" <<endl;
-            return false;
-        } else {
-            return true;
-        }
-    } else {
-        if (_receiver.stream_out().input_ended() && _sender.stream_in().eof() &&
-            _sender.next_seqno_absolute() == _sender.stream_in().bytes_written() + 2 &&
-            _sender.bytes_in_flight() == 0) {
-            if (time_since_last_segment_received() < 10 * _cfg.rt_timeout)
-                return true;
-            else {
-                return false;
-                // cerr << "-DEBUG: no message since "<< 10*_cfg.rt_timeout << "ms, session end" <<endl;
-            }
-        } else {
-            return true;
-        }
+    if (!streams_finished()) {
+        return true;
     }
+    // clean shutdown: done at once, or after lingering
+    return _linger_after_streams_finish && time_since_last_segment_received() < 10 * _cfg.rt_timeout;
+}
+
+size_t TCPConnection::linger_remaining() const {
+    return lingering() ? 10 * _cfg.rt_timeout - time_since_last_segment_received() : 0;
+}
+
+size_t TCPConnection::advertised_window() const {
+    return static_cast<size_t>(max(_advertised_edge.value() - _receiver.ackno().value(), 0));
+}
+
+size_t TCPConnection::window_update_threshold() const {
+    return min(_sender.mss(), _receiver.capacity() / 2);
+}
+
+//! \details Like RFC 1122 (4.2.3.3), the right edge of the window only moves forward once it can move by
+//! window_update_threshold(), so the peer isn't invited to send a sliver at a time. Under memory pressure
+//! it doesn't move forward at all. The window is never shrunk to keep the edge in place, though.
+uint16_t TCPConnection::receive_window() const {
+    size_t window = min(_receiver.window_size(), static_cast<size_t>(numeric_limits<uint16_t>::max()));
+    if (!_advertised_edge.has_value() || !_receiver.ackno().has_value()) {
+        return static_cast<uint16_t>(window);
+    }
+    const size_t advertised = advertised_window();
+    if (window > advertised && (window - advertised < window_update_threshold() ||
+                                TCPMemory::pressure() >= MemoryPressure::ShrinkWindows)) {
+        window = advertised;
+    }
+    return static_cast<uint16_t>(window);
+}
+
+//! \details Without this the peer only learns that a small or zero window has reopened from the ACK
+//! of its next probe or retransmission. The update is only sent while what is left of the advertised
+//! window is under half the capacity, as otherwise the ACKs of arriving data carry it soon enough.
+void TCPConnection::window_update() {
+    if (!_advertised_edge.has_value() || !_receiver.ackno().has_value() ||
+        _receiver.stream_out().input_ended() || !active()) {
+        return;
+    }
+    const size_t advertised = advertised_window();
+    if (2 * advertised >= _receiver.capacity() || receive_window() <= advertised) {
+        return;
+    }
+    _metrics.window_updates++;
+    _sender.send_empty_ack();
+    send_segment();
+}
+
+void TCPConnection::account() {
+    _memory.charge(_sender.stream_in().buffer_size() + _sender.bytes_in_flight() +
+                   _receiver.stream_out().buffer_size() + _receiver.unassembled_bytes());
 }
 
 size_t TCPConnection::write(const string &data) {
     size_t bytes_written = _sender.stream_in().write(data);
     _sender.fill_window();
     send_segment();
+    account();
     return bytes_written;
 }
 
 //! \param[in] ms_since_last_tick number of milliseconds since the last call to this method
 void TCPConnection::tick(const size_t ms_since_last_tick) {
     _curr_time += ms_since_last_tick;
+    // free what has been drained since the last tick, so an idle connection holds no buffers
+    _segments_out.trim();
+    _sender.trim();
+    _receiver.stream_out().trim();
+    [[maybe_unused]] const uint64_t retransmitted = _sender.retransmitted_segments();
     _sender.tick(ms_since_last_tick);
+    if (_sender.retransmitted_segments() != retransmitted) {
+        STARFISH_TRACE(
+            TCPTrace::rto_fired(this, _sender.consecutive_retransmissions(), _sender.retransmission_timeout()));
+    }
+    _autotuner.tick(_curr_time, _sender);
     send_segment();
-    if (_sender.consecutive_retransmissions() > TCPConfig::MAX_RETX_ATTEMPTS) {
+    if (_sender.consecutive_retransmissions() > TCPConfig::MAX_RETX_ATTEMPTS ||
+        _sender.unanswered_probes() > TCPConfig::MAX_RETX_ATTEMPTS) {
         _sender.send_empty_rst();  // abort the connnection
         _sender.stream_in().set_error();
         _receiver.stream_out().set_error();
         send_segment();
+        STARFISH_TRACING_ONLY(trace_state();)
         return;
     } else if (_receiver.ackno().has_value()) {  // syn received
         _sender.fill_window();
     }
     send_segment();
+    window_update();  // in case the owner read without calling window_update()
+    account();
+    STARFISH_TRACING_ONLY(trace_state();)
 }
 
 void TCPConnection::end_input_stream() {
     _sender.stream_in().end_input();
     _sender.fill_window();
     send_segment();
+    STARFISH_TRACING_ONLY(trace_state();)
 }
 
 void TCPConnection::connect() {
+    if (TCPMemory::pressure() == MemoryPressure::RefuseConnections) {
+        TCPMemory::count_refused();
+        throw runtime_error("TCPConnection::connect(): refused under memory pressure");
+    }
     _sender.fill_window();
     send_segment();
+    account();
+    STARFISH_TRACING_ONLY(trace_state();)
 }
 
 TCPConnection::~TCPConnection() {
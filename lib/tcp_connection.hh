@@ -1,20 +1,25 @@
 #ifndef TCP_CONNECTION
 #define TCP_CONNECTION
 
+#include "tcp_autotuner.hh"
 #include "tcp_config.hh"
+#include "tcp_memory.hh"
+#include "tcp_metrics.hh"
 #include "tcp_receiver.hh"
 #include "tcp_sender.hh"
 #include "tcp_state.hh"
+#include "tcp_trace.hh"
 
 //! \brief A complete endpoint of a TCP connection
 class TCPConnection {
   private:
     TCPConfig _cfg;
+    TCPAutotuner _autotuner{_cfg};
     TCPReceiver _receiver{_cfg.recv_capacity};
-    TCPSender _sender{_cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn};
+    TCPSender _sender{_autotuner.initial_send_capacity(), _cfg.rt_timeout, _cfg.fixed_isn};
 
     //! outbound queue of segments that the TCPConnection wants sent
-    std::queue<TCPSegment> _segments_out{};
+    SegmentQueue _segments_out{};
 
     //! Should the TCPConnection stay active (and keep ACKing)
     //! for 10 * _cfg.rt_timeout milliseconds after both streams have ended,
@@ -24,11 +29,53 @@ class TCPConnection {
     size_t _last_segment_time{0};
     size_t _curr_time{0};
 
+    //! number of inbound segments handled by header prediction
+    size_t _fast_path_hits{0};
+
+    //! counters kept by the connection itself (the sender keeps retransmissions and RTT samples)
+    TCPConnectionMetrics _metrics{};
+
+    //! this connection's share of the stack-wide buffered bytes
+    TCPMemory _memory{};
+
+    //! right edge of the last window advertised (see receive_window())
+    std::optional<WrappingInt32> _advertised_edge{};
+
+    //! What is left of the last window advertised, in bytes
+    size_t advertised_window() const;
+
+    //! Smallest growth of the receive window worth advertising: min(MSS, capacity / 2)
+    size_t window_update_threshold() const;
+
+    //! Charge the bytes the connection buffers to _memory
+    void account();
+
+#ifdef STARFISH_TRACING
+    //! state code (see TCPTrace::state_code) at the last state-change tracepoint
+    uint8_t _traced_state{0};
+
+    //! Record a StateChanged tracepoint if the state has changed since the last one
+    void trace_state();
+#endif
+
+    //! Have both streams ended, and everything we sent been acknowledged?
+    bool streams_finished() const;
+
+    //! \brief Handle the common in-order pure-data or pure-ACK segment of an established connection
+    //! \returns `false`, without side effects, if the segment needs the full segment_received() path
+    bool header_prediction(const TCPSegment &seg);
+
+    //! \brief Process the ACK and window of `hdr` (once the receiver has its payload), and send what that allows
+    //! \param[in] length is the length in sequence space of the segment(s) `hdr` came with; if it isn't 0,
+    //! something is sent in reply
+    void reply(const TCPHeader &hdr, const size_t length);
+
   public:
     //! \name "Input" interface for the writer
     //!@{
 
     //! \brief Initiate a connection by sending a SYN segment
+    //! \throws std::runtime_error if new connections are refused under memory pressure
     void connect();
 
     //! \brief Write data to the outbound byte stream, and send it over TCP if possible
@@ -47,6 +94,11 @@ class TCPConnection {
 
     //! \brief The inbound byte stream received from the peer
     ByteStream &inbound_stream() { return _receiver.stream_out(); }
+    const ByteStream &inbound_stream() const { return _receiver.stream_out(); }
+
+    //! \brief Tell the connection that bytes have been read from inbound_stream()
+    //! \details Sends a window-update ACK if reading has reopened a window that held the peer back.
+    void window_update();
     //!@}
 
     //! \name Accessors used for testing
@@ -58,6 +110,16 @@ class TCPConnection {
     size_t unassembled_bytes() const;
     //! \brief Number of milliseconds since the last segment was received
     size_t time_since_last_segment_received() const;
+    //! \brief number of inbound segments handled by the header-prediction fast path
+    size_t fast_path_hits() const { return _fast_path_hits; }
+    //! \brief payload size of the segments sent (see TCPSender::mss())
+    size_t mss() const { return _sender.mss(); }
+    //! \brief capacity of the outbound stream (see TCPAutotuner)
+    size_t send_capacity() const { return _sender.stream_in().capacity(); }
+    //! \brief capacity of the receiver, i.e. the largest window it advertises
+    size_t recv_capacity() const { return _receiver.capacity(); }
+    //! \brief counters of what the connection has sent and received
+    TCPConnectionMetrics metrics() const;
     //!< \brief summarize the state of the sender, receiver, and the connection
     TCPState state() const { return {_sender, _receiver, active(), _linger_after_streams_finish}; };
     //!@}
@@ -68,7 +130,10 @@ class TCPConnection {
     //! Called when a new segment has been received from the network
     void segment_received(const TCPSegment &seg);
 
-    //! Called periodically when time elapses
+    //! Called with a run of consecutive segments that the owner merged (see SegmentCoalescer)
+    void segment_received(const CoalescedSegment &run);
+
+    //! Called periodically when time elapses (this also frees the buffers and queues that are empty)
     void tick(const size_t ms_since_last_tick);
 
     void send_segment();
@@ -76,16 +141,31 @@ class TCPConnection {
     //! \note The owner or operating system will dequeue these and
     //! put each one into the payload of a lower-layer datagram (usually Internet datagrams (IP),
     //! but could also be user datagrams (UDP) or any other kind).
-    std::queue<TCPSegment> &segments_out() { return _segments_out; }
+    SegmentQueue &segments_out() { return _segments_out; }
 
     //! \brief Is the connection still alive in any way?
     //! \returns `true` if either stream is still running or if the TCPConnection is lingering
     //! after both streams have finished (e.g. to ACK retransmissions from the peer)
     bool active() const;
+
+    //! \brief Is the connection only lingering (TIME_WAIT), so that an owner could keep just enough of it
+    //! to ACK the peer's retransmitted FIN?
+    bool lingering() const { return active() and _linger_after_streams_finish and streams_finished(); }
+
+    //! \brief Milliseconds left to linger, if lingering()
+    size_t linger_remaining() const;
+    //!@}
+
+    //! \name What a TIME_WAIT ACK is made of
+    //!@{
+    WrappingInt32 next_seqno() const { return _sender.next_seqno(); }
+    std::optional<WrappingInt32> ackno() const { return _receiver.ackno(); }
+    //! \brief The window to advertise, after receiver-side silly window syndrome avoidance
+    uint16_t receive_window() const;
     //!@}
 
     //! Construct a new connection from a configuration
-    explicit TCPConnection(const TCPConfig &cfg) : _cfg{cfg} {}
+    explicit TCPConnection(const TCPConfig &cfg) : _cfg{cfg} { _sender.set_mss(_cfg.effective_mss(), _cfg.plpmtud); }
 
     //! \name construction and destruction
     //! moving is allowed; copying is disallowed; default construction not possible
@@ -0,0 +1,87 @@
+#include "ephemeral_ports.hh"
+
+#include <utility>
+
+using namespace std;
+
+FlowKey EphemeralPorts::_destination(const FlowKey &flow) {
+    FlowKey d = flow;
+    d.local_port = 0;
+    return d;
+}
+
+EphemeralPorts::Bitmap &EphemeralPorts::_bitmap(const FlowKey &dest) {
+    if (const auto it = _in_use.find(dest); it != _in_use.end()) {
+        return it->second;
+    }
+    if (_spare.empty()) {
+        return _in_use[dest];
+    }
+    auto node = move(_spare.back());  // (all zeros: it was forgotten with no port in use)
+    _spare.pop_back();
+    node.key() = dest;
+    return _in_use.insert(move(node)).position->second;
+}
+
+EphemeralPorts::EphemeralPorts() : _key(random_sip_key()) { _spare.reserve(SPARE_BITMAPS); }
+
+optional<uint16_t> EphemeralPorts::allocate(const FlowKey &flow) {
+    const FlowKey dest = _destination(flow);
+    Bitmap &bits = _bitmap(dest);
+
+    const size_t start = (siphash24(_key, &dest, sizeof(dest)) + _next++) % COUNT;
+    // the word holding `start` is visited twice: first from `start` up, last below `start`
+    for (size_t n = 0; n <= bits.words.size(); ++n) {
+        const size_t word = (start / 64 + n) % bits.words.size();
+        uint64_t free = ~bits.words[word];
+        if (n == 0) {
+            free &= ~uint64_t{0} << (start % 64);
+        }
+        if (free) {
+            const size_t bit = __builtin_ctzll(free);
+            bits.words[word] |= uint64_t{1} << bit;
+            ++bits.used;
+            return FIRST + word * 64 + bit;
+        }
+    }
+    return {};
+}
+
+bool EphemeralPorts::reserve(const FlowKey &flow) {
+    if (flow.local_port < FIRST) {
+        return true;
+    }
+    const size_t i = flow.local_port - FIRST;
+    Bitmap &bits = _bitmap(_destination(flow));
+    const uint64_t mask = uint64_t{1} << (i % 64);
+    if (bits.words[i / 64] & mask) {
+        return false;
+    }
+    bits.words[i / 64] |= mask;
+    ++bits.used;
+    return true;
+}
+
+void EphemeralPorts::release(const FlowKey &flow) {
+    const auto it = _in_use.find(_destination(flow));
+    if (it == _in_use.end() or flow.local_port < FIRST) {
+        return;
+    }
+    const size_t i = flow.local_port - FIRST;
+    const uint64_t mask = uint64_t{1} << (i % 64);
+    if (it->second.words[i / 64] & mask) {
+        it->second.words[i / 64] &= ~mask;
+        if (--it->second.used == 0) {  // forget destinations with no connections, keeping the bitmap if there's room
+            if (_spare.size() < SPARE_BITMAPS) {
+                _spare.push_back(_in_use.extract(it));
+            } else {
+                _in_use.erase(it);
+            }
+        }
+    }
+}
+
+size_t EphemeralPorts::in_use(const FlowKey &flow) const {
+    const auto it = _in_use.find(_destination(flow));
+    return it == _in_use.end() ? 0 : it->second.used;
+}
@@ -0,0 +1,74 @@
+#ifndef EPHEMERAL_PORTS
+#define EPHEMERAL_PORTS
+
+#include "flow_key.hh"
+#include "siphash.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! \brief Allocates local ports for active opens, with a bitmap of the ports in use per destination
+//! \details A port only has to be unique among the flows between the same local address and the same
+//! remote address and port, so each such destination has its own bitmap of the ephemeral range. A
+//! search starts at a keyed hash of the destination plus a counter (RFC 6056, algorithm 3) and finds
+//! the next free port a 64-bit word at a time. A destination's bitmap is forgotten when its last port is
+//! released, but kept (up to SPARE_BITMAPS of them) for the next new destination, so connect/close cycles
+//! don't allocate. Not thread-safe.
+class EphemeralPorts {
+  public:
+    //! \name The IANA ephemeral range (RFC 6335)
+    //!@{
+    static constexpr uint16_t FIRST = 49152;
+    static constexpr uint16_t LAST = 65535;
+    static constexpr size_t COUNT = LAST - FIRST + 1;
+    //!@}
+
+    //! Most bitmaps of forgotten destinations kept for reuse
+    static constexpr size_t SPARE_BITMAPS = 16;
+
+  private:
+    //! The ports in use to one destination
+    struct Bitmap {
+        std::array<uint64_t, COUNT / 64> words{};
+        size_t used{0};
+    };
+
+    SipKey _key;
+    uint32_t _next{0};  //!< added to each search's starting point, so consecutive searches don't collide
+    std::unordered_map<FlowKey, Bitmap, FlowKeyHash> _in_use{};  //!< keyed by destination (local_port 0)
+    std::vector<decltype(_in_use)::node_type> _spare{};          //!< emptied bitmaps, ready for reuse
+
+    //! `flow` without its local port
+    static FlowKey _destination(const FlowKey &flow);
+
+    //! `dest`'s bitmap, taken from _spare (or else allocated) if `dest` has none
+    Bitmap &_bitmap(const FlowKey &dest);
+
+  public:
+    //! Construct with a key drawn from std::random_device
+    EphemeralPorts();
+
+    //! Construct with a fixed key (e.g. to test)
+    explicit EphemeralPorts(const SipKey &key) : _key(key) { _spare.reserve(SPARE_BITMAPS); }
+
+    //! \brief Take a free port from `flow.local_address` to `flow.remote_address:remote_port`
+    //! \details `flow.local_port` is ignored.
+    //! \returns the port, or nothing if every ephemeral port to that destination is in use
+    std::optional<uint16_t> allocate(const FlowKey &flow);
+
+    //! \brief Mark `flow.local_port` in use (e.g. a port the application chose)
+    //! \returns false if it was already in use; ports outside the ephemeral range are not tracked
+    bool reserve(const FlowKey &flow);
+
+    //! Return `flow.local_port` to the free ports of its destination
+    void release(const FlowKey &flow);
+
+    //! Number of ports in use to `flow`'s destination
+    size_t in_use(const FlowKey &flow) const;
+};
+
+#endif /* EPHEMERAL_PORTS */
@@ -0,0 +1,149 @@
+#ifndef FAST_PARSER
+#define FAST_PARSER
+
+#include "buffer.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_header.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+
+//! \brief Fixed-offset parser for the IPv4 and TCP headers on the receive path
+//! \details NetParser consumes its Buffer one field at a time, bounds-checking every byte.
+//! FastParser checks the length once and then decodes each field with a single unaligned
+//! load at its fixed offset. NetParser remains the generic (slow) path.
+class FastParser {
+  public:
+    //! Load a big-endian integer of width `sizeof(T)` from (possibly unaligned) `p`
+    template <typename T>
+    static T load(const char *p) {
+        T val;
+        std::memcpy(&val, p, sizeof(T));
+        if constexpr (sizeof(T) == 1) {
+            return val;
+        } else if constexpr (sizeof(T) == 2) {
+            return be16toh(val);
+        } else {
+            static_assert(sizeof(T) == 4, "FastParser::load supports 8, 16 and 32-bit fields");
+            return be32toh(val);
+        }
+    }
+
+    //! \brief Parse an IPv4 header from the front of `buffer`
+    //! \note Performs the same checks, in the same order, as IPv4Header::parse
+    static ParseResult parse_ipv4(const Buffer &buffer, IPv4Header &header) {
+        const std::string_view data = buffer.str();
+        if (data.size() < IPv4Header::LENGTH) {
+            return ParseResult::PacketTooShort;
+        }
+        const char *p = data.data();
+
+        const uint8_t first_byte = load<uint8_t>(p);
+        header.ver = first_byte >> 4;
+        header.hlen = first_byte & 0x0f;
+        header.tos = load<uint8_t>(p + 1);
+        header.len = load<uint16_t>(p + 2);
+        header.id = load<uint16_t>(p + 4);
+
+        const uint16_t fo_val = load<uint16_t>(p + 6);
+        header.df = static_cast<bool>(fo_val & 0x4000);
+        header.mf = static_cast<bool>(fo_val & 0x2000);
+        header.offset = fo_val & 0x1fff;
+
+        header.ttl = load<uint8_t>(p + 8);
+        header.proto = load<uint8_t>(p + 9);
+        header.cksum = load<uint16_t>(p + 10);
+        header.src = load<uint32_t>(p + 12);
+        header.dst = load<uint32_t>(p + 16);
+
+        if (data.size() < 4 * size_t(header.hlen)) {
+            return ParseResult::PacketTooShort;
+        }
+        if (header.ver != 4) {
+            return ParseResult::WrongIPVersion;
+        }
+        if (header.hlen < 5) {
+            return ParseResult::HeaderTooShort;
+        }
+        if (data.size() != header.len) {
+            return ParseResult::TruncatedPacket;
+        }
+
+        InternetChecksum check;
+        check.add({p, 4 * size_t(header.hlen)});
+        if (check.value()) {
+            return ParseResult::BadChecksum;
+        }
+
+        return ParseResult::NoError;
+    }
+
+    //! \brief Parse a TCP header from the front of `buffer`
+    //! \note Performs the same checks as TCPHeader::parse (the checksum is verified by TCPSegment)
+    static ParseResult parse_tcp(const Buffer &buffer, TCPHeader &header) {
+        const std::string_view data = buffer.str();
+        if (data.size() < TCPHeader::LENGTH) {
+            return ParseResult::PacketTooShort;
+        }
+        const char *p = data.data();
+
+        header.sport = load<uint16_t>(p);
+        header.dport = load<uint16_t>(p + 2);
+        header.seqno = WrappingInt32{load<uint32_t>(p + 4)};
+        header.ackno = WrappingInt32{load<uint32_t>(p + 8)};
+        header.doff = load<uint8_t>(p + 12) >> 4;
+
+        const uint8_t fl_b = load<uint8_t>(p + 13);
+        header.urg = static_cast<bool>(fl_b & 0b0010'0000);
+        header.ack = static_cast<bool>(fl_b & 0b0001'0000);
+        header.psh = static_cast<bool>(fl_b & 0b0000'1000);
+        header.rst = static_cast<bool>(fl_b & 0b0000'0100);
+        header.syn = static_cast<bool>(fl_b & 0b0000'0010);
+        header.fin = static_cast<bool>(fl_b & 0b0000'0001);
+
+        header.win = load<uint16_t>(p + 14);
+        header.cksum = load<uint16_t>(p + 16);
+        header.uptr = load<uint16_t>(p + 18);
+
+        if (header.doff < 5) {
+            return ParseResult::HeaderTooShort;
+        }
+        if (data.size() < 4 * size_t(header.doff)) {
+            return ParseResult::PacketTooShort;
+        }
+        if (header.doff > TCPHeader::LENGTH / 4) {
+            header.parse_options(data.substr(TCPHeader::LENGTH, 4 * size_t(header.doff) - TCPHeader::LENGTH));
+        } else {
+            header.mss = 0;
+        }
+
+        return ParseResult::NoError;
+    }
+};
+
+//! \brief Fixed-offset counterpart of NetUnparser: writes fields straight into preallocated header space
+struct FastUnparser {
+    //! Store `val` big-endian, in `sizeof(T)` bytes, at (possibly unaligned) `p`
+    template <typename T>
+    static void store(char *p, const T val) {
+        T out;
+        if constexpr (sizeof(T) == 1) {
+            out = val;
+        } else if constexpr (sizeof(T) == 2) {
+            out = htobe16(val);
+        } else {
+            static_assert(sizeof(T) == 4, "FastUnparser::store supports 8, 16 and 32-bit fields");
+            out = htobe32(val);
+        }
+        std::memcpy(p, &out, sizeof(T));
+    }
+};
+
+//! \class FastParser
+//! Callers strip the parsed header with Buffer::remove_prefix (`4 * hlen` or `4 * doff` bytes),
+//! which touches the Buffer's reference count once per header instead of once per field.
+
+#endif /* FAST_PARSER */
@@ -0,0 +1,54 @@
+#ifndef FLOW_KEY
+#define FLOW_KEY
+
+#include "tcp_config.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+//! \brief The addresses and ports of one TCP flow, seen from the local end, in host byte order
+//! \details The per-packet path matches and fills headers with these numbers. They are taken from an
+//! FdAdapterConfig's Address objects once, when a connection is set up: Address::port() goes through
+//! getnameinfo() and string parsing, which is too slow for every packet. The fields are in host byte
+//! order, like the parsed IPv4Header and TCPHeader they are compared with.
+struct FlowKey {
+    uint32_t local_address{0};
+    uint32_t remote_address{0};
+    uint16_t local_port{0};
+    uint16_t remote_port{0};
+
+    //! The flow of an adapter's `source` (local) and `destination` (remote)
+    static FlowKey from(const FdAdapterConfig &cfg) {
+        return {cfg.source.ipv4_numeric(), cfg.destination.ipv4_numeric(), cfg.source.port(), cfg.destination.port()};
+    }
+
+    //! The FdAdapterConfig with `source` local and `destination` remote (slow: builds Address objects)
+    FdAdapterConfig config() const {
+        FdAdapterConfig cfg;
+        cfg.source = {Address::from_ipv4_numeric(local_address).ip(), local_port};
+        cfg.destination = {Address::from_ipv4_numeric(remote_address).ip(), remote_port};
+        return cfg;
+    }
+
+    bool operator==(const FlowKey &other) const {
+        return local_address == other.local_address and remote_address == other.remote_address and
+               local_port == other.local_port and remote_port == other.remote_port;
+    }
+    bool operator!=(const FlowKey &other) const { return not operator==(other); }
+};
+
+static_assert(std::is_trivially_copyable_v<FlowKey> and sizeof(FlowKey) == 12, "FlowKey should stay compact");
+
+//! \brief Hash of a FlowKey: the twelve bytes folded into one word, then two multiply-xorshift rounds
+struct FlowKeyHash {
+    size_t operator()(const FlowKey &k) const noexcept {
+        uint64_t h = (uint64_t{k.local_address} << 32 | k.remote_address) ^
+                     (uint64_t{k.local_port} << 16 | k.remote_port) * 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+};
+
+#endif /* FLOW_KEY */
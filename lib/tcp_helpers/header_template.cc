@@ -0,0 +1,68 @@
+#include "header_template.hh"
+
+#include "fast_parser.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <string_view>
+
+using namespace std;
+
+static constexpr size_t IP_LEN_OFFSET = 2;                            //!< IPv4 total length
+static constexpr size_t IP_CKSUM_OFFSET = 10;                         //!< IPv4 header checksum
+static constexpr size_t TCP_SEQNO_OFFSET = IPv4Header::LENGTH + 4;    //!< TCP seqno, then ackno
+static constexpr size_t TCP_FLAGS_OFFSET = IPv4Header::LENGTH + 13;   //!< TCP flags, then window
+static constexpr size_t TCP_CKSUM_OFFSET = IPv4Header::LENGTH + 16;   //!< TCP checksum
+
+//! Sum of the big-endian 16-bit words of `data` (of even length), unfolded
+static uint32_t word_sum(const string_view data) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < data.size(); i += 2) {
+        sum += FastParser::load<uint16_t>(data.data() + i);
+    }
+    return sum;
+}
+
+//! \details The changing fields are left 0 in the template, so they add nothing to the sums.
+HeaderTemplate::HeaderTemplate(const FlowKey &flow) {
+    IPv4Header ip;
+    ip.src = flow.local_address;
+    ip.dst = flow.remote_address;
+    ip.serialize(_bytes.data());
+
+    TCPHeader tcp;
+    tcp.sport = flow.local_port;
+    tcp.dport = flow.remote_port;
+    tcp.serialize(_bytes.data() + IPv4Header::LENGTH);
+
+    const string_view bytes{_bytes.data(), _bytes.size()};
+    _ip_sum = word_sum(bytes.substr(0, IPv4Header::LENGTH));
+    ip.len = IPv4Header::LENGTH;  // so the pseudo-header's TCP length is 0 too
+    _tcp_sum = ip.pseudo_cksum() + word_sum(bytes.substr(IPv4Header::LENGTH));
+}
+
+Buffer HeaderTemplate::write(const TCPHeader &hdr, Buffer &payload) {
+    const size_t tcp_length = TCPHeader::LENGTH + payload.size();
+    char *const out = payload.headroom_data(LENGTH);  // throws if there isn't enough headroom
+    copy(_bytes.begin(), _bytes.end(), out);
+
+    const uint16_t ip_length = IPv4Header::LENGTH + tcp_length;
+    FastUnparser::store<uint16_t>(out + IP_LEN_OFFSET, ip_length);
+    FastUnparser::store<uint16_t>(out + IP_CKSUM_OFFSET, InternetChecksum{_ip_sum + ip_length}.value());
+
+    const uint32_t seqno = hdr.seqno.raw_value();
+    const uint32_t ackno = hdr.ackno.raw_value();
+    const uint8_t flags = (hdr.ack ? 0b0001'0000 : 0) | (hdr.psh ? 0b0000'1000 : 0) | (hdr.rst ? 0b0000'0100 : 0) |
+                          (hdr.syn ? 0b0000'0010 : 0) | (hdr.fin ? 0b0000'0001 : 0);
+    FastUnparser::store<uint32_t>(out + TCP_SEQNO_OFFSET, seqno);
+    FastUnparser::store<uint32_t>(out + TCP_SEQNO_OFFSET + 4, ackno);
+    FastUnparser::store<uint8_t>(out + TCP_FLAGS_OFFSET, flags);
+    FastUnparser::store<uint16_t>(out + TCP_FLAGS_OFFSET + 1, hdr.win);
+
+    InternetChecksum check{_tcp_sum + static_cast<uint32_t>(tcp_length) + (seqno >> 16) + (seqno & 0xffff) +
+                           (ackno >> 16) + (ackno & 0xffff) + flags + hdr.win};
+    check.add(payload);
+    FastUnparser::store<uint16_t>(out + TCP_CKSUM_OFFSET, check.value());
+
+    return payload.expand_into_headroom(LENGTH);
+}
@@ -0,0 +1,47 @@
+#ifndef HEADER_TEMPLATE
+#define HEADER_TEMPLATE
+
+#include "buffer.hh"
+#include "flow_key.hh"
+#include "ipv4_header.hh"
+#include "tcp_header.hh"
+#include "tcp_segment.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief The IPv4 and TCP headers of one flow's outbound segments, prebuilt
+//! \details Of the 40 bytes, only the IPv4 length and checksum and the TCP seqno, ackno, flags, window
+//! and checksum change from segment to segment. The template holds the rest, and the sums of the
+//! constant fields that each checksum covers (the TCP one including the pseudo-header), so write()
+//! copies the template, stores the changing fields, and adds them to the sums: only the payload is
+//! summed from scratch. The datagrams are byte-for-byte those of IPv4Datagram::serialize_in_place()
+//! with a default IPv4Header.
+class HeaderTemplate {
+  public:
+    static constexpr size_t LENGTH = IPv4Header::LENGTH + TCPHeader::LENGTH;  //!< bytes written
+
+  private:
+    std::array<char, LENGTH> _bytes{};
+    uint32_t _ip_sum{0};   //!< sum of the constant fields of the IPv4 header
+    uint32_t _tcp_sum{0};  //!< sum of the constant fields of the pseudo-header and TCP header
+
+  public:
+    //! Build the template of `flow`'s outbound headers
+    explicit HeaderTemplate(const FlowKey &flow = {});
+
+    //! \brief Can write() wrap `seg`: a header without options or URG, and LENGTH bytes of headroom?
+    static bool fits(const TCPSegment &seg) {
+        const TCPHeader &hdr = seg.header();
+        return hdr.doff == TCPHeader::LENGTH / 4 and not hdr.urg and seg.payload().headroom() >= LENGTH;
+    }
+
+    //! \brief Write the headers of a segment with `header` into the headroom in front of `payload` (see fits())
+    //! \details `payload` must be the caller's to write: the headroom is shared by every copy of it (e.g. the
+    //! retransmission queue's), so the result is only valid until the next in-place write into that storage.
+    //! \returns the whole datagram, sharing the payload's storage
+    Buffer write(const TCPHeader &header, Buffer &payload);
+};
+
+#endif /* HEADER_TEMPLATE */
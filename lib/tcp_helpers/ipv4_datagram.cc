@@ -1,4 +1,6 @@
 #include "ipv4_datagram.hh"
+
+#include "fast_parser.hh"
 #include "parser.hh"
 #include "util.hh"
 
@@ -7,16 +9,23 @@
 
 using namespace std;
 
+static constexpr size_t CKSUM_OFFSET = 10;  //!< Offset of the checksum field in the IPv4 header
+
 ParseResult IPv4Datagram::parse(const Buffer buffer) {
-    NetParser p{buffer};
-    _header.parse(p);
-    _payload = p.buffer();
+    const ParseResult res = FastParser::parse_ipv4(buffer, _header);
+    if (res != ParseResult::NoError) {
+        return res;
+    }
+
+    Buffer payload = buffer;
+    payload.remove_prefix(4 * _header.hlen);
+    _payload = payload;
 
     if (_payload.size() != _header.payload_length()) {
         return ParseResult::PacketTooShort;
     }
 
-    return p.get_error();
+    return ParseResult::NoError;
 }
 
 BufferList IPv4Datagram::serialize() const {
@@ -26,15 +35,38 @@ BufferList IPv4Datagram::serialize() const {
 
     IPv4Header header_out = _header;
     header_out.cksum = 0;
-    const string header_zero_checksum = header_out.serialize();
+    string header_str = header_out.serialize();
 
     // calculate checksum -- taken over header only
     InternetChecksum check;
-    check.add(header_zero_checksum);
-    header_out.cksum = check.value();
+    check.add(header_str);
+    FastUnparser::store<uint16_t>(header_str.data() + CKSUM_OFFSET, check.value());
 
     BufferList ret;
-    ret.append(header_out.serialize());
+    ret.append(move(header_str));
     ret.append(_payload);
     return ret;
 }
+
+//! \param[in] header is the IPv4 header to write (its checksum field is recomputed)
+//! \param[in] payload must have at least `4 * header.hlen` bytes of headroom, which the caller owns
+//! \returns a Buffer holding the whole datagram, sharing the payload's storage
+Buffer IPv4Datagram::serialize_in_place(const IPv4Header &header, Buffer &payload) {
+    if (payload.size() != header.payload_length()) {
+        throw runtime_error("IPv4Datagram::serialize_in_place: payload is wrong size");
+    }
+
+    const size_t header_len = 4 * size_t(header.hlen);
+    char *const out = payload.headroom_data(header_len);  // throws if there isn't enough headroom
+
+    IPv4Header header_out = header;
+    header_out.cksum = 0;
+    header_out.serialize(out);
+
+    // calculate checksum -- taken over header only
+    InternetChecksum check;
+    check.add({out, header_len});
+    FastUnparser::store<uint16_t>(out + CKSUM_OFFSET, check.value());
+
+    return payload.expand_into_headroom(header_len);
+}
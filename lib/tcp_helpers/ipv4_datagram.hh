@@ -17,6 +17,9 @@ class IPv4Datagram {
     //! \brief Serialize the segment to a string
     BufferList serialize() const;
 
+    //! \brief Serialize `header` into the headroom in front of `payload`, computing the header checksum
+    static Buffer serialize_in_place(const IPv4Header &header, Buffer &payload);
+
     //! \name Accessors
     //!@{
     const IPv4Header &header() const { return _header; }
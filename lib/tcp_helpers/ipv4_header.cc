@@ -1,7 +1,9 @@
 #include "ipv4_header.hh"
 
+#include "fast_parser.hh"
 #include "util.hh"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <iomanip>
 #include <sstream>
@@ -76,6 +78,14 @@ ParseResult IPv4Header::parse(NetParser &p) {
 
 //! Serialize the IPv4Header to a string (does not recompute the checksum)
 string IPv4Header::serialize() const {
+    string ret(4 * size_t(hlen), 0);
+    serialize(ret.data());
+    return ret;
+}
+
+//! Serialize the IPv4Header into preallocated space (does not recompute the checksum)
+//! \param[out] out points to `4 * hlen` writable bytes; any options area is zero-filled
+void IPv4Header::serialize(char *out) const {
     // sanity checks
     if (ver != 4) {
         throw runtime_error("wrong IP version");
@@ -84,29 +94,24 @@ string IPv4Header::serialize() const {
         throw runtime_error("IP header too short");
     }
 
-    string ret;
-    ret.reserve(4 * hlen);
-
     const uint8_t first_byte = (ver << 4) | (hlen & 0xf);
-    NetUnparser::u8(ret, first_byte);  // version and header length
-    NetUnparser::u8(ret, tos);         // type of service
-    NetUnparser::u16(ret, len);        // length
-    NetUnparser::u16(ret, id);         // id
+    FastUnparser::store<uint8_t>(out, first_byte);  // version and header length
+    FastUnparser::store<uint8_t>(out + 1, tos);     // type of service
+    FastUnparser::store<uint16_t>(out + 2, len);    // length
+    FastUnparser::store<uint16_t>(out + 4, id);     // id
 
     const uint16_t fo_val = (df ? 0x4000 : 0) | (mf ? 0x2000 : 0) | (offset & 0x1fff);
-    NetUnparser::u16(ret, fo_val);  // flags and offset
-
-    NetUnparser::u8(ret, ttl);    // time to live
-    NetUnparser::u8(ret, proto);  // protocol number
+    FastUnparser::store<uint16_t>(out + 6, fo_val);  // flags and offset
 
-    NetUnparser::u16(ret, cksum);  // checksum
+    FastUnparser::store<uint8_t>(out + 8, ttl);    // time to live
+    FastUnparser::store<uint8_t>(out + 9, proto);  // protocol number
 
-    NetUnparser::u32(ret, src);  // src address
-    NetUnparser::u32(ret, dst);  // dst address
+    FastUnparser::store<uint16_t>(out + 10, cksum);  // checksum
 
-    ret.resize(4 * hlen);  // expand header to advertised size
+    FastUnparser::store<uint32_t>(out + 12, src);  // src address
+    FastUnparser::store<uint32_t>(out + 16, dst);  // dst address
 
-    return ret;
+    fill(out + IPv4Header::LENGTH, out + 4 * hlen, 0);  // expand header to advertised size
 }
 
 uint16_t IPv4Header::payload_length() const { return len - 4 * hlen; }
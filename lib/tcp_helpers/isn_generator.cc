@@ -0,0 +1,27 @@
+#include "isn_generator.hh"
+
+#include <chrono>
+
+using namespace std;
+
+ISNGenerator &ISNGenerator::global() {
+    static ISNGenerator generator{random_sip_key()};
+    return generator;
+}
+
+//! \details M + F(localip, localport, remoteip, remoteport, secretkey), where M ticks every 4 µs
+//! (RFC 6528, section 3).
+WrappingInt32 ISNGenerator::isn(const FlowKey &flow, const uint64_t now_us) const {
+    const uint64_t f = siphash24(_key, &flow, sizeof(flow));
+    return WrappingInt32{static_cast<uint32_t>(now_us / 4 + f)};
+}
+
+WrappingInt32 ISNGenerator::isn(const FlowKey &flow) const {
+    const auto now = chrono::steady_clock::now().time_since_epoch();
+    return isn(flow, chrono::duration_cast<chrono::microseconds>(now).count());
+}
+
+WrappingInt32 ISNGenerator::unpredictable() {
+    const uint64_t n = _counter.fetch_add(1, memory_order_relaxed);
+    return WrappingInt32{static_cast<uint32_t>(siphash24(_key, &n, sizeof(n)))};
+}
@@ -0,0 +1,46 @@
+#ifndef ISN_GENERATOR
+#define ISN_GENERATOR
+
+#include "flow_key.hh"
+#include "siphash.hh"
+#include "wrapping_integers.hh"
+
+#include <atomic>
+#include <cstdint>
+
+//! \brief Initial sequence numbers as in RFC 6528: a 4 µs clock plus a keyed hash of the flow
+//! \details The key is drawn once; after that an ISN costs one SipHash and a clock read, rather than
+//! reads of std::random_device. ISNs of one flow advance with the clock, so a new incarnation of a
+//! flow starts above its predecessor's sequence numbers, while an off-path attacker who doesn't know
+//! the key can't guess another flow's ISN from its own.
+class ISNGenerator {
+  private:
+    SipKey _key;
+    std::atomic<uint64_t> _counter{0};  //!< input of unpredictable()
+
+  public:
+    //! Construct with a fixed key (e.g. to test)
+    explicit ISNGenerator(const SipKey &key) : _key(key) {}
+
+    //! The process-wide generator, keyed from std::random_device the first time it's used
+    static ISNGenerator &global();
+
+    //! \brief The ISN of `flow` at `now_us` microseconds on a monotonic clock
+    WrappingInt32 isn(const FlowKey &flow, const uint64_t now_us) const;
+
+    //! \brief The ISN of `flow` now
+    WrappingInt32 isn(const FlowKey &flow) const;
+
+    //! \brief An ISN for a connection whose flow isn't known yet (e.g. one that waits for a SYN)
+    //! \details The keyed hash of a counter: as hard to guess as isn(), but not ordered by the clock.
+    WrappingInt32 unpredictable();
+
+    //! \name
+    //! The counter is atomic, so the generator can be shared by threads but not copied
+    //!@{
+    ISNGenerator(const ISNGenerator &other) = delete;
+    ISNGenerator &operator=(const ISNGenerator &other) = delete;
+    //!@}
+};
+
+#endif /* ISN_GENERATOR */
@@ -0,0 +1,77 @@
+#include "link_emulator.hh"
+
+#include "ipv4_header.hh"
+#include "tcp_header.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+//! \param[in] cfg is the link's rate, delay and impairments
+LinkEmulator::LinkEmulator(const LinkConfig &cfg) : _cfg(cfg), _rng(cfg.seed) {}
+
+bool LinkEmulator::_chance(const double p) {
+    return p > 0 and uniform_real_distribution<double>{0, 1}(_rng) < p;
+}
+
+uint64_t LinkEmulator::_transmission_us(const TCPSegment &seg) const {
+    if (_cfg.bandwidth_bps == 0) {
+        return 0;
+    }
+    const uint64_t bits = 8 * (IPv4Header::LENGTH + TCPHeader::LENGTH + seg.payload().size());
+    return bits * 1000000 / _cfg.bandwidth_bps;
+}
+
+//! \details A segment that finds `queue_limit` segments waiting for the link is dropped (tail drop).
+//! Loss is decided after queueing, as if on the wire, so a lost segment still uses link time.
+void LinkEmulator::send(const TCPSegment &seg, const uint64_t now_us) {
+    _stats.sent++;
+    if (_cfg.mtu and IPv4Header::LENGTH + TCPHeader::LENGTH + seg.payload().size() > _cfg.mtu) {
+        _stats.too_big++;
+        return;
+    }
+
+    while (not _departures.empty() and _departures.front() <= now_us) {
+        _departures.pop();
+    }
+    if (_cfg.queue_limit and _departures.size() >= _cfg.queue_limit) {
+        _stats.overflowed++;
+        return;
+    }
+    _link_free_us = max(_link_free_us, now_us) + _transmission_us(seg);
+    _departures.push(_link_free_us);
+
+    // the Gilbert-Elliott state changes once per segment
+    _bad_state = _bad_state ? not _chance(_cfg.burst_exit) : _chance(_cfg.burst_enter);
+    if (_chance(_bad_state ? _cfg.burst_loss : _cfg.loss)) {
+        _stats.lost++;
+        return;
+    }
+
+    const auto arrival = [&] {
+        uint64_t t = _link_free_us + _cfg.delay_us;
+        if (_cfg.jitter_us) {
+            t += uniform_int_distribution<uint64_t>{0, _cfg.jitter_us}(_rng);
+        }
+        return t;
+    };
+    uint64_t arrival_us = arrival();
+    if (_chance(_cfg.reorder)) {
+        _stats.reordered++;
+        arrival_us += _cfg.reorder_us;
+    }
+    _in_flight.push({arrival_us, _order++, seg});
+    if (_chance(_cfg.duplicate)) {
+        _stats.duplicated++;
+        _in_flight.push({arrival(), _order++, seg});
+    }
+}
+
+vector<TCPSegment> LinkEmulator::receive(const uint64_t now_us) {
+    vector<TCPSegment> arrived;
+    while (not _in_flight.empty() and _in_flight.top().arrival_us <= now_us) {
+        arrived.push_back(_in_flight.top().seg);
+        _in_flight.pop();
+    }
+    return arrived;
+}
@@ -0,0 +1,96 @@
+#ifndef LINK_EMULATOR
+#define LINK_EMULATOR
+
+#include "tcp_segment.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <random>
+#include <vector>
+
+//! Config for LinkEmulator
+class LinkConfig {
+  public:
+    uint64_t bandwidth_bps = 0;  //!< Link rate in bits per second (0 means unlimited)
+    uint64_t delay_us = 0;       //!< One-way propagation delay
+    uint64_t jitter_us = 0;      //!< Extra delay, uniform in [0, jitter_us], per segment
+    size_t queue_limit = 0;      //!< Segments that may wait for the link before the tail is dropped (0: no limit)
+    size_t mtu = 0;              //!< Largest datagram the link carries, counting 40 bytes of headers (0: no limit)
+
+    double loss = 0;  //!< Probability that a segment is lost (in the Gilbert-Elliott "good" state)
+
+    //! \name Bursty loss (Gilbert-Elliott): the link alternates between a good and a bad state
+    //!@{
+    double burst_enter = 0;  //!< Per-segment probability of going from good to bad
+    double burst_exit = 1;   //!< Per-segment probability of going from bad to good
+    double burst_loss = 1;   //!< Probability that a segment is lost in the bad state
+    //!@}
+
+    double duplicate = 0;     //!< Probability that a segment is delivered twice
+    double reorder = 0;       //!< Probability that a segment is held back by `reorder_us`
+    uint64_t reorder_us = 0;  //!< How long a reordered segment is held back
+
+    uint64_t seed = 0;  //!< Seed of the emulator's random choices: the same seed gives the same run
+};
+
+//! \brief A deterministic, one-way emulated link between two in-process TCPConnections
+//! \details send() puts a segment on the link at time `now_us`: it waits for the link to be free,
+//! takes its serialization time at `bandwidth_bps` (counting 40 bytes of IPv4 and TCP headers), then
+//! arrives after the propagation delay plus jitter. Segments may be dropped for exceeding the MTU,
+//! lost, duplicated or held back as configured. receive() returns the segments that have arrived by a given time, in arrival order.
+//! Every random choice comes from a generator seeded with LinkConfig::seed.
+class LinkEmulator {
+  public:
+    //! Counters of what the link has done
+    struct Stats {
+        uint64_t sent{0};        //!< segments offered to send()
+        uint64_t lost{0};        //!< segments dropped by random or bursty loss
+        uint64_t overflowed{0};  //!< segments dropped because the queue was full
+        uint64_t too_big{0};     //!< segments dropped because they exceeded the MTU
+        uint64_t duplicated{0};  //!< extra copies delivered
+        uint64_t reordered{0};   //!< segments held back
+    };
+
+  private:
+    struct InFlight {
+        uint64_t arrival_us;
+        uint64_t order;  //!< breaks ties in send order
+        TCPSegment seg;
+
+        bool operator>(const InFlight &other) const {
+            return arrival_us != other.arrival_us ? arrival_us > other.arrival_us : order > other.order;
+        }
+    };
+
+    LinkConfig _cfg;
+    std::mt19937_64 _rng;
+    std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight>> _in_flight{};
+    std::queue<uint64_t> _departures{};  //!< when each segment still queued for the link leaves it
+    uint64_t _link_free_us{0};           //!< when the link finishes serializing the last segment sent
+    uint64_t _order{0};
+    bool _bad_state{false};
+    Stats _stats{};
+
+    //! true with probability `p`
+    bool _chance(const double p);
+
+    //! Serialization time of `seg` at the link rate
+    uint64_t _transmission_us(const TCPSegment &seg) const;
+
+  public:
+    explicit LinkEmulator(const LinkConfig &cfg);
+
+    //! Put `seg` on the link at time `now_us`
+    void send(const TCPSegment &seg, const uint64_t now_us);
+
+    //! Remove and return the segments that have arrived by `now_us`
+    std::vector<TCPSegment> receive(const uint64_t now_us);
+
+    //! Segments on the link that have not arrived yet
+    size_t in_flight() const { return _in_flight.size(); }
+
+    const Stats &stats() const { return _stats; }
+};
+
+#endif /* LINK_EMULATOR */
@@ -0,0 +1,61 @@
+#include "path_mtu.hh"
+
+#include "tcp_config.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+PathMTUDiscovery::PathMTUDiscovery(const bool probing, const size_t base, const size_t ceiling)
+    : _probing(probing), _ceiling(ceiling), _low(min(base, ceiling)), _high(ceiling) {}
+
+void PathMTUDiscovery::set_ceiling(const size_t ceiling) {
+    _ceiling = min(_ceiling, ceiling);
+    _low = min(_low, _ceiling);
+    _high = min(_high, _ceiling);
+}
+
+optional<size_t> PathMTUDiscovery::next_step() const {
+    for (const size_t mtu : COMMON_MTUS) {
+        const size_t step = TCPConfig::mss_for_mtu(mtu);
+        if (step > _low and step < _high) {
+            return step;
+        }
+    }
+    if (_high == _ceiling and _high > _low) {  // the ceiling itself, unless it was given up
+        return _high;
+    }
+    return {};
+}
+
+optional<size_t> PathMTUDiscovery::probe_size(const uint64_t now_ms) {
+    if (not _probing or _probe_seqno.has_value()) {
+        return {};
+    }
+    if (done()) {
+        if (now_ms < _research_ms or _high == _ceiling) {
+            return {};
+        }
+        _high = _ceiling;  // the path may have changed since the search ended
+    }
+    return next_step();
+}
+
+void PathMTUDiscovery::probe_sent(const uint64_t seqno, const size_t size) {
+    _probe_seqno = seqno;
+    _probe_size = size;
+    _duplicate_acks = 0;
+}
+
+void PathMTUDiscovery::acked(const uint64_t ackno) {
+    if (_probe_seqno.has_value() and ackno >= _probe_seqno.value() + _probe_size) {
+        _probe_seqno.reset();
+        _low = _probe_size;
+    }
+}
+
+void PathMTUDiscovery::lost(const uint64_t now_ms) {
+    _probe_seqno.reset();
+    _high = _probe_size - 1;
+    _research_ms = now_ms + RESEARCH_MS;
+}
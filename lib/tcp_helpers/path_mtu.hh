@@ -0,0 +1,78 @@
+#ifndef PATH_MTU
+#define PATH_MTU
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+//! \brief Packetization-layer path MTU discovery (RFC 4821), as a search over the TCP payload size
+//! \details Data goes out in segments of mss(), a payload size known to get through the path. While
+//! the search is on, one segment at a time may be a probe of probe_size(): the next step up from mss()
+//! on a ladder of common link MTUs (COMMON_MTUS, and the ceiling itself), so each probe is a size a
+//! path is likely to carry, and the search needs a handful of probes rather than a bisection's dozen.
+//! The ceiling is the smaller of the local and the peer's MSS. An acknowledged probe raises mss() to
+//! its size; a lost probe gives its size up at once, as each loss costs a resent segment of that
+//! size. The search ends when no step is left below the largest size not given up; if that is below
+//! the ceiling, it starts again RESEARCH_MS after the last size was given up, in case the path has changed.
+//!
+//! A probe is taken as lost when it times out or after DUPLICATE_ACKS duplicate ACKs (so a search
+//! needn't wait a timeout per size). That says nothing about congestion, so the sender retransmits its
+//! bytes at once, in segments of mss(), without backing off. Without probing, mss() is simply the ceiling.
+class PathMTUDiscovery {
+  public:
+    static constexpr unsigned int DUPLICATE_ACKS = 3;        //!< duplicate ACKs that show a probe was lost
+    static constexpr uint64_t RESEARCH_MS = 10 * 60 * 1000;  //!< how long until a search starts again
+
+    //! Link MTUs the search steps through (RFC 1191's plateaus, Ethernet and jumbo frames)
+    static constexpr size_t COMMON_MTUS[] = {1500, 2002, 4352, 9000, 17914, 32000, 65535};
+
+  private:
+    bool _probing;
+    size_t _ceiling;
+    size_t _low;   //!< largest payload known to get through
+    size_t _high;  //!< largest payload that may get through
+
+    std::optional<uint64_t> _probe_seqno{};  //!< absolute seqno of the probe in flight
+    size_t _probe_size{0};                   //!< payload size of the last probe
+    unsigned int _duplicate_acks{0};         //!< duplicate ACKs of the probe in flight
+    uint64_t _research_ms{0};                //!< when a search that ended below the ceiling starts again
+
+    //! The smallest step of the ladder above mss() that may get through, if any
+    std::optional<size_t> next_step() const;
+
+  public:
+    //! \param[in] probing is whether to search (otherwise mss() is always the ceiling)
+    //! \param[in] base is the payload size to start from
+    //! \param[in] ceiling is the largest payload size to try
+    PathMTUDiscovery(const bool probing, const size_t base, const size_t ceiling);
+
+    //! Lower the ceiling, e.g. to the peer's MSS
+    void set_ceiling(const size_t ceiling);
+
+    //! Payload size of ordinary segments
+    size_t mss() const { return _probing ? _low : _ceiling; }
+
+    //! \brief Payload size of the next probe, if one should be sent at time `now_ms`
+    std::optional<size_t> probe_size(const uint64_t now_ms);
+
+    //! A probe of `size` bytes of payload was sent at absolute seqno `seqno`
+    void probe_sent(const uint64_t seqno, const size_t size);
+
+    //! Is the segment at absolute seqno `seqno` the probe in flight?
+    bool is_probe(const uint64_t seqno) const { return _probe_seqno == seqno; }
+
+    //! Everything before absolute seqno `ackno` has been acknowledged
+    void acked(const uint64_t ackno);
+
+    //! \brief An ACK that acknowledged nothing new arrived while the probe was the earliest byte outstanding
+    //! \returns `true` if that makes DUPLICATE_ACKS: the segments after the probe arrived, but it didn't
+    bool duplicate_ack() { return ++_duplicate_acks == DUPLICATE_ACKS; }
+
+    //! The probe in flight was lost (it timed out, or duplicate_ack() said so)
+    void lost(const uint64_t now_ms);
+
+    //! Has the search ended (until RESEARCH_MS after it did)?
+    bool done() const { return not next_step().has_value(); }
+};
+
+#endif /* PATH_MTU */
@@ -0,0 +1,19 @@
+#include "segment_coalescer.hh"
+
+#include <utility>
+
+using namespace std;
+
+//! \details Batches are small (see TUNStack::RECEIVE_BATCH), so the flow's last run is found by a
+//! scan from the end, which allocates nothing.
+void SegmentCoalescer::add(const FlowKey &flow, TCPSegment &&seg) {
+    for (auto run = _runs.rbegin(); run != _runs.rend(); ++run) {
+        if (run->flow == flow) {
+            if (run->segment.append(seg)) {
+                return;
+            }
+            break;
+        }
+    }
+    _runs.push_back({flow, CoalescedSegment{move(seg)}});
+}
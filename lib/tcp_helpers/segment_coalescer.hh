@@ -0,0 +1,38 @@
+#ifndef SEGMENT_COALESCER
+#define SEGMENT_COALESCER
+
+#include "flow_key.hh"
+#include "tcp_segment.hh"
+
+#include <cstddef>
+#include <vector>
+
+//! \brief Software GRO: merges the consecutive in-order segments of each flow in a batch received together
+//! \details The owner add()s the segments of a batch as it reads them, then hands each of runs() to its
+//! connection (as one segment, so the per-segment work of TCPConnection::segment_received() and its ACK
+//! happen once per run) and clear()s. A segment is merged into the last run of its flow if it continues
+//! it (see CoalescedSegment::append()), and otherwise starts a new run. Runs are kept in the order of their
+//! first segments, so each flow's segments are still handed over in the order they arrived.
+class SegmentCoalescer {
+  public:
+    //! Merged segments of one flow
+    struct Run {
+        FlowKey flow;
+        CoalescedSegment segment;
+    };
+
+  private:
+    std::vector<Run> _runs{};
+
+  public:
+    //! Merge `seg` of `flow` into the batch
+    void add(const FlowKey &flow, TCPSegment &&seg);
+
+    //! The runs of the batch, in order
+    std::vector<Run> &runs() { return _runs; }
+
+    //! Start the next batch (keeping the memory of this one)
+    void clear() { _runs.clear(); }
+};
+
+#endif /* SEGMENT_COALESCER */
@@ -0,0 +1,113 @@
+#include "tcp_autotuner.hh"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+atomic<size_t> TCPAutotuner::_budget{TCPConfig::AUTOTUNE_BUDGET};
+atomic<size_t> TCPAutotuner::_in_use{0};
+
+TCPAutotuner::TCPAutotuner(const TCPConfig &cfg)
+    : _enabled(cfg.autotune)
+    , _default_rtt(cfg.rt_timeout)
+    , _max_send_capacity(max(cfg.max_send_capacity, TCPConfig::AUTOTUNE_MIN_CAPACITY))
+    , _send_floor(cfg.send_capacity) {
+    if (not _enabled) {
+        return;
+    }
+    if (not charge(_send_floor)) {
+        // the minimum is granted even past the budget: a connection can't do without it
+        _send_floor = min(_send_floor, TCPConfig::AUTOTUNE_MIN_CAPACITY);
+        _in_use += _send_floor;
+    }
+    _granted = _send_floor;
+}
+
+TCPAutotuner::~TCPAutotuner() { _in_use -= _granted; }
+
+TCPAutotuner::TCPAutotuner(TCPAutotuner &&other) noexcept
+    : _enabled(other._enabled)
+    , _default_rtt(other._default_rtt)
+    , _max_send_capacity(other._max_send_capacity)
+    , _send_floor(other._send_floor)
+    , _granted(exchange(other._granted, 0))
+    , _epoch_start(other._epoch_start)
+    , _acked_at_epoch(other._acked_at_epoch)
+    , _idle_epochs(other._idle_epochs) {}
+
+TCPAutotuner &TCPAutotuner::operator=(TCPAutotuner &&other) noexcept {
+    if (this != &other) {
+        _in_use -= _granted;
+        _enabled = other._enabled;
+        _default_rtt = other._default_rtt;
+        _max_send_capacity = other._max_send_capacity;
+        _send_floor = other._send_floor;
+        _granted = exchange(other._granted, 0);
+        _epoch_start = other._epoch_start;
+        _acked_at_epoch = other._acked_at_epoch;
+        _idle_epochs = other._idle_epochs;
+    }
+    return *this;
+}
+
+bool TCPAutotuner::charge(const size_t bytes) {
+    size_t in_use = _in_use;
+    do {
+        if (in_use + bytes > _budget) {
+            return false;
+        }
+    } while (not _in_use.compare_exchange_weak(in_use, in_use + bytes));
+    return true;
+}
+
+//! \details Growth is all-or-nothing against the budget: a connection that can't get its target keeps
+//! its current capacity and tries again next round trip.
+size_t TCPAutotuner::resize(const size_t current, const size_t target) {
+    if (target > current) {
+        const size_t growth = target - current;
+        if (not charge(growth)) {
+            return current;
+        }
+        _granted += growth;
+    } else {
+        _in_use -= current - target;
+        _granted -= current - target;
+    }
+    return target;
+}
+
+//! \details The measurement epoch is one smoothed round-trip time, over which the bandwidth-delay
+//! product is estimated by the bytes acknowledged. While the writer fills the capacity, though, it
+//! can't keep a larger peer window full, and the acknowledged bytes understate what the path carries;
+//! the peer's window is the estimate then (the sender can't have more than it in flight anyway).
+void TCPAutotuner::tick(const size_t now, TCPSender &sender) {
+    if (not _enabled) {
+        return;
+    }
+    const size_t rtt = sender.srtt().value_or(_default_rtt);
+    if (now - _epoch_start < rtt) {
+        return;
+    }
+
+    const uint64_t acked = sender.next_seqno_absolute() - sender.bytes_in_flight();
+    const uint64_t acked_in_epoch = acked - _acked_at_epoch;
+    ByteStream &outbound = sender.stream_in();
+    const bool idle = acked_in_epoch == 0 and outbound.buffer_empty() and sender.bytes_in_flight() == 0;
+    _idle_epochs = idle ? _idle_epochs + 1 : 0;
+    if (_idle_epochs >= IDLE_EPOCHS) {
+        const size_t floor = max(_send_floor, outbound.buffer_size());
+        if (outbound.capacity() > floor) {
+            outbound.set_capacity(resize(outbound.capacity(), floor));
+        }
+    } else if (not idle) {
+        const uint64_t bdp = outbound.remaining_capacity() == 0 ? max<uint64_t>(acked_in_epoch, sender.window_size())
+                                                                : acked_in_epoch;
+        const size_t target = min<size_t>(2 * bdp, _max_send_capacity);
+        if (target > outbound.capacity()) {
+            outbound.set_capacity(resize(outbound.capacity(), target));
+        }
+    }
+    _epoch_start = now;
+    _acked_at_epoch = acked;
+}
@@ -0,0 +1,76 @@
+#ifndef TCP_AUTOTUNER
+#define TCP_AUTOTUNER
+
+#include "tcp_config.hh"
+#include "tcp_sender.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief Dynamic right-sizing of a connection's send capacity
+//! \details Like Linux's tcp_wmem autotuning: once per round trip, the send capacity grows to twice
+//! the bytes acknowledged during that round trip, or if the writer has filled it, to twice the peer's
+//! window if that is more (so a flow the capacity holds back grows at once to what the peer will
+//! take), and shrinks back to its initial
+//! capacity (never below the bytes it buffers) once the flow has been idle for IDLE_EPOCHS round trips.
+//! Every capacity, the initial ones included, is drawn from a budget shared by every autotuned
+//! connection in the process; a connection whose initial capacity doesn't fit in what is left of it
+//! starts at TCPConfig::AUTOTUNE_MIN_CAPACITY instead.
+//!
+//! The receive capacity is left as configured: without window scaling no more than 65535 bytes can be
+//! advertised, which the default capacity nearly is already, and shrinking it could take back a window
+//! the peer has been given.
+class TCPAutotuner {
+  public:
+    static constexpr unsigned int IDLE_EPOCHS = 8;  //!< round trips a flow is idle before its capacity shrinks
+
+  private:
+    static std::atomic<size_t> _budget;  //!< capacity all autotuned connections may hold together
+    static std::atomic<size_t> _in_use;  //!< capacity they hold now
+
+    bool _enabled;
+    uint16_t _default_rtt;    //!< epoch length until the sender has measured a round trip
+    size_t _max_send_capacity;
+    size_t _send_floor;       //!< initial send capacity, which shrinking returns to
+    size_t _granted{0};       //!< this connection's share of `_in_use`
+
+    size_t _epoch_start{0};         //!< when the measurement epoch began
+    uint64_t _acked_at_epoch{0};
+    unsigned int _idle_epochs{0};   //!< epochs in a row in which the flow was idle
+
+    //! Add `bytes` to `_in_use` if the budget allows it; returns whether it did
+    static bool charge(const size_t bytes);
+
+    //! Resize `current` to `target`, drawing any growth from the budget; returns the new capacity
+    size_t resize(const size_t current, const size_t target);
+
+  public:
+    //! Charges the initial `cfg.send_capacity` to the budget, if autotuning is on
+    explicit TCPAutotuner(const TCPConfig &cfg);
+    ~TCPAutotuner();  //!< returns the connection's capacity to the budget
+
+    //! \brief Send capacity the connection starts with (the configured one, unless the budget is short)
+    size_t initial_send_capacity() const { return _send_floor; }
+
+    //! \brief Called from TCPConnection::tick; resizes the sender's capacity once per round trip
+    //! \param[in] now is the connection's clock, in milliseconds
+    void tick(const size_t now, TCPSender &sender);
+
+    //! \name Global budget
+    //!@{
+    static void set_budget(const size_t bytes) { _budget = bytes; }
+    static size_t budget() { return _budget; }
+    static size_t in_use() { return _in_use; }
+    //!@}
+
+    //! \name moving is allowed (the share of the budget moves along); copying is disallowed
+    //!@{
+    TCPAutotuner(TCPAutotuner &&other) noexcept;
+    TCPAutotuner &operator=(TCPAutotuner &&other) noexcept;
+    TCPAutotuner(const TCPAutotuner &other) = delete;
+    TCPAutotuner &operator=(const TCPAutotuner &other) = delete;
+    //!@}
+};
+
+#endif /* TCP_AUTOTUNER */
@@ -4,6 +4,7 @@
 #include "address.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <optional>
@@ -11,15 +12,42 @@
 //! Config for TCP sender and receiver
 class TCPConfig {
   public:
-    static constexpr size_t DEFAULT_CAPACITY = 64000;  //!< Default capacity
-    static constexpr size_t MAX_PAYLOAD_SIZE = 1452;   //!< Max TCP payload that fits in either IPv4 or UDP datagram
-    static constexpr uint16_t TIMEOUT_DFLT = 1000;     //!< Default re-transmit timeout is 1 second
-    static constexpr unsigned MAX_RETX_ATTEMPTS = 8;   //!< Maximum re-transmit attempts before giving up
+    static constexpr size_t DEFAULT_CAPACITY = 64000;   //!< Default capacity
+    static constexpr size_t MAX_PAYLOAD_SIZE = 1452;    //!< Max TCP payload that fits in either IPv4 or UDP datagram
+    static constexpr size_t HEADERS = 40;               //!< IPv4 + TCP headers, without options
+    static constexpr size_t MAX_MSS = 65535 - HEADERS;  //!< Max TCP payload of an IPv4 datagram
+    static constexpr size_t MIN_MSS = 88;               //!< Smallest peer MSS option honored (as Linux's TCP_MIN_MSS)
+    static constexpr uint16_t TIMEOUT_DFLT = 1000;      //!< Default re-transmit timeout is 1 second
+    static constexpr unsigned MAX_RETX_ATTEMPTS = 8;    //!< Maximum re-transmit attempts before giving up
+    static constexpr size_t PERSIST_TIMEOUT_MAX = 60000;  //!< Longest interval between zero-window probes, in ms
+    //! Bytes reserved in front of each outbound payload for the IPv4 + TCP headers (with a SYN's MSS option)
+    static constexpr size_t HEADROOM = HEADERS + 4;
+    static constexpr size_t AUTOTUNE_MIN_CAPACITY = 4 * MAX_PAYLOAD_SIZE;  //!< Autotuning never shrinks below this
+    static constexpr size_t AUTOTUNE_BUDGET = 64 * 1024 * 1024;  //!< Default capacity shared by autotuned connections
 
     uint16_t rt_timeout = TIMEOUT_DFLT;       //!< Initial value of the retransmission timeout, in milliseconds
     size_t recv_capacity = DEFAULT_CAPACITY;  //!< Receive capacity, in bytes
     size_t send_capacity = DEFAULT_CAPACITY;  //!< Sender capacity, in bytes
     std::optional<WrappingInt32> fixed_isn{};
+
+    //! Largest payload to send, also sent to the peer as the MSS option (the peer's option may lower it).
+    //! 0 means the MTU of the interface, where the owner knows it (TUNStack, TUNSocket), or else MAX_PAYLOAD_SIZE.
+    //! Where the owner knows the interface's MTU, that MTU also caps a larger `mss`.
+    size_t mss = 0;
+
+    //! Search for the largest payload the path carries (RFC 4821), from MAX_PAYLOAD_SIZE up through common MTUs
+    //! (see PathMTUDiscovery)
+    bool plpmtud = false;
+
+    //! The MSS to use: `mss` (at most MAX_MSS), or MAX_PAYLOAD_SIZE if it is 0
+    size_t effective_mss() const { return mss ? std::min(mss, MAX_MSS) : MAX_PAYLOAD_SIZE; }
+
+    //! The MSS of an interface whose MTU is `mtu`, leaving room for the IPv4 and TCP headers
+    static size_t mss_for_mtu(const size_t mtu) { return mtu > HEADERS ? std::min(mtu - HEADERS, MAX_MSS) : 1; }
+
+    //! Resize the send capacity to the measured bandwidth-delay product (see TCPAutotuner)
+    bool autotune = false;
+    size_t max_send_capacity = 4 * 1024 * 1024;  //!< Autotuning limit for the send capacity, in bytes
 };
 
 //! Config for classes derived from FdAdapter
@@ -1,6 +1,10 @@
 #include "tcp_header.hh"
 
+#include "fast_parser.hh"
+
+#include <algorithm>
 #include <sstream>
+#include <stdexcept>
 
 using namespace std;
 
@@ -37,8 +41,11 @@ ParseResult TCPHeader::parse(NetParser &p) {
         return ParseResult::HeaderTooShort;
     }
 
-    // skip any options or anything extra in the header
-    p.remove_prefix(doff * 4 - TCPHeader::LENGTH);
+    // read the options, and skip anything extra in the header
+    const size_t options_length = doff * 4 - TCPHeader::LENGTH;
+    const Buffer rest = p.buffer();
+    parse_options(rest.str().substr(0, min(options_length, rest.size())));
+    p.remove_prefix(options_length);
 
     if (p.error()) {
         return p.get_error();
@@ -47,34 +54,64 @@ ParseResult TCPHeader::parse(NetParser &p) {
     return ParseResult::NoError;
 }
 
+//! \param[in] options is the header past its first TCPHeader::LENGTH bytes
+//! \details A malformed option ends the parsing, keeping what was read before it.
+void TCPHeader::parse_options(string_view options) {
+    enum : uint8_t { END = 0, NOP = 1, MSS = 2 };
+    mss = 0;
+    while (not options.empty() and options[0] != END) {
+        if (options[0] == NOP) {
+            options.remove_prefix(1);
+            continue;
+        }
+        const size_t len = options.size() >= 2 ? static_cast<uint8_t>(options[1]) : 0;
+        if (len < 2 or len > options.size()) {
+            return;
+        }
+        if (options[0] == MSS and len == 4) {
+            mss = FastParser::load<uint16_t>(options.data() + 2);
+        }
+        options.remove_prefix(len);
+    }
+}
+
 //! Serialize the TCPHeader to a string (does not recompute the checksum)
 string TCPHeader::serialize() const {
+    string ret(4 * size_t(doff), 0);
+    serialize(ret.data());
+    return ret;
+}
+
+//! Serialize the TCPHeader into preallocated space (does not recompute the checksum)
+//! \param[out] out points to `4 * doff` writable bytes; any options area is zero-filled
+void TCPHeader::serialize(char *out) const {
     // sanity check
     if (doff < 5) {
         throw runtime_error("TCP header too short");
     }
 
-    string ret;
-    ret.reserve(4 * doff);
-
-    NetUnparser::u16(ret, sport);              // source port
-    NetUnparser::u16(ret, dport);              // destination port
-    NetUnparser::u32(ret, seqno.raw_value());  // sequence number
-    NetUnparser::u32(ret, ackno.raw_value());  // ack number
-    NetUnparser::u8(ret, doff << 4);           // data offset
+    FastUnparser::store<uint16_t>(out, sport);                  // source port
+    FastUnparser::store<uint16_t>(out + 2, dport);              // destination port
+    FastUnparser::store<uint32_t>(out + 4, seqno.raw_value());  // sequence number
+    FastUnparser::store<uint32_t>(out + 8, ackno.raw_value());  // ack number
+    FastUnparser::store<uint8_t>(out + 12, doff << 4);          // data offset
 
     const uint8_t fl_b = (urg ? 0b0010'0000 : 0) | (ack ? 0b0001'0000 : 0) | (psh ? 0b0000'1000 : 0) |
                          (rst ? 0b0000'0100 : 0) | (syn ? 0b0000'0010 : 0) | (fin ? 0b0000'0001 : 0);
-    NetUnparser::u8(ret, fl_b);  // flags
-    NetUnparser::u16(ret, win);  // window size
+    FastUnparser::store<uint8_t>(out + 13, fl_b);  // flags
+    FastUnparser::store<uint16_t>(out + 14, win);  // window size
 
-    NetUnparser::u16(ret, cksum);  // checksum
+    FastUnparser::store<uint16_t>(out + 16, cksum);  // checksum
 
-    NetUnparser::u16(ret, uptr);  // urgent pointer
+    FastUnparser::store<uint16_t>(out + 18, uptr);  // urgent pointer
 
-    ret.resize(4 * doff);  // expand header to advertised size
+    fill(out + TCPHeader::LENGTH, out + 4 * doff, 0);  // expand header to advertised size
 
-    return ret;
+    if (mss != 0 and 4 * size_t(doff) >= MSS_LENGTH) {
+        FastUnparser::store<uint8_t>(out + LENGTH, 2);  // kind: maximum segment size
+        FastUnparser::store<uint8_t>(out + LENGTH + 1, 4);
+        FastUnparser::store<uint16_t>(out + LENGTH + 2, mss);
+    }
 }
 
 //! \returns A string with the header's contents
@@ -90,6 +127,9 @@ string TCPHeader::to_string() const {
        << "TCP winsize: " << +win << '\n'
        << "TCP cksum: " << +cksum << '\n'
        << "TCP uptr: " << +uptr << '\n';
+    if (mss) {
+        ss << "TCP mss: " << dec << mss << '\n';
+    }
     return ss.str();
 }
 
@@ -104,5 +144,5 @@ bool TCPHeader::operator==(const TCPHeader &other) const {
     // TODO(aozdemir) more complete check (right now we omit cksum, src, dst
     return seqno == other.seqno && ackno == other.ackno && doff == other.doff && urg == other.urg && ack == other.ack &&
            psh == other.psh && rst == other.rst && syn == other.syn && fin == other.fin && win == other.win &&
-           uptr == other.uptr;
+           uptr == other.uptr && mss == other.mss;
 }
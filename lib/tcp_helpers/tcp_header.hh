@@ -4,10 +4,13 @@
 #include "parser.hh"
 #include "wrapping_integers.hh"
 
+#include <string_view>
+
 //! \brief [TCP](\ref rfc::rfc793) segment header
-//! \note TCP options are not supported
+//! \note Of the TCP options, only the maximum segment size is supported; others are skipped
 struct TCPHeader {
     static constexpr size_t LENGTH = 20;  //!< [TCP](\ref rfc::rfc793) header length, not including options
+    static constexpr size_t MSS_LENGTH = LENGTH + 4;  //!< header length with the MSS option
 
     //! \struct TCPHeader
     //! ~~~{.txt}
@@ -48,14 +51,21 @@ struct TCPHeader {
     uint16_t win = 0;           //!< window size
     uint16_t cksum = 0;         //!< checksum
     uint16_t uptr = 0;          //!< urgent pointer
+    uint16_t mss = 0;           //!< MSS option, or 0 if absent (serialized if `doff` leaves room for it)
     //!@}
 
     //! Parse the TCP fields from the provided NetParser
     ParseResult parse(NetParser &p);
 
+    //! Read the options that are supported (the MSS) from the header's options area
+    void parse_options(std::string_view options);
+
     //! Serialize the TCP fields
     std::string serialize() const;
 
+    //! Serialize the TCP fields into `out`, which must have room for `4 * doff` bytes
+    void serialize(char *out) const;
+
     //! Return a string containing a header in human-readable format
     std::string to_string() const;
 
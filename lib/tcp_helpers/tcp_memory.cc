@@ -0,0 +1,73 @@
+#include "tcp_memory.hh"
+
+#include <utility>
+
+using namespace std;
+
+atomic<size_t> TCPMemory::_buffered{0};
+atomic<bool> TCPMemory::_under_pressure{false};
+atomic<size_t> TCPMemory::_low{Limits{}.low};
+atomic<size_t> TCPMemory::_pressure{Limits{}.pressure};
+atomic<size_t> TCPMemory::_drop_out_of_order{Limits{}.drop_out_of_order};
+atomic<size_t> TCPMemory::_refuse_connections{Limits{}.refuse_connections};
+atomic<uint64_t> TCPMemory::_refused{0};
+atomic<uint64_t> TCPMemory::_dropped{0};
+
+TCPMemory::~TCPMemory() { _buffered -= _charged; }
+
+TCPMemory::TCPMemory(TCPMemory &&other) noexcept : _charged(exchange(other._charged, 0)) {}
+
+TCPMemory &TCPMemory::operator=(TCPMemory &&other) noexcept {
+    if (this != &other) {
+        _buffered -= _charged;
+        _charged = exchange(other._charged, 0);
+    }
+    return *this;
+}
+
+void TCPMemory::charge(const size_t bytes) {
+    const size_t rounded = (bytes + QUANTUM - 1) / QUANTUM * QUANTUM;
+    if (rounded > _charged) {
+        _buffered += rounded - _charged;
+    } else if (rounded < _charged) {
+        _buffered -= _charged - rounded;
+    }
+    _charged = rounded;
+}
+
+void TCPMemory::set_limits(const Limits &limits) {
+    _low = limits.low;
+    _pressure = limits.pressure;
+    _drop_out_of_order = limits.drop_out_of_order;
+    _refuse_connections = limits.refuse_connections;
+}
+
+TCPMemory::Limits TCPMemory::limits() {
+    Limits limits;
+    limits.low = _low;
+    limits.pressure = _pressure;
+    limits.drop_out_of_order = _drop_out_of_order;
+    limits.refuse_connections = _refuse_connections;
+    return limits;
+}
+
+MemoryPressure TCPMemory::pressure() {
+    const size_t buffered = _buffered.load(memory_order_relaxed);
+    // the flag is only written when it changes, so connections on other threads keep sharing its line
+    if (buffered < _low) {
+        if (_under_pressure.load(memory_order_relaxed)) {
+            _under_pressure.store(false, memory_order_relaxed);
+        }
+        return MemoryPressure::None;
+    }
+    if (buffered > _pressure && !_under_pressure.load(memory_order_relaxed)) {
+        _under_pressure.store(true, memory_order_relaxed);
+    }
+    if (buffered > _refuse_connections) {
+        return MemoryPressure::RefuseConnections;
+    }
+    if (buffered > _drop_out_of_order) {
+        return MemoryPressure::DropOutOfOrder;
+    }
+    return _under_pressure.load(memory_order_relaxed) ? MemoryPressure::ShrinkWindows : MemoryPressure::None;
+}
@@ -0,0 +1,78 @@
+#ifndef TCP_MEMORY
+#define TCP_MEMORY
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//! Stack-wide memory pressure, in increasing severity (each level also applies the ones before it)
+enum class MemoryPressure : uint8_t {
+    None = 0,
+    ShrinkWindows,     //!< receive windows stop opening: their right edges don't move forward
+    DropOutOfOrder,    //!< out-of-order data is dropped, and what is stored is pruned
+    RefuseConnections  //!< new connections are refused (incoming SYNs are ignored, connect() throws)
+};
+
+//! \brief Bytes buffered by every TCPConnection in the process, and the pressure they put on memory
+//! \details Like Linux's tcp_mem. Each connection charges what it holds: its outbound stream and the
+//! bytes in flight (send buffer), and its inbound stream and out-of-order substrings (receive buffer).
+//! A charge is rounded up to QUANTUM bytes, like the pages Linux charges, so the shared counter only
+//! changes when a connection's usage crosses a quantum. Pressure starts above `Limits::pressure` and,
+//! until it escalates further, only ends once usage falls below `Limits::low`.
+class TCPMemory {
+  public:
+    //! Granularity of a connection's charge, in bytes
+    static constexpr size_t QUANTUM = 4096;
+
+    //! Thresholds on the bytes buffered by all connections
+    struct Limits {
+        size_t low = 32 * 1024 * 1024;                 //!< pressure ends below this (tcp_mem[0])
+        size_t pressure = 48 * 1024 * 1024;            //!< windows shrink above this (tcp_mem[1])
+        size_t drop_out_of_order = 64 * 1024 * 1024;   //!< out-of-order data is dropped above this
+        size_t refuse_connections = 96 * 1024 * 1024;  //!< new connections are refused above this (tcp_mem[2])
+    };
+
+  private:
+    static std::atomic<size_t> _buffered;       //!< bytes charged by every connection
+    static std::atomic<bool> _under_pressure;   //!< between `low` and `pressure`: still shrinking windows?
+    static std::atomic<size_t> _low;
+    static std::atomic<size_t> _pressure;
+    static std::atomic<size_t> _drop_out_of_order;
+    static std::atomic<size_t> _refuse_connections;
+    static std::atomic<uint64_t> _refused;      //!< connections refused
+    static std::atomic<uint64_t> _dropped;      //!< out-of-order bytes pruned
+
+    size_t _charged{0};  //!< this connection's share of `_buffered`
+
+  public:
+    TCPMemory() = default;
+    ~TCPMemory();  //!< returns the connection's charge
+
+    //! \brief Charge `bytes` (rounded up to QUANTUM) for this connection, replacing its last charge
+    void charge(const size_t bytes);
+
+    //! This connection's charge
+    size_t charged() const { return _charged; }
+
+    //! \name Stack-wide accounting
+    //!@{
+    static void set_limits(const Limits &limits);
+    static Limits limits();
+    static size_t buffered() { return _buffered; }
+    static MemoryPressure pressure();
+    static void count_refused() { _refused.fetch_add(1, std::memory_order_relaxed); }
+    static void count_dropped(const size_t bytes) { _dropped.fetch_add(bytes, std::memory_order_relaxed); }
+    static uint64_t refused() { return _refused; }
+    static uint64_t dropped() { return _dropped; }
+    //!@}
+
+    //! \name moving is allowed (the charge moves along); copying is disallowed
+    //!@{
+    TCPMemory(TCPMemory &&other) noexcept;
+    TCPMemory &operator=(TCPMemory &&other) noexcept;
+    TCPMemory(const TCPMemory &other) = delete;
+    TCPMemory &operator=(const TCPMemory &other) = delete;
+    //!@}
+};
+
+#endif /* TCP_MEMORY */
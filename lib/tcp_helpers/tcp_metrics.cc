@@ -0,0 +1,47 @@
+#include "tcp_metrics.hh"
+
+#include <iterator>
+
+using namespace std;
+
+static constexpr const char *COUNTER_NAMES[] = {"segments_in",
+                                                "segments_out",
+                                                "bytes_in",
+                                                "bytes_out",
+                                                "retransmissions",
+                                                "duplicate_acks",
+                                                "out_of_order_bytes",
+                                                "zero_windows_received",
+                                                "zero_windows_sent",
+                                                "window_updates",
+                                                "zero_window_probes",
+                                                "coalesced_segments",
+                                                "mtu_probes_lost"};
+
+void TCPConnectionMetrics::write_prometheus_types(ostream &out) {
+    for (const char *name : COUNTER_NAMES) {
+        out << "# TYPE starfish_tcp_" << name << "_total counter\n";
+    }
+    out << "# TYPE starfish_tcp_rtt_ms histogram\n";
+}
+
+void TCPConnectionMetrics::write_prometheus(ostream &out, const string &labels) const {
+    const uint64_t values[] = {segments_in,
+                               segments_out,
+                               bytes_in,
+                               bytes_out,
+                               retransmissions,
+                               duplicate_acks,
+                               out_of_order_bytes,
+                               zero_windows_received,
+                               zero_windows_sent,
+                               window_updates,
+                               zero_window_probes,
+                               coalesced_segments,
+                               mtu_probes_lost};
+    static_assert(size(values) == size(COUNTER_NAMES));
+    for (size_t i = 0; i < size(values); ++i) {
+        out << "starfish_tcp_" << COUNTER_NAMES[i] << "_total{" << labels << "} " << values[i] << "\n";
+    }
+    rtt_ms.write_prometheus(out, "starfish_tcp_rtt_ms", labels);
+}
@@ -0,0 +1,36 @@
+#ifndef TCP_METRICS
+#define TCP_METRICS
+
+#include "metrics.hh"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//! \brief Counters of one TCPConnection
+//! \details A connection is only touched by the thread that runs it, so these are plain integers.
+struct TCPConnectionMetrics {
+    uint64_t segments_in{0};            //!< segments received
+    uint64_t segments_out{0};           //!< segments sent, including retransmissions
+    uint64_t bytes_in{0};               //!< payload bytes received
+    uint64_t bytes_out{0};              //!< payload bytes sent, including retransmissions
+    uint64_t retransmissions{0};        //!< segments retransmitted on timeout
+    uint64_t duplicate_acks{0};         //!< pure ACKs that acknowledged nothing new, nor moved the window, while
+                                        //!< data was in flight (RFC 5681's duplicate ACKs)
+    uint64_t out_of_order_bytes{0};     //!< payload bytes received ahead of the next expected byte
+    uint64_t zero_windows_received{0};  //!< segments from the peer advertising a zero window
+    uint64_t zero_windows_sent{0};      //!< segments advertising a zero window to the peer
+    uint64_t window_updates{0};         //!< ACKs sent only because reading reopened the receive window
+    uint64_t zero_window_probes{0};     //!< probes of the peer's zero window (not counted as retransmissions)
+    uint64_t coalesced_segments{0};     //!< segments received merged into the one before them (see SegmentCoalescer)
+    uint64_t mtu_probes_lost{0};        //!< path MTU probes lost (not counted as retransmissions)
+    Histogram rtt_ms{};                 //!< round-trip time samples, in milliseconds
+
+    //! Append the counters to `out` in the Prometheus text format, with `labels` (e.g. `conn="1"`)
+    void write_prometheus(std::ostream &out, const std::string &labels) const;
+
+    //! Append the `# TYPE` lines of the metric families, once before the first connection's counters
+    static void write_prometheus_types(std::ostream &out);
+};
+
+#endif /* TCP_METRICS */
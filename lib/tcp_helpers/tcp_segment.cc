@@ -1,5 +1,6 @@
 #include "tcp_segment.hh"
 
+#include "fast_parser.hh"
 #include "parser.hh"
 #include "util.hh"
 
@@ -7,6 +8,8 @@
 
 using namespace std;
 
+static constexpr size_t CKSUM_OFFSET = 16;  //!< Offset of the checksum field in the TCP header
+
 //! \param[in] buffer string/Buffer to be parsed
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
 ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer_checksum) {
@@ -16,10 +19,14 @@ ParseResult TCPSegment::parse(const Buffer buffer, const uint32_t datagram_layer
         return ParseResult::BadChecksum;
     }
 
-    NetParser p{buffer};
-    _header.parse(p);
-    _payload = p.buffer();
-    return p.get_error();
+    const ParseResult res = FastParser::parse_tcp(buffer, _header);
+    if (res != ParseResult::NoError) {
+        return res;
+    }
+
+    _payload = buffer;
+    _payload.remove_prefix(4 * _header.doff);
+    return ParseResult::NoError;
 }
 
 size_t TCPSegment::length_in_sequence_space() const {
@@ -27,19 +34,60 @@ size_t TCPSegment::length_in_sequence_space() const {
 }
 
 //! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
+//! \note Never writes the payload's headroom; the caller that owns it opts in with serialize_in_place()
 BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
     TCPHeader header_out = _header;
     header_out.cksum = 0;
+    string header_str = header_out.serialize();
 
     // calculate checksum -- taken over entire segment
     InternetChecksum check(datagram_layer_checksum);
-    check.add(header_out.serialize());
+    check.add(header_str);
     check.add(_payload);
-    header_out.cksum = check.value();
+    FastUnparser::store<uint16_t>(header_str.data() + CKSUM_OFFSET, check.value());
 
     BufferList ret;
-    ret.append(header_out.serialize());
+    ret.append(move(header_str));
     ret.append(_payload);
 
     return ret;
 }
+
+//! \param[in] datagram_layer_checksum pseudo-checksum from the lower-layer protocol
+//! \returns a Buffer holding header + payload, sharing the payload's storage (no allocation or copy)
+//! \note The header is written into headroom shared by every copy of the payload, so only the owner of
+//! that storage should call this, and the result is only valid until the next in-place serialization of
+//! a segment carrying the same payload.
+Buffer TCPSegment::serialize_in_place(const uint32_t datagram_layer_checksum) {
+    const size_t header_len = 4 * size_t(_header.doff);
+    char *const out = _payload.headroom_data(header_len);  // throws if there isn't enough headroom
+
+    TCPHeader header_out = _header;
+    header_out.cksum = 0;
+    header_out.serialize(out);
+
+    // calculate checksum -- header and payload are contiguous, so one pass covers the entire segment
+    Buffer ret = _payload.expand_into_headroom(header_len);
+    InternetChecksum check(datagram_layer_checksum);
+    check.add(ret);
+    FastUnparser::store<uint16_t>(out + CKSUM_OFFSET, check.value());
+
+    return ret;
+}
+
+//! Can `hdr` be part of a run: a data segment with just ACK (and maybe PSH) set?
+static bool coalescable(const TCPHeader &hdr) { return hdr.ack and not(hdr.syn or hdr.fin or hdr.rst or hdr.urg); }
+
+bool CoalescedSegment::append(TCPSegment &seg) {
+    TCPHeader &hdr = _first.header();
+    const TCPHeader &next = seg.header();
+    if (not coalescable(hdr) or not coalescable(next) or _first.payload().size() == 0 or seg.payload().size() == 0 or
+        next.seqno != hdr.seqno + _payload_size or next.ackno != hdr.ackno or next.doff != hdr.doff) {
+        return false;
+    }
+    hdr.win = next.win;
+    hdr.psh = hdr.psh or next.psh;
+    _payload_size += seg.payload().size();
+    _rest.push_back(move(seg.payload()));
+    return true;
+}
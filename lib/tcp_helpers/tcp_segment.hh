@@ -2,9 +2,12 @@
 #define TCP_SEGMENT
 
 #include "buffer.hh"
+#include "lazy_deque.hh"
 #include "tcp_header.hh"
 
 #include <cstdint>
+#include <queue>
+#include <vector>
 
 //! \brief [TCP](\ref rfc::rfc793) segment
 class TCPSegment {
@@ -19,6 +22,9 @@ class TCPSegment {
     //! \brief Serialize the segment to a string
     BufferList serialize(const uint32_t datagram_layer_checksum = 0) const;
 
+    //! \brief Serialize the header into the payload's headroom, computing the checksum in the same pass
+    Buffer serialize_in_place(const uint32_t datagram_layer_checksum = 0);
+
     //! \name Accessors
     //!@{
     const TCPHeader &header() const { return _header; }
@@ -37,5 +43,44 @@ class TCPSegment {
 };
 
 
+//! \brief Consecutive in-order data segments of one flow, merged into one logical segment
+//! \details The header is the first segment's, except for the window (and PSH) of the last; the
+//! payload is the chain of the segments' payloads, which are not copied.
+class CoalescedSegment {
+  private:
+    TCPSegment _first;
+    std::vector<Buffer> _rest{};  //!< payloads of the segments after the first, in order
+    size_t _payload_size;
+
+  public:
+    explicit CoalescedSegment(TCPSegment &&first) : _first(std::move(first)), _payload_size(_first.payload().size()) {}
+
+    //! \brief Merge `seg` into the end of the run, if it continues it
+    //! \details Only data segments with just ACK (and maybe PSH) set are merged, and only if `seg` starts
+    //! where the run ends and acknowledges the same ackno.
+    //! \returns false (leaving `seg` alone) if it can't be merged
+    bool append(TCPSegment &seg);
+
+    //! The header, with the seqno of the first segment
+    const TCPHeader &header() const { return _first.header(); }
+
+    //! The first segment (with the header() of the run, but only its own payload)
+    const TCPSegment &first() const { return _first; }
+
+    //! Payloads of the rest of the segments, in order
+    const std::vector<Buffer> &rest() const { return _rest; }
+
+    //! Number of segments merged
+    size_t segments() const { return 1 + _rest.size(); }
+
+    //! Total payload size
+    size_t payload_size() const { return _payload_size; }
+};
+
+//! Segments waiting to be sent; trim() frees its memory while there are none
+class SegmentQueue : public std::queue<TCPSegment, LazyDeque<TCPSegment>> {
+  public:
+    void trim() { c.trim(); }
+};
 
 #endif /* TCP_SEGMENT */
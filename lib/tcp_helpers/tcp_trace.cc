@@ -0,0 +1,116 @@
+#include "tcp_trace.hh"
+
+#include <array>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+namespace TCPTrace {
+
+//! Bits of TraceRecord::flags for a segment
+enum : uint8_t { SYN = 1, ACK = 2, RST = 4, FIN = 8, PSH = 16, URG = 32 };
+
+//! Official state names, indexed by TCPState::State
+static const array<const char *, 12> STATE_NAMES = {"LISTEN",
+                                                    "SYN_RCVD",
+                                                    "SYN_SENT",
+                                                    "ESTABLISHED",
+                                                    "CLOSE_WAIT",
+                                                    "LAST_ACK",
+                                                    "FIN_WAIT_1",
+                                                    "FIN_WAIT_2",
+                                                    "CLOSING",
+                                                    "TIME_WAIT",
+                                                    "CLOSED",
+                                                    "RESET"};
+
+static uint64_t object_id(const void *conn) { return reinterpret_cast<uintptr_t>(conn); }
+
+TraceRecord segment(const TraceEvent event, const void *conn, const TCPSegment &seg) {
+    const TCPHeader &hdr = seg.header();
+    TraceRecord rec{};
+    rec.object = object_id(conn);
+    rec.event = event;
+    rec.a = hdr.seqno.raw_value();
+    rec.b = hdr.ackno.raw_value();
+    rec.len = seg.payload().size();
+    rec.win = hdr.win;
+    rec.flags = (hdr.syn ? SYN : 0) | (hdr.ack ? ACK : 0) | (hdr.rst ? RST : 0) | (hdr.fin ? FIN : 0) |
+                (hdr.psh ? PSH : 0) | (hdr.urg ? URG : 0);
+    return rec;
+}
+
+TraceRecord state_changed(const void *conn, const uint8_t from, const uint8_t to) {
+    TraceRecord rec{};
+    rec.object = object_id(conn);
+    rec.event = TraceEvent::StateChanged;
+    rec.a = from;
+    rec.b = to;
+    return rec;
+}
+
+TraceRecord rto_fired(const void *conn, const unsigned int consecutive, const size_t rto_ms) {
+    TraceRecord rec{};
+    rec.object = object_id(conn);
+    rec.event = TraceEvent::RtoFired;
+    rec.a = consecutive;
+    rec.len = rto_ms;
+    return rec;
+}
+
+TraceRecord window_updated(const void *conn, const size_t from, const size_t to) {
+    TraceRecord rec{};
+    rec.object = object_id(conn);
+    rec.event = TraceEvent::WindowUpdated;
+    rec.a = from;
+    rec.b = to;
+    return rec;
+}
+
+uint8_t state_code(const TCPState &state) {
+    for (uint8_t s = 0; s < STATE_NAMES.size(); ++s) {
+        if (state == TCPState{static_cast<TCPState::State>(s)}) {
+            return s;
+        }
+    }
+    return UNKNOWN_STATE;
+}
+
+static string state_name(const uint32_t code) { return code < STATE_NAMES.size() ? STATE_NAMES[code] : "?"; }
+
+string render(const TraceRecord &rec, const uint64_t start_ns) {
+    stringstream ss{};
+    ss << fixed << setprecision(6) << (rec.timestamp_ns - start_ns) / 1e9 << " conn=0x" << hex << rec.object
+       << dec << " ";
+    switch (rec.event) {
+        case TraceEvent::SegmentReceived:
+        case TraceEvent::SegmentSent: {
+            TCPHeader hdr{};
+            hdr.seqno = WrappingInt32{rec.a};
+            hdr.ackno = WrappingInt32{rec.b};
+            hdr.win = rec.win;
+            hdr.syn = rec.flags & SYN;
+            hdr.ack = rec.flags & ACK;
+            hdr.rst = rec.flags & RST;
+            hdr.fin = rec.flags & FIN;
+            ss << (rec.event == TraceEvent::SegmentReceived ? "rx " : "tx ") << hdr.summary()
+               << " payload=" << rec.len;
+            break;
+        }
+        case TraceEvent::StateChanged:
+            ss << "state " << state_name(rec.a) << " -> " << state_name(rec.b);
+            break;
+        case TraceEvent::RtoFired:
+            ss << "rto consecutive=" << rec.a << " timeout=" << rec.len << "ms";
+            break;
+        case TraceEvent::WindowUpdated:
+            ss << "window " << rec.a << " -> " << rec.b;
+            break;
+        default:
+            ss << "unknown event " << static_cast<unsigned int>(rec.event);
+    }
+    return ss.str();
+}
+
+}  // namespace TCPTrace
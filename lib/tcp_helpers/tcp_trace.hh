@@ -0,0 +1,36 @@
+#ifndef TCP_TRACE
+#define TCP_TRACE
+
+#include "tcp_segment.hh"
+#include "tcp_state.hh"
+#include "trace.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! \brief TraceRecords of a TCPConnection's tracepoints, and how trace_decode renders them
+namespace TCPTrace {
+
+//! State code of a TCPState that matches none of the official states
+constexpr uint8_t UNKNOWN_STATE = 0xff;
+
+//! \name Building records (only evaluated when tracing is compiled in)
+//!@{
+TraceRecord segment(const TraceEvent event, const void *conn, const TCPSegment &seg);
+TraceRecord state_changed(const void *conn, const uint8_t from, const uint8_t to);
+TraceRecord rto_fired(const void *conn, const unsigned int consecutive, const size_t rto_ms);
+TraceRecord window_updated(const void *conn, const size_t from, const size_t to);
+//!@}
+
+//! The TCPState::State that `state` matches, or UNKNOWN_STATE
+uint8_t state_code(const TCPState &state);
+
+//! \brief One line describing `rec`, with its time relative to `start_ns`
+//! \details Segments are rendered as by TCPHeader::summary(), e.g.
+//! `0.001200 conn=0x5581d2c0 tx Header(flags=A,seqno=1,ack=1,win=64000) payload=1000`
+std::string render(const TraceRecord &rec, const uint64_t start_ns);
+
+}  // namespace TCPTrace
+
+#endif /* TCP_TRACE */
@@ -1,12 +1,16 @@
 #include "tcp_tun_socket.hh"
 
+#include "ephemeral_ports.hh"
+#include "isn_generator.hh"
 #include "parser.hh"
 #include "tun.hh"
 #include "util.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
@@ -18,6 +22,14 @@
 using namespace std;
 
 static constexpr size_t TCP_TICK_MS = 10;
+static constexpr size_t RING_CAPACITY = 256 * 1024;
+
+//! Local ports of every TUNSocket's active open (they share the TUN device); guarded by tun_socket_ports_lock
+static EphemeralPorts &tun_socket_ports() {
+    static EphemeralPorts ports;
+    return ports;
+}
+static mutex tun_socket_ports_lock{};
 
 //! \param[in] condition is a function returning true if loop should continue
 void TUNSocket::_tcp_loop(const function<bool()> &condition) {
@@ -34,21 +46,43 @@ void TUNSocket::_tcp_loop(const function<bool()> &condition) {
             _datagram_adapter.tick(next_time - base_time);
             base_time = next_time;
         }
+
+        if (_transport == Transport::Ring) {
+            _pump_rings();
+        }
     }
 }
 
-//! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
+//! \param[in] data_sockets are the owner's and the TCP thread's ends of a connected pair of AF_UNIX SOCK_STREAM
+//! sockets, or (Transport::Ring) an unconnected one and nothing
 //! \param[in] datagram_interface is the interface for reading and writing datagrams
-TUNSocket::TUNSocket(pair<FileDescriptor, FileDescriptor> data_socket_pair,
-                                         TCPOverIPv4OverTunFdAdapter &&datagram_interface)
-    : LocalStreamSocket(move(data_socket_pair.first))
-    , _thread_data(move(data_socket_pair.second))
+//! \param[in] transport selects how application bytes reach the TCP thread
+TUNSocket::TUNSocket(pair<FileDescriptor, optional<FileDescriptor>> data_sockets,
+                     TCPOverIPv4OverTunFdAdapter &&datagram_interface,
+                     const Transport transport)
+    : LocalStreamSocket(move(data_sockets.first))
+    , _thread_data()
+    , _transport(transport)
     , _datagram_adapter(move(datagram_interface)) {
-    _thread_data.set_blocking(false);
+    if (data_sockets.second) {
+        _thread_data.emplace(move(*data_sockets.second));
+        _thread_data->set_blocking(false);
+    }
+    if (_transport == Transport::Ring) {
+        _outbound_ring = make_unique<ByteRing>(RING_CAPACITY);
+        _inbound_ring = make_unique<ByteRing>(RING_CAPACITY);
+        _tcp_wakeup.emplace();
+        _owner_wakeup.emplace();
+    }
 }
 
 void TUNSocket::_initialize_TCP(const TCPConfig &config) {
-    _tcp.emplace(config);
+    TCPConfig cfg = config;
+    if (const TunFD &tun = _datagram_adapter; tun.is_device()) {  // the interface's MTU caps the MSS
+        const size_t mss = TCPConfig::mss_for_mtu(tun.mtu());
+        cfg.mss = cfg.mss ? min(cfg.mss, mss) : mss;
+    }
+    _tcp.emplace(cfg);
 
     // Set up the event loop
 
@@ -77,36 +111,65 @@ void TUNSocket::_initialize_TCP(const TCPConfig &config) {
                                 _tcp->segment_received(move(seg.value()));
                             }
 
-                            // debugging output:
-                            if (_thread_data.eof() and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
-                                cerr << "DEBUG: Outbound stream to "
-                                     << _datagram_adapter.config().destination.to_string()
-                                     << " has been fully acknowledged.\n";
+                            if (_outbound_shutdown and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
+                                if (_verbose) {
+                                    cerr << "DEBUG: Outbound stream to "
+                                         << _datagram_adapter.config().destination.to_string()
+                                         << " has been fully acknowledged.\n";
+                                }
                                 _fully_acked = true;
                             }
                         },
                         [&] { return _tcp->active(); });
 
+    // rules 2 and 3, Transport::Ring: the owner signals new outbound bytes or freed inbound space;
+    // the rings are also pumped after every event (see _tcp_loop), since inbound bytes arrive via rule 1
+    if (_transport == Transport::Ring) {
+        _eventloop.add_rule(*_tcp_wakeup,
+                            Direction::In,
+                            [&] {
+                                _tcp_wakeup->clear();
+                                _pump_rings();
+                            },
+                            [&] { return (_tcp->active() and not _outbound_shutdown) or not _inbound_shutdown; });
+    } else {
+        _add_socketpair_rules();
+    }
+
+    // rule 4: read outbound segments from TCPConnection and send as datagrams
+    _eventloop.add_rule(_datagram_adapter,
+                        Direction::Out,
+                        [&] {
+                            while (not _tcp->segments_out().empty()) {
+                                _datagram_adapter.write(_tcp->segments_out().front());
+                                _tcp->segments_out().pop();
+                            }
+                        },
+                        [&] { return not _tcp->segments_out().empty(); });
+}
+
+void TUNSocket::_add_socketpair_rules() {
     // rule 2: read from pipe into outbound buffer
     _eventloop.add_rule(
-        _thread_data,
+        *_thread_data,
         Direction::In,
         [&] {
-            const auto data = _thread_data.read(_tcp->remaining_outbound_capacity());
+            const auto data = _thread_data->read(_tcp->remaining_outbound_capacity());
             const auto len = data.size();
             const auto amount_written = _tcp->write(move(data));
             if (amount_written != len) {
                 throw runtime_error("TCPConnection::write() accepted less than advertised length");
             }
 
-            if (_thread_data.eof()) {
+            if (_thread_data->eof()) {
                 _tcp->end_input_stream();
                 _outbound_shutdown = true;
 
-                // debugging output:
-                cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
-                     << " finished (" << _tcp.value().bytes_in_flight() << " byte"
-                     << (_tcp.value().bytes_in_flight() == 1 ? "" : "s") << " still in flight).\n";
+                if (_verbose) {
+                    cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
+                         << " finished (" << _tcp.value().bytes_in_flight() << " byte"
+                         << (_tcp.value().bytes_in_flight() == 1 ? "" : "s") << " still in flight).\n";
+                }
             }
         },
         [&] { return (_tcp->active()) and (not _outbound_shutdown) and (_tcp->remaining_outbound_capacity() > 0); },
@@ -117,7 +180,7 @@ void TUNSocket::_initialize_TCP(const TCPConfig &config) {
 
     // rule 3: read from inbound buffer into pipe
     _eventloop.add_rule(
-        _thread_data,
+        *_thread_data,
         Direction::Out,
         [&] {
             ByteStream &inbound = _tcp->inbound_stream();
@@ -126,17 +189,19 @@ void TUNSocket::_initialize_TCP(const TCPConfig &config) {
             // write (i.e., only pop what was actually written).
             const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
             const std::string buffer = inbound.peek_output(amount_to_write);
-            const auto bytes_written = _thread_data.write(move(buffer), false);
+            const auto bytes_written = _thread_data->write(move(buffer), false);
             inbound.pop_output(bytes_written);
+            _tcp->window_update();
 
             if (inbound.eof() or inbound.error()) {
-                _thread_data.shutdown(SHUT_WR);
+                _thread_data->shutdown(SHUT_WR);
                 _inbound_shutdown = true;
 
-                // debugging output:
-                cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string()
-                     << " finished " << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
-                if (_tcp.value().state() == TCPState::State::TIME_WAIT) {
+                if (_verbose) {
+                    cerr << "DEBUG: Inbound stream from " << _datagram_adapter.config().destination.to_string()
+                         << " finished " << (inbound.error() ? "with an error/reset.\n" : "cleanly.\n");
+                }
+                if (_verbose and _tcp.value().state() == TCPState::State::TIME_WAIT) {
                     cerr << "DEBUG: Waiting for lingering segments (e.g. retransmissions of FIN) from peer...\n";
                 }
             }
@@ -145,35 +210,138 @@ void TUNSocket::_initialize_TCP(const TCPConfig &config) {
             return (not _tcp->inbound_stream().buffer_empty()) or
                    ((_tcp->inbound_stream().eof() or _tcp->inbound_stream().error()) and not _inbound_shutdown);
         });
+}
 
-    // rule 4: read outbound segments from TCPConnection and send as datagrams
-    _eventloop.add_rule(_datagram_adapter,
-                        Direction::Out,
-                        [&] {
-                            while (not _tcp->segments_out().empty()) {
-                                _datagram_adapter.write(_tcp->segments_out().front());
-                                _tcp->segments_out().pop();
-                            }
-                        },
-                        [&] { return not _tcp->segments_out().empty(); });
+//! \details The Transport::Ring counterpart of rules 2 and 3. Each ring has one producer and one
+//! consumer: the owner pushes into `_outbound_ring` and pops from `_inbound_ring`, this thread does
+//! the opposite. Whichever side frees space or adds bytes notifies the other side's eventfd.
+void TUNSocket::_pump_rings() {
+    bool wake_owner = false;
+
+    // outbound: owner -> TCPConnection
+    if (_tcp->active() and not _outbound_shutdown) {
+        const bool closed = _outbound_ring->closed();  // before popping, so no byte pushed before close is missed
+        string data;
+        if (_outbound_ring->pop(data, _tcp->remaining_outbound_capacity()) > 0) {
+            const auto len = data.size();
+            if (_tcp->write(move(data)) != len) {
+                throw runtime_error("TCPConnection::write() accepted less than advertised length");
+            }
+            wake_owner = true;
+        }
+
+        if (closed and _outbound_ring->size() == 0) {
+            _tcp->end_input_stream();
+            _outbound_shutdown = true;
+        }
+    }
+
+    // inbound: TCPConnection -> owner
+    ByteStream &inbound = _tcp->inbound_stream();
+    if (not _inbound_shutdown) {
+        const size_t amount_to_push = min(inbound.buffer_size(), _inbound_ring->free_space());
+        if (amount_to_push > 0) {
+            inbound.pop_output(_inbound_ring->push(inbound.peek_output(amount_to_push)));
+            _tcp->window_update();
+            wake_owner = true;
+        }
+
+        if (inbound.eof() or inbound.error()) {
+            _inbound_ring->close();
+            _inbound_shutdown = true;
+            wake_owner = true;
+        }
+    }
+
+    if (wake_owner) {
+        _owner_wakeup->notify();
+    }
 }
 
-//! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
-//! \param[in] type is the type of AF_UNIX sockets to create (e.g., SOCK_SEQPACKET)
-//! \returns a std::pair of connected sockets
-static inline pair<FileDescriptor, FileDescriptor> socket_pair_helper(const int type) {
+//! \brief The sockets between the owner and the TCP thread: a [socketpair](\ref man2::socketpair) of AF_UNIX
+//! SOCK_STREAM sockets, or for Transport::Ring (whose bytes go through rings) one unconnected socket
+//! \returns the owner's end, and the TCP thread's end if there is one
+static inline pair<FileDescriptor, optional<FileDescriptor>> data_sockets(const TUNSocket::Transport transport) {
+    if (transport == TUNSocket::Transport::Ring) {
+        return {FileDescriptor(SystemCall("socket", ::socket(AF_UNIX, SOCK_STREAM, 0))), nullopt};
+    }
     int fds[2];
-    SystemCall("socketpair", ::socketpair(AF_UNIX, type, 0, static_cast<int *>(fds)));
+    SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, static_cast<int *>(fds)));
     return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
 }
 
 //! \param[in] datagram_interface is the underlying interface (e.g. to UDP, IP, or Ethernet)
 
-TUNSocket::TUNSocket(TCPOverIPv4OverTunFdAdapter &&datagram_interface)
-    : TUNSocket(socket_pair_helper(SOCK_STREAM), move(datagram_interface)) {}
+TUNSocket::TUNSocket(TCPOverIPv4OverTunFdAdapter &&datagram_interface, const Transport transport)
+    : TUNSocket(data_sockets(transport), move(datagram_interface), transport) {}
+
+TUNSocket::TUNSocket(std::string name, const Transport transport)
+    : TUNSocket(data_sockets(transport), move(TCPOverIPv4OverTunFdAdapter(TunFD(name))), transport) {}
+
+TUNSocket::TUNSocket(FileDescriptor &&datagram_fd, const Transport transport)
+    : TUNSocket(data_sockets(transport),
+                TCPOverIPv4OverTunFdAdapter(TunFD(move(datagram_fd))),
+                transport) {}
+
+//! \param[in] limit is the maximum number of bytes to read
+string TUNSocket::stream_read(const size_t limit) {
+    if (_transport == Transport::SocketPair) {
+        return FileDescriptor::read(limit);
+    }
+
+    string ret;
+    while (limit > 0) {
+        const bool closed = _inbound_ring->closed();  // before popping, so no byte pushed before close is missed
+        if (_inbound_ring->pop(ret, limit) > 0) {
+            _tcp_wakeup->notify();
+            break;
+        }
+        if (closed) {
+            _owner_eof = true;
+            break;
+        }
+        _owner_wakeup->wait();
+    }
+    return ret;
+}
+
+//! \param[in] data is the bytes to write
+//! \param[in] write_all is whether to block until every byte is accepted
+//! \returns the number of bytes accepted
+size_t TUNSocket::stream_write(string_view data, const bool write_all) {
+    if (_transport == Transport::SocketPair) {
+        return FileDescriptor::write(data, write_all);
+    }
+
+    size_t total_bytes_written = 0;
+    while (true) {
+        if (_outbound_ring->closed() or _tcp_done) {
+            throw runtime_error("TUNSocket: stream_write() after the outbound stream was shut down");
+        }
+        const size_t bytes_written = _outbound_ring->push(data);
+        if (bytes_written > 0) {
+            _tcp_wakeup->notify();
+        }
+        data.remove_prefix(bytes_written);
+        total_bytes_written += bytes_written;
+        if (data.empty() or (not write_all and total_bytes_written > 0)) {
+            return total_bytes_written;
+        }
+        _owner_wakeup->wait();
+    }
+}
 
-TUNSocket::TUNSocket(std::string name)
-    : TUNSocket(socket_pair_helper(SOCK_STREAM), move(TCPOverIPv4OverTunFdAdapter(TunFD(name)))) {}
+bool TUNSocket::stream_eof() const { return _transport == Transport::SocketPair ? FileDescriptor::eof() : _owner_eof; }
+
+//! \param[in] how is SHUT_WR, SHUT_RD or SHUT_RDWR, as for [shutdown(2)](\ref man2::shutdown)
+void TUNSocket::stream_shutdown(const int how) {
+    if (_transport == Transport::SocketPair) {
+        LocalStreamSocket::shutdown(how);
+    } else if ((how == SHUT_WR or how == SHUT_RDWR) and not _outbound_ring->closed()) {
+        _outbound_ring->close();
+        _tcp_wakeup->notify();
+    }
+}
 
 
 TUNSocket::~TUNSocket() {
@@ -184,6 +352,10 @@ TUNSocket::~TUNSocket() {
             _abort.store(true);
             _tcp_thread.join();
         }
+        if (_ephemeral_flow) {
+            const lock_guard<mutex> guard(tun_socket_ports_lock);
+            tun_socket_ports().release(*_ephemeral_flow);
+        }
     } catch (const exception &e) {
         cerr << "Exception destructing TUNSocket: " << e.what() << endl;
     }
@@ -191,11 +363,15 @@ TUNSocket::~TUNSocket() {
 
 
 void TUNSocket::wait_until_closed() {
-    shutdown(SHUT_RDWR);
+    stream_shutdown(SHUT_RDWR);
     if (_tcp_thread.joinable()) {
-        cerr << "DEBUG: Waiting for clean shutdown... ";
+        if (_verbose) {
+            cerr << "DEBUG: Waiting for clean shutdown... ";
+        }
         _tcp_thread.join();
-        cerr << "done.\n";
+        if (_verbose) {
+            cerr << "done.\n";
+        }
     }
 }
 
@@ -207,11 +383,17 @@ void TUNSocket::connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad) {
         throw runtime_error("connect() with TCPConnection already initialized");
     }
 
-    _initialize_TCP(c_tcp);
+    TCPConfig tcp_config = c_tcp;
+    if (not tcp_config.fixed_isn) {
+        tcp_config.fixed_isn = ISNGenerator::global().isn(FlowKey::from(c_ad));
+    }
+    _initialize_TCP(tcp_config);
 
-    _datagram_adapter.config_mut() = c_ad;
+    _datagram_adapter.set_config(c_ad);
 
-    cerr << "DEBUG: Connecting to " << c_ad.destination.to_string() << "... ";
+    if (_verbose) {
+        cerr << "DEBUG: Connecting to " << c_ad.destination.to_string() << "... ";
+    }
     _tcp->connect();
 
     const TCPState expected_state = TCPState::State::SYN_SENT;
@@ -222,7 +404,9 @@ void TUNSocket::connect(const TCPConfig &c_tcp, const FdAdapterConfig &c_ad) {
     }
 
     _tcp_loop([&] { return _tcp->state() == TCPState::State::SYN_SENT; });
-    cerr << "done.\n";
+    if (_verbose) {
+        cerr << "done.\n";
+    }
 
     _tcp_thread = thread(&TUNSocket::_tcp_main, this);
 }
@@ -237,15 +421,19 @@ void TUNSocket::listen_and_accept(const TCPConfig &c_tcp, const FdAdapterConfig
 
     _initialize_TCP(c_tcp);
 
-    _datagram_adapter.config_mut() = c_ad;
+    _datagram_adapter.set_config(c_ad);
     _datagram_adapter.set_listening(true);
 
-    cerr << "DEBUG: Listening for incoming connection... ";
+    if (_verbose) {
+        cerr << "DEBUG: Listening for incoming connection... ";
+    }
     _tcp_loop([&] {
         const auto s = _tcp->state();
         return (s == TCPState::State::LISTEN or s == TCPState::State::SYN_RCVD or s == TCPState::State::SYN_SENT);
     });
-    cerr << "new connection from " << _datagram_adapter.config().destination.to_string() << ".\n";
+    if (_verbose) {
+        cerr << "new connection from " << _datagram_adapter.config().destination.to_string() << ".\n";
+    }
 
     _tcp_thread = thread(&TUNSocket::_tcp_main, this);
 }
@@ -257,8 +445,14 @@ void TUNSocket::_tcp_main() {
             throw runtime_error("no TCP");
         }
         _tcp_loop([] { return true; });
-        shutdown(SHUT_RDWR);
-        if (not _tcp.value().active()) {
+        if (_transport == Transport::Ring) {
+            _inbound_ring->close();
+            _tcp_done = true;
+            _owner_wakeup->notify();
+        } else {
+            LocalStreamSocket::shutdown(SHUT_RDWR);
+        }
+        if (_verbose and not _tcp.value().active()) {
             cerr << "DEBUG: TCP connection finished "
                  << (_tcp.value().state() == TCPState::State::RESET ? "uncleanly" : "cleanly.\n");
         }
@@ -271,23 +465,30 @@ void TUNSocket::_tcp_main() {
 
 
 
-void TUNSocket::connect(const Address &address) {
-    TCPConfig tcp_config;
-    tcp_config.rt_timeout = 100;
+void TUNSocket::connect(const Address &address) { _connect_from("169.254.144.1", address); }
 
-    FdAdapterConfig multiplexer_config;
-    multiplexer_config.source = {"169.254.144.1", to_string(uint16_t(random_device()()))};
-    multiplexer_config.destination = address;
+void TUNSocket::connect(const string source_ip, const Address &address) { _connect_from(source_ip, address); }
 
-    connect(tcp_config, multiplexer_config);
-}
+void TUNSocket::_connect_from(const string &source_ip, const Address &address) {
+    if (_ephemeral_flow) {
+        throw runtime_error("connect() with TCPConnection already initialized");
+    }
+    FlowKey flow{Address{source_ip}.ipv4_numeric(), address.ipv4_numeric(), 0, address.port()};
+    {
+        const lock_guard<mutex> guard(tun_socket_ports_lock);
+        const optional<uint16_t> port = tun_socket_ports().allocate(flow);
+        if (not port) {
+            throw runtime_error("connect(): no free ephemeral port to " + address.to_string());
+        }
+        flow.local_port = *port;
+    }
+    _ephemeral_flow = flow;
 
-void TUNSocket::connect(const string source_ip, const Address &address) {
     TCPConfig tcp_config;
     tcp_config.rt_timeout = 100;
 
     FdAdapterConfig multiplexer_config;
-    multiplexer_config.source = {source_ip, to_string(uint16_t(random_device()()))};
+    multiplexer_config.source = {source_ip, flow.local_port};
     multiplexer_config.destination = address;
 
     connect(tcp_config, multiplexer_config);
@@ -1,7 +1,9 @@
 #ifndef TCP_TUN_SOCKET
 #define TCP_TUN_SOCKET
 
+#include "byte_ring.hh"
 #include "byte_stream.hh"
+#include "eventfd.hh"
 #include "eventloop.hh"
 #include "file_descriptor.hh"
 #include "tcp_config.hh"
@@ -10,15 +12,41 @@
 
 #include <atomic>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 //! Multithreaded wrapper around TCPConnection that approximates the Unix sockets API
 class TUNSocket : public LocalStreamSocket {
+  public:
+    //! How application bytes travel between the owner and the TCP thread
+    enum class Transport {
+        SocketPair,  //!< through an AF_UNIX socketpair: the TUNSocket is a real fd the owner can poll
+        Ring         //!< through in-process lock-free rings with eventfd wakeups: no syscalls or kernel copies
+    };
+
   private:
-    //! Stream socket for reads and writes between owner and TCP thread
-    LocalStreamSocket _thread_data;
+    //! Stream socket for reads and writes between owner and TCP thread (Transport::SocketPair only)
+    std::optional<LocalStreamSocket> _thread_data;
+
+    //! \name Ring transport (Transport::Ring only)
+    //!@{
+    Transport _transport;
+    std::unique_ptr<ByteRing> _outbound_ring{};  //!< owner writes, TCP thread reads
+    std::unique_ptr<ByteRing> _inbound_ring{};   //!< TCP thread writes, owner reads
+    std::optional<EventFD> _tcp_wakeup{};        //!< owner -> TCP thread: outbound bytes, or inbound space
+    std::optional<EventFD> _owner_wakeup{};      //!< TCP thread -> owner: inbound bytes, or outbound space
+    bool _owner_eof{false};                      //!< has the owner read the end of the inbound ring?
+
+    //! Move bytes between the rings and the TCPConnection, and propagate shutdowns (TCP thread)
+    void _pump_rings();
+
+    //! Add the event-loop rules that move bytes through the socketpair (Transport::SocketPair only)
+    void _add_socketpair_rules();
+    //!@}
 
     //! Adapter to underlying datagram socket (e.g., UDP or IP)
     TCPOverIPv4OverTunFdAdapter _datagram_adapter;
@@ -41,8 +69,10 @@ class TUNSocket : public LocalStreamSocket {
     //! Handle to the TCPConnection thread; owner thread calls join() in the destructor
     std::thread _tcp_thread{};
 
-    //! Construct LocalStreamSocket fds from socket pair, initialize eventloop
-    TUNSocket(std::pair<FileDescriptor, FileDescriptor> data_socket_pair, TCPOverIPv4OverTunFdAdapter &&datagram_interface);
+    //! Construct LocalStreamSocket fds from the owner's and (Transport::SocketPair only) the TCP thread's ends
+    TUNSocket(std::pair<FileDescriptor, std::optional<FileDescriptor>> data_sockets,
+              TCPOverIPv4OverTunFdAdapter &&datagram_interface,
+              const Transport transport);
 
     std::atomic_bool _abort{false};  //!< Flag used by the owner to force the TCPConnection thread to shut down
 
@@ -52,13 +82,53 @@ class TUNSocket : public LocalStreamSocket {
 
     bool _fully_acked{false};  //!< Has the outbound data been fully acknowledged by the peer?
 
+    std::atomic_bool _tcp_done{false};  //!< Has the TCPConnection thread finished (Transport::Ring only)?
+
+    std::optional<FlowKey> _ephemeral_flow{};  //!< flow whose ephemeral local port this socket holds, if any
+
+    bool _verbose{false};  //!< Report connection progress ("DEBUG: ...") on std::cerr?
+
+    //! Connect from an ephemeral port of `source_ip`
+    void _connect_from(const std::string &source_ip, const Address &address);
+
   public:
     //! Construct from the interface that the TCPConnection thread will use to read and write datagrams
     //! Using the default name for tun device
-    explicit TUNSocket(TCPOverIPv4OverTunFdAdapter &&datagram_interface = TCPOverIPv4OverTunFdAdapter(TunFD("starfish_tun")));
+    explicit TUNSocket(TCPOverIPv4OverTunFdAdapter &&datagram_interface = TCPOverIPv4OverTunFdAdapter(TunFD("starfish_tun")),
+                       const Transport transport = Transport::SocketPair);
     //! Using user-defined name, NOTE: make sure the tun device is available and the related routing rules are configured.
-    explicit TUNSocket(std::string name);
+    explicit TUNSocket(std::string name, const Transport transport = Transport::SocketPair);
+    //! Using a datagram fd that stands in for the tun device (e.g. one end of a socketpair, in tests)
+    TUNSocket(FileDescriptor &&datagram_fd, const Transport transport);
+
+    //! \name Reliable byte stream to and from the peer
+    //! These work in either Transport mode. In Transport::Ring mode, the TUNSocket's own fd is an unconnected
+    //! socket that carries no bytes (so it can't be polled), and the FileDescriptor methods of the same names
+    //! are hidden by the ones below.
+    //!@{
+
+    //! Read up to `limit` bytes, blocking until at least one byte or EOF arrives
+    std::string stream_read(const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Write `data`, blocking until all of it (or, if `write_all` is false, at least some of it) is accepted
+    size_t stream_write(std::string_view data, const bool write_all = true);
+
+    //! Has the owner read the end of the inbound stream?
+    bool stream_eof() const;
+
+    //! Shut down the outbound (SHUT_WR) and/or inbound (SHUT_RD) stream
+    void stream_shutdown(const int how);
+
+    std::string read(const size_t limit = std::numeric_limits<size_t>::max()) { return stream_read(limit); }
+    size_t write(std::string_view data, const bool write_all = true) { return stream_write(data, write_all); }
+    bool eof() const { return stream_eof(); }
+    void shutdown(const int how) { stream_shutdown(how); }
+    //!@}
+
 
+    //! Report the connection's progress (connecting, accepting, each stream finishing) on std::cerr; call
+    //! before connect() or listen_and_accept()
+    void set_verbose(const bool verbose) { _verbose = verbose; }
 
     //! Close socket, and wait for TCPConnection to finish
     //! \note Calling this function is only advisable if the socket has reached EOF,
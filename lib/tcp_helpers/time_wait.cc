@@ -0,0 +1,101 @@
+#include "time_wait.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+TimeWaitTable::TimeWaitTable(const size_t granularity_ms) : _wheel(SLOTS), _granularity_ms(granularity_ms) {
+    if (granularity_ms == 0) {
+        throw runtime_error("TimeWaitTable: granularity must be positive");
+    }
+}
+
+void TimeWaitTable::_schedule(const FlowKey &flow, const uint64_t expiry_ms) {
+    // round up, so an entry is never forgotten early, but never into a slot tick() has already passed (e.g.
+    // an expiry of _now_ms on a slot boundary), where the entry would wait a whole turn of the wheel
+    const uint64_t slot = max((expiry_ms + _granularity_ms - 1) / _granularity_ms, _now_ms / _granularity_ms + 1);
+    _wheel[slot % SLOTS].push_back(flow);
+}
+
+void TimeWaitTable::add(const FlowKey &flow, const TCPConnection &conn) {
+    if (not conn.lingering() or not conn.ackno()) {
+        throw runtime_error("TimeWaitTable::add(): connection isn't lingering");
+    }
+    add(flow, {conn.next_seqno(), *conn.ackno(), 0, 0, conn.receive_window()}, conn.linger_remaining());
+}
+
+//! \param[in] flow is the flow, seen from the local end
+//! \param[in] entry holds the final seqnos (its expiry is set from `linger_ms`)
+//! \param[in] linger_ms is how long to stay in TIME_WAIT; unless `entry.linger_ms` is set, it's also
+//! what a retransmitted FIN restarts the timer for
+void TimeWaitTable::add(const FlowKey &flow, const Entry &entry, const size_t linger_ms) {
+    Entry &e = _entries.insert_or_assign(flow, entry).first->second;
+    e.expiry_ms = _now_ms + linger_ms;
+    if (e.linger_ms == 0) {
+        e.linger_ms = linger_ms;
+    }
+    _schedule(flow, e.expiry_ms);
+}
+
+optional<TCPSegment> TimeWaitTable::segment_received(const FlowKey &flow, const TCPSegment &seg) {
+    const auto it = _entries.find(flow);
+    if (it == _entries.end()) {
+        throw runtime_error("TimeWaitTable::segment_received(): flow isn't in TIME_WAIT");
+    }
+    Entry &e = it->second;
+    const TCPHeader &hdr = seg.header();
+    if (hdr.rst) {
+        return {};
+    }
+    if (hdr.syn) {
+        if (hdr.seqno - e.ackno > 0) {  // a new incarnation of the flow
+            _entries.erase(it);
+        }
+        return {};
+    }
+    if (seg.length_in_sequence_space() == 0) {
+        return {};
+    }
+    if (hdr.fin) {
+        e.expiry_ms = _now_ms + e.linger_ms;
+        _schedule(flow, e.expiry_ms);
+    }
+    TCPSegment ack;
+    ack.header().ack = true;
+    ack.header().seqno = e.seqno;
+    ack.header().ackno = e.ackno;
+    ack.header().win = e.win;
+    return ack;
+}
+
+void TimeWaitTable::tick(const size_t ms_since_last_tick, const function<void(const FlowKey &)> &expired) {
+    const uint64_t then = _now_ms;
+    _now_ms += ms_since_last_tick;
+    // visit each slot whose time has come since the last tick (every slot, at most, once)
+    const uint64_t first = then / _granularity_ms + 1, last = _now_ms / _granularity_ms;
+    for (uint64_t t = first; t <= last and t < first + SLOTS; ++t) {
+        vector<FlowKey> &slot = _wheel[t % SLOTS];
+        if (_entries.empty()) {
+            slot.clear();  // only stale flows (erased or reopened) are left
+            continue;
+        }
+        for (size_t i = 0; i < slot.size();) {
+            const auto it = _entries.find(slot[i]);
+            if (it != _entries.end() and it->second.expiry_ms > _now_ms) {
+                if ((it->second.expiry_ms + _granularity_ms - 1) / _granularity_ms % SLOTS == t % SLOTS) {
+                    ++i;  // due in a later turn of the wheel
+                    continue;
+                }
+            } else if (it != _entries.end()) {
+                if (expired) {
+                    expired(it->first);
+                }
+                _entries.erase(it);
+            }
+            // expired, erased, or restarted (and scheduled again in another slot)
+            slot[i] = slot.back();
+            slot.pop_back();
+        }
+    }
+}
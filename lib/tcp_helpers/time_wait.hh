@@ -0,0 +1,76 @@
+#ifndef TIME_WAIT_TABLE
+#define TIME_WAIT_TABLE
+
+#include "flow_key.hh"
+#include "tcp_connection.hh"
+#include "tcp_segment.hh"
+#include "wrapping_integers.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! \brief The TIME_WAIT state of closed connections, kept in a few bytes per flow instead of a
+//! whole TCPConnection
+//! \details An entry holds what it takes to ACK the peer's retransmitted FIN: our final seqno, the
+//! ackno and window we last advertised, and when the entry expires. Expiries are indexed by a hashed
+//! timer wheel, so tick() only visits the entries whose slots it passes.
+class TimeWaitTable {
+  public:
+    //! One flow in TIME_WAIT
+    struct Entry {
+        WrappingInt32 seqno;  //!< our next seqno (after our FIN)
+        WrappingInt32 ackno;  //!< the peer's next seqno (after its FIN)
+        uint64_t expiry_ms;   //!< when the entry is forgotten (on the table's clock)
+        uint32_t linger_ms;   //!< how long a retransmitted FIN restarts the timer for
+        uint16_t win;         //!< the window we advertised
+    };
+
+    //! Slots of the timer wheel
+    static constexpr size_t SLOTS = 512;
+
+  private:
+    std::unordered_map<FlowKey, Entry, FlowKeyHash> _entries{};
+    std::vector<std::vector<FlowKey>> _wheel;  //!< flows by expiry slot (stale when restarted or erased)
+    size_t _granularity_ms;                    //!< time covered by one slot
+    uint64_t _now_ms{0};
+
+    //! Index `flow` in the slot of `expiry_ms`
+    void _schedule(const FlowKey &flow, const uint64_t expiry_ms);
+
+  public:
+    //! Construct a table whose entries expire within `granularity_ms` of their deadline
+    explicit TimeWaitTable(const size_t granularity_ms = 100);
+
+    //! \brief Keep `flow` in TIME_WAIT for `conn`'s remaining linger time, with its final seqnos
+    //! \note `conn` must be lingering() (the caller then drops it)
+    void add(const FlowKey &flow, const TCPConnection &conn);
+
+    //! Keep `flow` in TIME_WAIT for `linger_ms`
+    void add(const FlowKey &flow, const Entry &entry, const size_t linger_ms);
+
+    //! Is `flow` in TIME_WAIT?
+    bool contains(const FlowKey &flow) const { return _entries.count(flow); }
+
+    //! \brief Handle a segment of a flow that contains()
+    //! \details A retransmitted FIN (or any segment that occupies sequence space) is ACKed, and a FIN
+    //! restarts the timer. A SYN beyond the final ackno reopens the flow: its entry is erased, so the
+    //! caller can pass the SYN on to a listener. Anything else, including RSTs (RFC 1337), is absorbed.
+    //! \returns the ACK to send, if any
+    std::optional<TCPSegment> segment_received(const FlowKey &flow, const TCPSegment &seg);
+
+    //! Forget `flow` (e.g. because a new connection reuses it)
+    void erase(const FlowKey &flow) { _entries.erase(flow); }
+
+    //! \brief Advance the clock, forgetting expired entries
+    //! \param[in] expired is called with the flow of each expired entry
+    void tick(const size_t ms_since_last_tick, const std::function<void(const FlowKey &)> &expired = {});
+
+    //! Number of flows in TIME_WAIT
+    size_t size() const { return _entries.size(); }
+};
+
+#endif /* TIME_WAIT_TABLE */
@@ -2,9 +2,9 @@
 
 #include "ipv4_datagram.hh"
 #include "ipv4_header.hh"
+#include "metrics.hh"
 #include "parser.hh"
 
-#include <arpa/inet.h>
 #include <stdexcept>
 #include <unistd.h>
 #include <utility>
@@ -26,12 +26,14 @@ using namespace std;
 optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram &ip_dgram) {
     // is the IPv4 datagram for us?
     // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
-    if (not listening() and (ip_dgram.header().dst != config().source.ipv4_numeric())) {
+    if (not listening() and (ip_dgram.header().dst != _flow.local_address)) {
+        StackMetrics::demux_miss();
         return {};
     }
 
     // is the IPv4 datagram from our peer?
-    if (not listening() and (ip_dgram.header().src != config().destination.ipv4_numeric())) {
+    if (not listening() and (ip_dgram.header().src != _flow.remote_address)) {
+        StackMetrics::demux_miss();
         return {};
     }
 
@@ -42,28 +44,37 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 
     // is the payload a valid TCP segment?
     TCPSegment tcp_seg;
-    if (ParseResult::NoError != tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum())) {
+    if (const ParseResult r = tcp_seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum());
+        r != ParseResult::NoError) {
+        StackMetrics::tcp_parse_failure(r);
         return {};
     }
 
     // is the TCP segment for us?
-    if (tcp_seg.header().dport != config().source.port()) {
+    if (tcp_seg.header().dport != _flow.local_port) {
+        StackMetrics::demux_miss();
         return {};
     }
 
     // should we target this source addr/port (and use its destination addr as our source) in reply?
     if (listening()) {
         if (tcp_seg.header().syn and not tcp_seg.header().rst) {
-            config_mutable().source = {inet_ntoa({htobe32(ip_dgram.header().dst)}), config().source.port()};
-            config_mutable().destination = {inet_ntoa({htobe32(ip_dgram.header().src)}), tcp_seg.header().sport};
+            _flow.local_address = ip_dgram.header().dst;
+            _flow.remote_address = ip_dgram.header().src;
+            _flow.remote_port = tcp_seg.header().sport;
+            _template = HeaderTemplate{_flow};
+            config_mutable().source = {Address::from_ipv4_numeric(_flow.local_address).ip(), _flow.local_port};
+            config_mutable().destination = {Address::from_ipv4_numeric(_flow.remote_address).ip(), _flow.remote_port};
             set_listening(false);
         } else {
+            StackMetrics::demux_miss();
             return {};
         }
     }
 
     // is the TCP segment from our peer?
-    if (tcp_seg.header().sport != config().destination.port()) {
+    if (tcp_seg.header().sport != _flow.remote_port) {
+        StackMetrics::demux_miss();
         return {};
     }
 
@@ -74,13 +85,13 @@ optional<TCPSegment> TCPOverIPv4Adapter::unwrap_tcp_in_ip(const InternetDatagram
 //! \param[in] seg is the TCP segment to convert
 InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
     // set the port numbers in the TCP segment
-    seg.header().sport = config().source.port();
-    seg.header().dport = config().destination.port();
+    seg.header().sport = _flow.local_port;
+    seg.header().dport = _flow.remote_port;
 
     // create an Internet Datagram and set its addresses and length
     InternetDatagram ip_dgram;
-    ip_dgram.header().src = config().source.ipv4_numeric();
-    ip_dgram.header().dst = config().destination.ipv4_numeric();
+    ip_dgram.header().src = _flow.local_address;
+    ip_dgram.header().dst = _flow.remote_address;
     ip_dgram.header().len = ip_dgram.header().hlen * 4 + seg.header().doff * 4 + seg.payload().size();
 
     // set payload, calculating TCP checksum using information from IP header
@@ -88,3 +99,45 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip(TCPSegment &seg) {
 
     return ip_dgram;
 }
+
+//! \details Segments produced by TCPSender carry TCPConfig::HEADROOM bytes of headroom in front of
+//! their payload, enough for the headers of any segment it sends (a SYN's MSS option included);
+//! header-only segments are given the adapter's own headroom, which is only replaced while the last
+//! datagram written into it is still referenced (e.g. queued). Both headers are written there, so
+//! the datagram is built without allocating or copying the payload. Segments without options (all
+//! but SYNs) are wrapped by the flow's HeaderTemplate, which patches the few fields that change
+//! into prebuilt headers.
+//! \param[in] seg is the TCP segment to convert
+//! \returns the complete datagram, or empty if the payload has no room for the headers
+optional<Buffer> TCPOverIPv4Adapter::wrap_tcp_in_ip_in_place(TCPSegment &seg) {
+    if (seg.payload().size() == 0) {
+        seg.payload() = Buffer{};  // (it may still refer to the headroom from the last call)
+        if (not _ack_headroom.unshared()) {
+            _ack_headroom = Buffer{string(TCPConfig::HEADROOM, 0), TCPConfig::HEADROOM};
+        }
+        seg.payload() = _ack_headroom;
+    }
+
+    // set the port numbers in the TCP segment
+    seg.header().sport = _flow.local_port;
+    seg.header().dport = _flow.remote_port;
+
+    if (HeaderTemplate::fits(seg)) {
+        return _template.write(seg.header(), seg.payload());
+    }
+
+    const size_t tcp_header_len = 4 * size_t(seg.header().doff);
+    if (seg.payload().headroom() < IPv4Header::LENGTH + tcp_header_len) {
+        return {};
+    }
+
+    // set the IPv4 header's addresses and length
+    IPv4Header ip_header;
+    ip_header.src = _flow.local_address;
+    ip_header.dst = _flow.remote_address;
+    ip_header.len = ip_header.hlen * 4 + tcp_header_len + seg.payload().size();
+
+    // TCP header (and checksum) first, then the IPv4 header in front of it
+    Buffer tcp_part = seg.serialize_in_place(ip_header.pseudo_cksum());
+    return IPv4Datagram::serialize_in_place(ip_header, tcp_part);
+}
@@ -6,11 +6,18 @@
 #include <utility>
 #include "../util/tun.hh"
 #include "../util/socket.hh"
+#include "flow_key.hh"
+#include "header_template.hh"
 #include "tcp_config.hh"
 #include "tcp_header.hh"
 #include "tcp_segment.hh"
 #include "ipv4_datagram.hh"
 #include "file_descriptor.hh"
+#include "metrics.hh"
+#include "pcap.hh"
+
+#include <memory>
+#include <string_view>
 
 class FdAdapterBase {
   private:
@@ -42,10 +49,67 @@ class FdAdapterBase {
 };
 
 class TCPOverIPv4Adapter : public FdAdapterBase {
+  private:
+    //! Where datagrams read and written are captured, if anywhere
+    std::shared_ptr<PcapCapture> _capture{};
+
+    //! config()'s addresses and ports, as numbers for the per-packet path
+    FlowKey _flow{};
+
+    //! The headers of _flow's outbound datagrams, prebuilt (see wrap_tcp_in_ip_in_place())
+    HeaderTemplate _template{};
+
+    //! Headroom for the headers of header-only segments, reused once no datagram refers to it
+    Buffer _ack_headroom{};
+
+  protected:
+    //! Hand `datagram` to the capture, if there is one
+    void capture(const std::string_view datagram) {
+        if (_capture) {
+            _capture->capture(datagram);
+        }
+    }
+
   public:
+    //! \brief Set the local (`source`) and remote (`destination`) addresses, and cache their FlowKey
+    void set_config(const FdAdapterConfig &cfg) {
+        config_mutable() = cfg;
+        _flow = FlowKey::from(cfg);
+        _template = HeaderTemplate{_flow};
+    }
+
+    //! Changing the addresses must go through set_config(), which keeps flow() current
+    FdAdapterConfig &config_mut() = delete;
+
+    //! The flow this adapter sends and accepts (while listening, only its local port is set)
+    const FlowKey &flow() const { return _flow; }
+
+    //! \brief Capture every datagram read or written through this adapter (nullptr stops capturing)
+    //! \note The capture may be shared by adapters that run on the same thread
+    void set_capture(std::shared_ptr<PcapCapture> capture) { _capture = std::move(capture); }
+
     std::optional<TCPSegment> unwrap_tcp_in_ip(const InternetDatagram &ip_dgram);
 
     InternetDatagram wrap_tcp_in_ip(TCPSegment &seg);
+
+    //! Serializes `seg` and its IPv4 header into the headroom in front of the segment's payload
+    //! \note The caller owns `seg`; the datagram shares its payload's storage, and is only valid until the next
+    //! in-place write into that storage (e.g. a retransmission of the same payload)
+    std::optional<Buffer> wrap_tcp_in_ip_in_place(TCPSegment &seg);
+
+    //! Wraps `seg` in an IPv4 datagram (in place when possible) and writes it to `fd`
+    void write_to(FileDescriptor &fd, TCPSegment &seg) {
+        if (const auto dgram = wrap_tcp_in_ip_in_place(seg)) {
+            capture(dgram->str());
+            fd.write(dgram->str());
+        } else {
+            const BufferList serialized = wrap_tcp_in_ip(seg).serialize();
+            if (_capture) {
+                _capture->capture(serialized.concatenate());
+            }
+            fd.write(serialized);
+        }
+    }
 };
 
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
@@ -59,14 +123,18 @@ class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter {
     //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
     std::optional<TCPSegment> read() {
         InternetDatagram ip_dgram;
-        if (ip_dgram.parse(_tun.read()) != ParseResult::NoError) {
+        std::string raw = _tun.read();
+        capture(raw);
+        const ParseResult r = ip_dgram.parse(std::move(raw));
+        if (r != ParseResult::NoError) {
+            StackMetrics::ipv4_parse_failure(r);
             return {};
         }
         return unwrap_tcp_in_ip(ip_dgram);
     }
 
     //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-    void write(TCPSegment &seg) { _tun.write(wrap_tcp_in_ip(seg).serialize()); }
+    void write(TCPSegment &seg) { write_to(_tun, seg); }
 
     //! Access the underlying TUN device
     operator TunFD &() { return _tun; }
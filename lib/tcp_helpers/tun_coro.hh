@@ -0,0 +1,360 @@
+#ifndef TUN_CORO
+#define TUN_CORO
+
+#if !defined(__cpp_impl_coroutine)
+#error "tun_coro.hh needs C++20 coroutines: compile this translation unit with -std=c++2a"
+#endif
+
+#include "eventloop.hh"
+#include "tcp_config.hh"
+#include "tun_adapter.hh"
+#include "tun_stack.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+class CoroStack;
+
+//! \brief A coroutine that returns nothing; started by CoroStack::spawn or by being co_awaited
+//! \details An exception escaping the coroutine is rethrown to whoever co_awaits it (or from CoroStack::run).
+class CoroTask {
+  public:
+    struct promise_type {
+        std::coroutine_handle<> continuation{};  //!< resumed when this coroutine finishes
+        std::exception_ptr exception{};
+
+        CoroTask get_return_object() { return CoroTask{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                const auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+  private:
+    std::coroutine_handle<promise_type> _handle;
+
+    explicit CoroTask(std::coroutine_handle<promise_type> h) : _handle(h) {}
+
+  public:
+    CoroTask(CoroTask &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    CoroTask &operator=(CoroTask &&other) noexcept {
+        std::swap(_handle, other._handle);
+        return *this;
+    }
+    CoroTask(const CoroTask &other) = delete;
+    CoroTask &operator=(const CoroTask &other) = delete;
+    ~CoroTask() {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    //! Has the coroutine run to completion?
+    bool done() const { return not _handle or _handle.done(); }
+
+    //! Run the coroutine until it first suspends (or finishes)
+    void start() { _handle.resume(); }
+
+    //! Rethrow the exception the coroutine finished with, if any
+    void rethrow_if_failed() const {
+        if (_handle and _handle.promise().exception) {
+            std::rethrow_exception(_handle.promise().exception);
+        }
+    }
+
+    //! \name Awaiting a CoroTask runs it, and resumes the awaiting coroutine once it finishes
+    //!@{
+    bool await_ready() const { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        _handle.promise().continuation = awaiting;
+        return _handle;
+    }
+    void await_resume() const { rethrow_if_failed(); }
+    //!@}
+};
+
+//! \brief An awaitable that parks the awaiting coroutine on a CoroStack until it can make progress
+//! \details It lives in the coroutine's frame while parked.
+class CoroAwaiter {
+  private:
+    friend class CoroStack;
+    std::coroutine_handle<> _handle{};
+
+  protected:
+    CoroStack &_stack;
+    uint64_t _deadline = std::numeric_limits<uint64_t>::max();  //!< ms timestamp that wakes CoroStack::run(), if any
+
+    //! Make whatever progress is possible; true once the coroutine can be resumed
+    virtual bool poll() = 0;
+
+  public:
+    explicit CoroAwaiter(CoroStack &stack) : _stack(stack) {}
+    virtual ~CoroAwaiter() = default;
+
+    bool await_ready() { return poll(); }
+    void await_suspend(std::coroutine_handle<> h);
+};
+
+//! \brief A TUNConnection whose reads and writes are awaited instead of polled
+class CoroConnection {
+  private:
+    CoroStack &_stack;
+    std::shared_ptr<TUNConnection> _conn;
+
+  public:
+    //! Awaitable returned by read()
+    class ReadAwaiter : public CoroAwaiter {
+        TUNConnection &_conn;
+        std::string &_buf;
+        size_t _limit;
+
+      protected:
+        bool poll() override { return _conn.readable() or not _conn.active(); }
+
+      public:
+        ReadAwaiter(CoroStack &s, TUNConnection &conn, std::string &buf, const size_t limit)
+            : CoroAwaiter(s), _conn(conn), _buf(buf), _limit(limit) {}
+        size_t await_resume() { return _conn.read(_buf, _limit); }
+    };
+
+    //! Awaitable returned by write()
+    class WriteAwaiter : public CoroAwaiter {
+        TUNConnection &_conn;
+        std::string_view _data;
+        size_t _written = 0;
+
+      protected:
+        bool poll() override {
+            _written += _conn.write(_data.substr(_written));
+            return _written == _data.size() or not _conn.active();
+        }
+
+      public:
+        WriteAwaiter(CoroStack &s, TUNConnection &conn, std::string_view data)
+            : CoroAwaiter(s), _conn(conn), _data(data) {}
+        size_t await_resume() const { return _written; }
+    };
+
+    CoroConnection(CoroStack &stack, std::shared_ptr<TUNConnection> conn) : _stack(stack), _conn(std::move(conn)) {}
+
+    //! \brief Awaitable: append up to `limit` bytes to `buf` once some have arrived
+    //! \returns (from co_await) the number of bytes read; 0 means the inbound stream has ended
+    ReadAwaiter read(std::string &buf, const size_t limit = std::numeric_limits<size_t>::max()) {
+        return {_stack, *_conn, buf, limit};
+    }
+
+    //! \brief Awaitable: write all of `data`, suspending while the outbound stream is full
+    //! \returns (from co_await) the number of bytes written, which is short only if the connection died
+    //! \note `data` must stay valid until the co_await completes
+    WriteAwaiter write(std::string_view data) { return {_stack, *_conn, data}; }
+
+    //! End the outbound stream
+    void shutdown_write() { _conn->shutdown_write(); }
+
+    bool eof() const { return _conn->eof(); }
+    bool active() const { return _conn->active(); }
+    TCPState state() const { return _conn->state(); }
+    const FdAdapterConfig &config() const { return _conn->config(); }
+
+    //! The underlying (non-blocking) connection
+    TUNConnection &connection() { return *_conn; }
+};
+
+//! \brief Schedules coroutines over a TUNStack on the application's EventLoop
+//! \details A coroutine that can't make progress (nothing to read, no room to write, no connection to
+//! accept, a timer that hasn't expired) parks itself on the CoroStack. run() waits on the EventLoop,
+//! ticks the TUNStack, and resumes every parked coroutine that can now make progress.
+class CoroStack {
+  public:
+    //! Awaitable returned by connect()
+    class ConnectAwaiter : public CoroAwaiter {
+        std::shared_ptr<TUNConnection> _conn;
+
+      protected:
+        bool poll() override {
+            const auto state = _conn->state();
+            return not _conn->active() or
+                   (state != TCPState::State::SYN_SENT and state != TCPState::State::SYN_RCVD);
+        }
+
+      public:
+        ConnectAwaiter(CoroStack &s, std::shared_ptr<TUNConnection> conn) : CoroAwaiter(s), _conn(std::move(conn)) {}
+        CoroConnection await_resume() {
+            if (not _conn->active()) {
+                throw std::runtime_error("CoroStack::connect(): connection failed");
+            }
+            return {_stack, std::move(_conn)};
+        }
+    };
+
+    //! Awaitable returned by accept()
+    class AcceptAwaiter : public CoroAwaiter {
+        std::shared_ptr<TUNConnection> _conn{};
+
+      protected:
+        bool poll() override {
+            _conn = _stack._stack.accept();
+            return _conn != nullptr;
+        }
+
+      public:
+        using CoroAwaiter::CoroAwaiter;
+        CoroConnection await_resume() { return {_stack, std::move(_conn)}; }
+    };
+
+    //! Awaitable returned by sleep_for()
+    class SleepAwaiter : public CoroAwaiter {
+      protected:
+        bool poll() override { return timestamp_ms() >= _deadline; }
+
+      public:
+        SleepAwaiter(CoroStack &s, const uint64_t deadline) : CoroAwaiter(s) { _deadline = deadline; }
+        void await_resume() const {}
+    };
+
+    //! Time between two ticks of the TUNStack while waiting on the EventLoop
+    static constexpr int TICK_MS = 10;
+
+  private:
+    friend class CoroAwaiter;
+
+    TUNStack &_stack;
+    EventLoop &_loop;
+    std::list<CoroTask> _tasks{};
+    std::list<CoroAwaiter *> _parked{};
+    uint64_t _now;
+
+    //! Resume parked coroutines until none can make progress
+    void _resume_ready() {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (auto it = _parked.begin(); it != _parked.end();) {
+                if ((*it)->poll()) {
+                    const auto h = (*it)->_handle;
+                    it = _parked.erase(it);
+                    h.resume();
+                    progress = true;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    //! How long the EventLoop may wait before a timer expires or the TUNStack needs a tick
+    int _poll_timeout() const {
+        uint64_t deadline = _now + TICK_MS;
+        for (const auto *waiter : _parked) {
+            deadline = std::min(deadline, waiter->_deadline);
+        }
+        return static_cast<int>(deadline > _now ? deadline - _now : 0);
+    }
+
+  public:
+    //! \param[in] stack is the TUNStack whose connections are awaited
+    //! \param[in] loop is the EventLoop the stack's rules are installed on
+    CoroStack(TUNStack &stack, EventLoop &loop) : _stack(stack), _loop(loop), _now(timestamp_ms()) {
+        _stack.install_rules(_loop);
+    }
+
+    //! \brief Start `task`; it is owned by the CoroStack until it finishes
+    void spawn(CoroTask task) {
+        _tasks.push_back(std::move(task));
+        _tasks.back().start();
+    }
+
+    //! \brief Run until every spawned task has finished
+    //! \note Rethrows the first exception to escape a spawned task
+    void run() {
+        while (true) {
+            _resume_ready();
+            for (auto it = _tasks.begin(); it != _tasks.end();) {
+                if (it->done()) {
+                    it->rethrow_if_failed();
+                    it = _tasks.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (_tasks.empty()) {
+                return;
+            }
+
+            if (_loop.wait_next_event(_poll_timeout()) == EventLoop::Result::Exit) {
+                throw std::runtime_error("CoroStack::run(): EventLoop exited with tasks still waiting");
+            }
+            const uint64_t now = timestamp_ms();
+            _stack.tick(now - _now);
+            _now = now;
+        }
+    }
+
+    //! \brief Awaitable: open a connection, resuming once it is established
+    //! \throws std::runtime_error (from co_await) if the connection is refused or times out
+    ConnectAwaiter connect(const TCPConfig &cfg, const FdAdapterConfig &adapter_cfg) {
+        return {*this, _stack.connect(cfg, adapter_cfg)};
+    }
+
+    //! \brief Awaitable: the next connection accepted by one of the TUNStack's listeners
+    AcceptAwaiter accept() { return AcceptAwaiter{*this}; }
+
+    //! \brief Awaitable: resume after `ms` milliseconds
+    SleepAwaiter sleep_for(const uint64_t ms) { return {*this, timestamp_ms() + ms}; }
+};
+
+inline void CoroAwaiter::await_suspend(std::coroutine_handle<> h) {
+    _handle = h;
+    _stack._parked.push_back(this);
+}
+
+//! \class CoroStack
+//! Example: an echo server, written as straight-line code with no thread per connection
+//!
+//! ~~~{.cpp}
+//! CoroTask echo(CoroConnection conn) {
+//!     std::string buf;
+//!     while (true) {
+//!         const size_t n = co_await conn.read(buf);
+//!         if (n == 0) {
+//!             break;
+//!         }
+//!         co_await conn.write(buf);
+//!         buf.clear();
+//!     }
+//!     conn.shutdown_write();
+//! }
+//!
+//! CoroTask serve(CoroStack &stack) {
+//!     while (true) {
+//!         CoroConnection conn = co_await stack.accept();
+//!         stack.spawn(echo(std::move(conn)));
+//!     }
+//! }
+//! ~~~
+//!
+//! \note GCC 12 can miscompile a coroutine that co_awaits inside the condition or increment of a loop,
+//! or the condition of an `if` in a loop (the coroutine never starts): bind the awaited result to a
+//! variable in its own statement first, as above.
+
+#endif /* TUN_CORO */
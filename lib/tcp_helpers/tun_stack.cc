@@ -0,0 +1,361 @@
+#include "tun_stack.hh"
+
+#include "ipv4_datagram.hh"
+#include "isn_generator.hh"
+#include "metrics.hh"
+#include "parser.hh"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+//! \param[in] cfg is the TCPConfig for the TCPConnection
+//! \param[in] adapter_cfg holds the local (`source`) and remote (`destination`) addresses
+//! \param[in] stack is the TUNStack that sends the connection's datagrams
+TUNConnection::TUNConnection(const TCPConfig &cfg, const FdAdapterConfig &adapter_cfg, TUNStack &stack)
+    : _tcp(cfg), _stack(stack) {
+    _adapter.set_config(adapter_cfg);
+}
+
+void TUNConnection::_flush() {
+    while (not _tcp.segments_out().empty()) {
+        _stack._send(_adapter, _tcp.segments_out().front());
+        _tcp.segments_out().pop();
+    }
+}
+
+void TUNConnection::_segment_received(const CoalescedSegment &run) {
+    _tcp.segment_received(run);
+    _flush();
+}
+
+void TUNConnection::_tick(const size_t ms_since_last_tick) {
+    _tcp.tick(ms_since_last_tick);
+    _flush();
+}
+
+size_t TUNConnection::read(string &out, const size_t limit) {
+    ByteStream &inbound = _tcp.inbound_stream();
+    const size_t len = min(limit, inbound.buffer_size());
+    out.append(inbound.peek_output(len));
+    inbound.pop_output(len);
+    if (len > 0) {
+        _tcp.window_update();
+        _flush();
+    }
+    return len;
+}
+
+string TUNConnection::read(const size_t limit) {
+    string ret;
+    read(ret, limit);
+    return ret;
+}
+
+size_t TUNConnection::write(string_view data) {
+    const size_t len = min(data.size(), _tcp.remaining_outbound_capacity());
+    if (len == 0) {
+        return 0;
+    }
+    const size_t bytes_written = _tcp.write(string(data.substr(0, len)));
+    _flush();
+    return bytes_written;
+}
+
+void TUNConnection::shutdown_write() {
+    _tcp.end_input_stream();
+    _flush();
+}
+
+bool TUNConnection::readable() const {
+    const ByteStream &inbound = _tcp.inbound_stream();
+    return not inbound.buffer_empty() or inbound.input_ended() or inbound.error();
+}
+
+bool TUNConnection::writable() const {
+    return _tcp.active() and _tcp.remaining_outbound_capacity() > 0 and
+           _tcp.state() != TCPState::State::LISTEN and _tcp.state() != TCPState::State::SYN_SENT;
+}
+
+bool TUNConnection::eof() const { return _tcp.inbound_stream().eof() or _tcp.inbound_stream().error(); }
+
+//! \details The fd is made non-blocking: datagrams that don't fit in its queue wait in the TUNStack until
+//! the EventLoop says there is room, up to MAX_OUTBOUND of them. (Blocking instead would deadlock an
+//! application whose own thread is what drains the other end.)
+TUNStack::TUNStack(FileDescriptor &&datagram_fd) : _datagram_fd(move(datagram_fd)) {
+    _datagram_fd.set_blocking(false);
+}
+
+// (only the FileDescriptor part of `tun` is moved from: its name is still there to look up the MTU)
+TUNStack::TUNStack(TunFD &&tun) : TUNStack(static_cast<FileDescriptor &&>(tun)) {
+    if (tun.is_device()) {  // (not, e.g., a socketpair standing in for one)
+        _mtu = tun.mtu();
+    }
+}
+
+void TUNStack::_send(TCPOverIPv4Adapter &adapter, TCPSegment &seg) {
+    const optional<Buffer> in_place = adapter.wrap_tcp_in_ip_in_place(seg);
+    const string fallback = in_place ? string{} : adapter.wrap_tcp_in_ip(seg).serialize().concatenate();
+    const string_view dgram = in_place ? in_place->str() : string_view{fallback};
+    if (_capture) {
+        _capture->capture(dgram);
+    }
+
+    if (_outbound.empty() and _datagram_fd.write_datagram(dgram)) {
+        return;
+    }
+    if (_outbound.size() >= MAX_OUTBOUND) {
+        StackMetrics::outbound_drop();
+        return;
+    }
+    _outbound.emplace_back(dgram);
+}
+
+void TUNStack::_write_outbound() {
+    while (not _outbound.empty() and _datagram_fd.write_datagram(_outbound.front())) {
+        _outbound.pop_front();
+    }
+}
+
+//! \param[in] loop is the application's EventLoop
+void TUNStack::install_rules(EventLoop &loop) {
+    loop.add_rule(_datagram_fd, EventLoop::Direction::In, [this] { receive(); });
+    loop.add_rule(
+        _datagram_fd, EventLoop::Direction::Out, [this] { _write_outbound(); }, [this] { return not _outbound.empty(); });
+}
+
+//! \details Datagrams that aren't valid TCP-in-IPv4, or that belong to no connection and aren't a
+//! SYN to a listener, are dropped. So are SYNs to a listener while TCPMemory refuses connections.
+void TUNStack::receive() {
+    string raw;
+    for (size_t n = 0; n < RECEIVE_BATCH and _datagram_fd.read_datagram(raw); ++n) {
+        _parse(move(raw));
+    }
+    for (SegmentCoalescer::Run &run : _coalescer.runs()) {
+        _demultiplex(run.flow, run.segment);
+    }
+    _coalescer.clear();
+}
+
+void TUNStack::_parse(string &&raw) {
+    if (_capture) {
+        _capture->capture(raw);
+    }
+    InternetDatagram ip_dgram;
+    if (const ParseResult r = ip_dgram.parse(move(raw)); r != ParseResult::NoError) {
+        StackMetrics::ipv4_parse_failure(r);
+        return;
+    }
+    if (ip_dgram.header().proto != IPv4Header::PROTO_TCP) {
+        return;
+    }
+
+    TCPSegment seg;
+    if (const ParseResult r = seg.parse(ip_dgram.payload(), ip_dgram.header().pseudo_cksum());
+        r != ParseResult::NoError) {
+        StackMetrics::tcp_parse_failure(r);
+        return;
+    }
+
+    _coalescer.add({ip_dgram.header().dst, ip_dgram.header().src, seg.header().dport, seg.header().sport},
+                   move(seg));
+}
+
+//! \details Only a run's first segment matters to a listener or _time_wait: a run of more is data,
+//! which a listener drops and _time_wait answers with one ACK.
+void TUNStack::_demultiplex(const FlowKey &key, const CoalescedSegment &run) {
+    const TCPSegment &seg = run.first();
+    auto conn = _connections.find(key);
+    if (conn == _connections.end()) {
+        if (_time_wait.contains(key) and _time_wait_received(key, seg)) {
+            return;
+        }
+        const auto listener = _listeners.find(seg.header().dport);
+        if (listener == _listeners.end() or not seg.header().syn or seg.header().rst or
+            (listener->second.address != 0 and listener->second.address != key.local_address)) {
+            StackMetrics::demux_miss();
+            return;
+        }
+        if (TCPMemory::pressure() == MemoryPressure::RefuseConnections) {
+            TCPMemory::count_refused();
+            return;
+        }
+        if (_backlog(listener->first) >= listener->second.backlog) {
+            StackMetrics::listen_overflow();
+            return;
+        }
+
+        auto new_conn = _emplace(key, listener->second.cfg, key.config());
+        conn = _connections.find(key);
+        _accept_queue.push_back(move(new_conn));
+    }
+
+    conn->second->_segment_received(run);
+    if (not conn->second->active() or conn->second->_tcp.lingering()) {
+        _erase(conn);
+    }
+}
+
+bool TUNStack::_time_wait_received(const FlowKey &flow, const TCPSegment &seg) {
+    if (optional<TCPSegment> ack = _time_wait.segment_received(flow, seg)) {
+        if (_time_wait_adapter.flow() != flow) {
+            _time_wait_adapter.set_config(flow.config());
+        }
+        _send(_time_wait_adapter, *ack);
+    }
+    if (_time_wait.contains(flow)) {
+        return true;
+    }
+    _ports.release(flow);
+    return false;
+}
+
+std::shared_ptr<TUNConnection> TUNStack::_emplace(const FlowKey &flow,
+                                                  const TCPConfig &cfg,
+                                                  const FdAdapterConfig &adapter_cfg) {
+    TCPConfig conn_cfg = cfg;
+    if (_mtu) {  // nothing larger than the interface's MTU can leave it, so it caps the MSS (and any search)
+        const size_t mss = TCPConfig::mss_for_mtu(*_mtu);
+        conn_cfg.mss = conn_cfg.mss ? min(conn_cfg.mss, mss) : mss;
+    }
+    if (not conn_cfg.fixed_isn) {
+        conn_cfg.fixed_isn = ISNGenerator::global().isn(flow);
+    }
+    auto conn = make_shared<TUNConnection>(conn_cfg, adapter_cfg, *this);
+    _connections.emplace(flow, conn);
+    _ports.reserve(flow);  // (already taken if the stack allocated it)
+    return conn;
+}
+
+TUNStack::Connections::iterator TUNStack::_erase(Connections::iterator it) {
+    const TCPConnection &tcp = it->second->_tcp;
+    if (tcp.lingering()) {
+        _time_wait.add(it->first, tcp);
+        it->second->_time_wait = true;
+    } else {
+        _ports.release(it->first);
+    }
+    return _connections.erase(it);
+}
+
+size_t TUNStack::_backlog(const uint16_t port) {
+    size_t n = 0;
+    for (auto it = _accept_queue.begin(); it != _accept_queue.end();) {
+        if (not(*it)->active()) {
+            it = _accept_queue.erase(it);
+            continue;
+        }
+        n += (*it)->_adapter.flow().local_port == port;
+        ++it;
+    }
+    return n;
+}
+
+void TUNStack::_refuse_under_pressure() {
+    if (TCPMemory::pressure() == MemoryPressure::RefuseConnections) {
+        TCPMemory::count_refused();
+        throw runtime_error("TUNStack::connect(): refused under memory pressure");
+    }
+}
+
+//! \param[in] cfg is the TCPConfig for the TCPConnection
+//! \param[in] adapter_cfg holds the local (`source`) and remote (`destination`) addresses
+std::shared_ptr<TUNConnection> TUNStack::connect(const TCPConfig &cfg, const FdAdapterConfig &adapter_cfg) {
+    _refuse_under_pressure();
+    const FlowKey key = FlowKey::from(adapter_cfg);
+    if (_connections.count(key)) {
+        throw runtime_error("TUNStack::connect(): a connection with these addresses already exists");
+    }
+    _time_wait.erase(key);  // a new incarnation (its ISN, from the clock, is beyond the old one's)
+
+    auto conn = _emplace(key, cfg, adapter_cfg);
+    conn->_tcp.connect();
+    conn->_flush();
+    return conn;
+}
+
+//! \param[in] cfg is the TCPConfig for the TCPConnection
+//! \param[in] local_ip is the local address; the port is allocated by the stack
+//! \param[in] remote is the address and port to connect to
+std::shared_ptr<TUNConnection> TUNStack::connect(const TCPConfig &cfg, const string &local_ip, const Address &remote) {
+    _refuse_under_pressure();
+    FlowKey key{Address{local_ip}.ipv4_numeric(), remote.ipv4_numeric(), 0, remote.port()};
+    const optional<uint16_t> port = _ports.allocate(key);
+    if (not port) {
+        throw runtime_error("TUNStack::connect(): no free ephemeral port to " + remote.to_string());
+    }
+    key.local_port = *port;
+
+    FdAdapterConfig adapter_cfg;
+    adapter_cfg.source = {local_ip, *port};
+    adapter_cfg.destination = remote;
+    auto conn = _emplace(key, cfg, adapter_cfg);
+    conn->_tcp.connect();
+    conn->_flush();
+    return conn;
+}
+
+//! \param[in] cfg is the TCPConfig for accepted connections
+//! \param[in] local is the address and port to accept connections on
+//! \param[in] backlog is the most connections to `local` that may be in their handshake or waiting for accept()
+void TUNStack::listen(const TCPConfig &cfg, const Address &local, const size_t backlog) {
+    if (not _listeners.emplace(local.port(), Listener{cfg, local.ipv4_numeric(), backlog}).second) {
+        throw runtime_error("TUNStack::listen(): already listening on port " + to_string(local.port()));
+    }
+}
+
+std::shared_ptr<TUNConnection> TUNStack::accept() {
+    for (auto it = _accept_queue.begin(); it != _accept_queue.end();) {
+        const auto state = (*it)->state();
+        if (not(*it)->active()) {  // reset or timed out during the handshake
+            it = _accept_queue.erase(it);
+        } else if (state == TCPState::State::LISTEN or state == TCPState::State::SYN_RCVD) {
+            ++it;
+        } else {
+            auto conn = move(*it);
+            _accept_queue.erase(it);
+            return conn;
+        }
+    }
+    return nullptr;
+}
+
+//! \param[in] ms_since_last_tick number of milliseconds since the last call to this method
+void TUNStack::tick(const size_t ms_since_last_tick) {
+    for (auto it = _connections.begin(); it != _connections.end();) {
+        it->second->_tick(ms_since_last_tick);
+        if (it->second->active() and not it->second->_tcp.lingering()) {
+            ++it;
+        } else {
+            it = _erase(it);
+        }
+    }
+    _time_wait.tick(ms_since_last_tick, [this](const FlowKey &flow) { _ports.release(flow); });
+}
+
+//! \param[out] out is the stream the metrics are appended to
+void TUNStack::write_prometheus(ostream &out) const {
+    StackMetrics::write_prometheus(out);
+    out << "# TYPE starfish_tcp_connections gauge\n";
+    out << "starfish_tcp_connections " << _connections.size() << "\n";
+    out << "# TYPE starfish_tcp_time_wait gauge\n";
+    out << "starfish_tcp_time_wait " << _time_wait.size() << "\n";
+    // TCPMemory is process-wide: these cover every stack (and TUNSocket) in the process
+    out << "# TYPE starfish_tcp_memory_bytes gauge\n";
+    out << "starfish_tcp_memory_bytes " << TCPMemory::buffered() << "\n";
+    out << "# TYPE starfish_tcp_memory_pressure gauge\n";
+    out << "starfish_tcp_memory_pressure " << static_cast<unsigned int>(TCPMemory::pressure()) << "\n";
+    out << "# TYPE starfish_tcp_memory_refused_connections_total counter\n";
+    out << "starfish_tcp_memory_refused_connections_total " << TCPMemory::refused() << "\n";
+    out << "# TYPE starfish_tcp_memory_dropped_bytes_total counter\n";
+    out << "starfish_tcp_memory_dropped_bytes_total " << TCPMemory::dropped() << "\n";
+    TCPConnectionMetrics::write_prometheus_types(out);
+    for (const auto &[key, conn] : _connections) {
+        const FdAdapterConfig &cfg = conn->config();
+        conn->metrics().write_prometheus(
+            out, "local=\"" + cfg.source.to_string() + "\",remote=\"" + cfg.destination.to_string() + "\"");
+    }
+}
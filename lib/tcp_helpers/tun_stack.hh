@@ -0,0 +1,224 @@
+#ifndef TUN_STACK
+#define TUN_STACK
+
+#include "ephemeral_ports.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "flow_key.hh"
+#include "pcap.hh"
+#include "segment_coalescer.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_memory.hh"
+#include "time_wait.hh"
+#include "tun_adapter.hh"
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class TUNStack;
+
+//! \brief One TCP connection of a TUNStack
+//! \details All methods are non-blocking and run the TCP state machine to completion in the calling
+//! thread: bytes written are segmented and the resulting datagrams sent (or queued on the TUNStack)
+//! before write() returns.
+class TUNConnection {
+  private:
+    friend class TUNStack;
+
+    TCPConnection _tcp;
+    TCPOverIPv4Adapter _adapter{};
+    TUNStack &_stack;
+    bool _time_wait{false};  //!< has the stack replaced the connection by a TimeWaitTable entry?
+
+    //! Send every segment the TCPConnection has queued
+    void _flush();
+
+    //! Hand a run of inbound segments (already demultiplexed by the stack) to the TCPConnection
+    void _segment_received(const CoalescedSegment &run);
+
+    //! Advance the TCPConnection's clock
+    void _tick(const size_t ms_since_last_tick);
+
+  public:
+    //! Construct a connection that sends its datagrams through `stack`
+    TUNConnection(const TCPConfig &cfg, const FdAdapterConfig &adapter_cfg, TUNStack &stack);
+
+    //! \name Reliable byte stream to and from the peer
+    //!@{
+
+    //! Move up to `limit` already-received bytes into `out`, without blocking
+    //! \returns the number of bytes read
+    size_t read(std::string &out, const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Read up to `limit` already-received bytes, without blocking
+    std::string read(const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Write as much of `data` as the outbound stream has room for, without blocking
+    //! \returns the number of bytes accepted
+    size_t write(std::string_view data);
+
+    //! End the outbound stream (sends a FIN once the outbound bytes have been sent)
+    void shutdown_write();
+    //!@}
+
+    //! \name Readiness
+    //!@{
+    bool readable() const;  //!< is there data (or the end of the stream) to read?
+    bool writable() const;  //!< would write() accept at least one byte?
+    bool eof() const;       //!< has the whole inbound stream been read?
+    bool active() const { return not _time_wait and _tcp.active(); }  //!< is the stack still running it?
+    //!@}
+
+    //! \brief The connection's state, by its official TCP name
+    TCPState state() const { return _tcp.state(); }
+
+    //! \brief Counters of what the connection has sent and received
+    TCPConnectionMetrics metrics() const { return _tcp.metrics(); }
+
+    //! \brief Local (`source`) and remote (`destination`) addresses
+    const FdAdapterConfig &config() const { return _adapter.config(); }
+};
+
+//! \brief TCP connections multiplexed over one datagram FileDescriptor, driven by the caller's thread
+//! \details Unlike TUNSocket, there is no thread per connection. The application owns the EventLoop:
+//! install_rules() adds a rule that reads and demultiplexes inbound datagrams, and the application calls
+//! tick() as time passes. Connections are served inline, run to completion.
+class TUNStack {
+  public:
+    //! Most datagrams receive() reads (and coalesces) at a time
+    static constexpr size_t RECEIVE_BATCH = 64;
+
+    //! Most datagrams waiting for room in the fd; more are dropped (and counted), for TCP to retransmit
+    static constexpr size_t MAX_OUTBOUND = 1024;
+
+    //! Default backlog of a listener: most connections still in their handshake or not yet accept()ed
+    static constexpr size_t DEFAULT_BACKLOG = 128;
+
+  private:
+    //! A passive open: connections to `port` (on `address`, unless it's 0) are accepted with `cfg`, up to
+    //! `backlog` at a time
+    struct Listener {
+        TCPConfig cfg;
+        uint32_t address;
+        size_t backlog;
+    };
+
+    FileDescriptor _datagram_fd;
+    std::deque<std::string> _outbound{};  //!< datagrams waiting for room in the fd's queue
+    std::unordered_map<FlowKey, std::shared_ptr<TUNConnection>, FlowKeyHash> _connections{};
+    std::map<uint16_t, Listener> _listeners{};
+    std::deque<std::shared_ptr<TUNConnection>> _accept_queue{};
+    std::shared_ptr<PcapCapture> _capture{};  //!< where datagrams read and written are captured, if anywhere
+    std::optional<size_t> _mtu{};             //!< of the TUN device, if the stack runs one
+    EphemeralPorts _ports{};                  //!< local ports of the connections, per destination
+    TimeWaitTable _time_wait{};               //!< connections that have closed, but still linger
+    TCPOverIPv4Adapter _time_wait_adapter{};  //!< wraps the ACKs of _time_wait
+    SegmentCoalescer _coalescer{};            //!< the segments of the batch receive() is reading
+
+    using Connections = decltype(_connections);
+
+    friend class TUNConnection;
+
+    //! Send `seg`'s datagram now if the fd has room, or queue it behind the ones already waiting (or drop
+    //! it if MAX_OUTBOUND are)
+    void _send(TCPOverIPv4Adapter &adapter, TCPSegment &seg);
+
+    //! Write queued datagrams until the queue is empty or the fd is full
+    void _write_outbound();
+
+    //! Add a connection of `flow`, whose ISN comes from ISNGenerator unless `cfg` fixes it (and whose MSS
+    //! comes from the TUN device's MTU unless `cfg` sets a smaller one)
+    std::shared_ptr<TUNConnection> _emplace(const FlowKey &flow,
+                                            const TCPConfig &cfg,
+                                            const FdAdapterConfig &adapter_cfg);
+
+    //! \brief Forget a connection that is no longer active() or only lingers
+    //! \details A lingering connection moves to _time_wait, which keeps its local port until it expires.
+    Connections::iterator _erase(Connections::iterator it);
+
+    //! Parse one datagram read from the fd, and add its segment to _coalescer
+    void _parse(std::string &&raw);
+
+    //! Hand a run of segments of `flow` to its connection, or to a listener or _time_wait
+    void _demultiplex(const FlowKey &flow, const CoalescedSegment &run);
+
+    //! Hand a segment of a flow in TIME_WAIT to _time_wait, and send its ACK
+    //! \returns false if the segment reopened the flow
+    bool _time_wait_received(const FlowKey &flow, const TCPSegment &seg);
+
+    //! Number of _accept_queue's connections to `port` (forgetting those no longer active())
+    size_t _backlog(const uint16_t port);
+
+    //! \throws std::runtime_error (counting the refusal) if TCPMemory refuses new connections
+    void _refuse_under_pressure();
+
+  public:
+    //! Construct from a datagram fd carrying IPv4, e.g. a TunFD or a SOCK_SEQPACKET socket
+    explicit TUNStack(FileDescriptor &&datagram_fd);
+
+    //! \brief Construct from a TUN device, whose MTU sets the MSS of connections that leave TCPConfig::mss at 0,
+    //! and caps it for the others
+    explicit TUNStack(TunFD &&tun);
+
+    //! Add rules to `loop` that receive() inbound datagrams, and write queued outbound datagrams
+    void install_rules(EventLoop &loop);
+
+    //! Capture every datagram read or written by the stack (nullptr stops capturing)
+    void set_capture(std::shared_ptr<PcapCapture> capture) { _capture = std::move(capture); }
+
+    //! \brief Read the datagrams waiting (up to RECEIVE_BATCH), and hand their segments to their connections
+    //! (what the rule installed by install_rules() does)
+    //! \details Consecutive in-order segments of a flow are merged first (see SegmentCoalescer), so the
+    //! connection handles them, and ACKs them, as one.
+    void receive();
+
+    //! \brief Start opening a connection (returns immediately; see TUNConnection::state())
+    //! \throws std::runtime_error if a connection of these addresses exists, or under memory pressure
+    std::shared_ptr<TUNConnection> connect(const TCPConfig &cfg, const FdAdapterConfig &adapter_cfg);
+
+    //! \brief Start opening a connection from an ephemeral port of `local_ip`
+    //! \throws std::runtime_error if every ephemeral port to `remote` is in use, or under memory pressure
+    std::shared_ptr<TUNConnection> connect(const TCPConfig &cfg, const std::string &local_ip, const Address &remote);
+
+    //! \brief Accept connections to `local` (its address may be "0" to accept on any address)
+    //! \details Once `backlog` connections to `local` are in their handshake or waiting for accept(), further
+    //! SYNs are dropped (and counted), for the peers to retransmit.
+    void listen(const TCPConfig &cfg, const Address &local, const size_t backlog = DEFAULT_BACKLOG);
+
+    //! \brief A connection that completed its handshake with a listener, or nullptr if there is none
+    std::shared_ptr<TUNConnection> accept();
+
+    //! \brief Advance every connection's clock, and forget those that have finished
+    void tick(const size_t ms_since_last_tick);
+
+    //! \brief Number of connections alive
+    size_t size() const { return _connections.size(); }
+
+    //! \brief Number of closed connections lingering in TIME_WAIT
+    size_t time_wait_size() const { return _time_wait.size(); }
+
+    //! \brief Number of datagrams waiting for room in the fd
+    size_t outbound_size() const { return _outbound.size(); }
+
+    //! \brief Append the stack-wide counters, and those of every live connection (labeled by its
+    //! addresses), to `out` in the Prometheus text format
+    void write_prometheus(std::ostream &out) const;
+};
+
+//! \class TUNStack
+//! A connection stays in the stack until it is no longer active(); the application's
+//! std::shared_ptr to it stays valid after that (e.g. to read the rest of the inbound stream).
+//! Once both streams have finished, the stack keeps only a TimeWaitTable entry for the connection's
+//! TIME_WAIT (to ACK a retransmitted FIN), and the TUNConnection is no longer active().
+//! A TUNConnection must not be used after its TUNStack has been destroyed.
+
+#endif /* TUN_STACK */
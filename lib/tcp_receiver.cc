@@ -1,17 +1,13 @@
 #include "tcp_receiver.hh"
 
-#include "util.hh"
-
 // Dummy implementation of a TCP receiver
 
 
 using namespace std;
 
-void TCPReceiver::segment_received(const TCPSegment &seg) {
+void TCPReceiver::segment_received(const TCPSegment &seg, const bool in_order_only) {
     if (!_ackno.has_value()) {
         if (seg.header().syn) {  // handshake
-            auto rd = get_random_generator();
-            _isn = WrappingInt32(rd());
             sender_isn = seg.header().seqno;
             _reassembler.push_substring((seg.payload().copy()), 0, seg.header().fin);
             _ackno = WrappingInt32(sender_isn) + (seg.length_in_sequence_space() - seg.payload().size()) +
@@ -30,6 +26,9 @@ void TCPReceiver::segment_received(const TCPSegment &seg) {
             // cerr<< "-DEBUG: receive abnormal data, discard"<<endl;
             return;
         }
+        if (in_order_only && index > _checkpoint) {
+            return;
+        }
         // _reassembler.push_substring(seg.payload().copy(), index, seg.header().fin); // ! copy here
         _reassembler.push_substring(Buffer(move(seg.payload().copy())), index, seg.header().fin); // ! copy here
         // _reassembler.push_substring(seg.payload(),index, seg.header().fin);
@@ -43,6 +42,50 @@ void TCPReceiver::segment_received(const TCPSegment &seg) {
     }
 }
 
+//! \details A run that starts at the ackno and fits the window (as runs of a well-behaved peer do) is
+//! appended to the stream without copying, one payload at a time, unless a FIN arrived ahead of it.
+//! Otherwise each of its segments is handled in turn.
+void TCPReceiver::segment_received(const CoalescedSegment &run, const bool in_order_only) {
+    if (!_ackno.has_value() || stream_out().input_ended()) {
+        return;
+    }
+    if (run.header().seqno == _ackno.value() && _reassembler.empty() && !_reassembler.eof_known() &&
+        run.payload_size() <= window_size()) {
+        _reassembler.push_in_order(run.first().payload());
+        for (const Buffer &payload : run.rest()) {
+            _reassembler.push_in_order(payload);
+        }
+        _ackno = _ackno.value() + run.payload_size();
+        _checkpoint += run.payload_size();
+        return;
+    }
+    segment_received(run.first(), in_order_only);
+    TCPSegment seg;
+    seg.header() = run.header();
+    seg.header().seqno = seg.header().seqno + run.first().payload().size();
+    for (const Buffer &payload : run.rest()) {
+        seg.payload() = payload;
+        segment_received(seg, in_order_only);
+        seg.header().seqno = seg.header().seqno + payload.size();
+    }
+}
+
+//! \details Header prediction: the segment starts at the ackno, carries no SYN or FIN, nothing
+//! (not even a FIN that arrived early) is waiting in the reassembler and the payload fits the window. Then no unwrapping, trimming or
+//! merging is needed, and the payload is appended to the stream without being copied.
+bool TCPReceiver::segment_received_in_order(const TCPSegment &seg) {
+    const TCPHeader &hdr = seg.header();
+    const size_t len = seg.payload().size();
+    if (!_ackno.has_value() || hdr.syn || hdr.fin || hdr.seqno != _ackno.value() || stream_out().input_ended() ||
+        !_reassembler.empty() || _reassembler.eof_known() || len > window_size()) {
+        return false;
+    }
+    _reassembler.push_in_order(seg.payload());
+    _ackno = _ackno.value() + len;
+    _checkpoint += len;
+    return true;
+}
+
 optional<WrappingInt32> TCPReceiver::ackno() const { return _ackno; }
 
 size_t TCPReceiver::window_size() const { return stream_out().remaining_capacity(); }
@@ -20,7 +20,6 @@ class TCPReceiver {
     //! The maximum number of bytes we'll store.
     size_t _capacity;
     std::optional<WrappingInt32> _ackno;
-    WrappingInt32 _isn;
     WrappingInt32 sender_isn;
     // the index of the last reassembled byte
     uint64_t _checkpoint;
@@ -31,7 +30,7 @@ class TCPReceiver {
     //! \param capacity the maximum number of bytes that the receiver will
     //!                 store in its buffers at any give time.
     TCPReceiver(const size_t capacity)
-        : _reassembler(capacity), _capacity(capacity), _ackno(), _isn(0), sender_isn(0), _checkpoint(0) {}
+        : _reassembler(capacity), _capacity(capacity), _ackno(), sender_isn(0), _checkpoint(0) {}
 
     //! \name Accessors to provide feedback to the remote TCPSender
     //!@{
@@ -57,11 +56,27 @@ class TCPReceiver {
     size_t window_size() const;
     //!@}
 
+    //! \brief the maximum number of bytes the receiver will store
+    size_t capacity() const { return _capacity; }
+
     //! \brief number of bytes stored but not yet reassembled
     size_t unassembled_bytes() const { return _reassembler.unassembled_bytes(); }
 
     //! \brief handle an inbound segment
-    void segment_received(const TCPSegment &seg);
+    //! \param[in] in_order_only ignores a segment that starts beyond the ackno, rather than storing it
+    void segment_received(const TCPSegment &seg, const bool in_order_only = false);
+
+    //! \brief handle a run of inbound segments merged by SegmentCoalescer
+    //! \param[in] in_order_only ignores the segments that start beyond the ackno, rather than storing them
+    void segment_received(const CoalescedSegment &run, const bool in_order_only = false);
+
+    //! \brief drop the bytes stored but not yet reassembled
+    //! \returns the number of bytes dropped
+    size_t drop_unassembled() { return _reassembler.drop_unassembled(); }
+
+    //! \brief handle an inbound segment if it is the next in-order data and fits the window
+    //! \returns `false`, without side effects, if the segment needs segment_received()
+    bool segment_received_in_order(const TCPSegment &seg);
 
     //! \name "Output" interface for the reader
     //!@{
@@ -1,9 +1,8 @@
 #include "tcp_sender.hh"
 
+#include "isn_generator.hh"
 #include "tcp_config.hh"
 
-#include <random>
-
 // Dummy implementation of a TCP sender
 
 
@@ -14,38 +13,50 @@ using namespace std;
 
 //! \param[in] capacity the capacity of the outgoing byte stream
 //! \param[in] retx_timeout the initial amount of time to wait before retransmitting the oldest outstanding segment
-//! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses a random ISN)
+//! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses an unpredictable ISN)
 TCPSender::TCPSender(const size_t capacity, const uint16_t retx_timeout, const std::optional<WrappingInt32> fixed_isn)
-    : _isn(fixed_isn.value_or(WrappingInt32{random_device()()}))
+    : _isn(fixed_isn ? *fixed_isn : ISNGenerator::global().unpredictable())
     , _initial_retransmission_timeout{retx_timeout}
     , _stream(capacity)
     , _retransmission_timeout{retx_timeout}
     , _timer()
     , _window_size(1)
-    , _bytes_in_flight(0)
-    , _segments_in_flight() {}
+    , _bytes_in_flight(0) {}
 
 uint64_t TCPSender::bytes_in_flight() const { return _bytes_in_flight; }
 
+void TCPSender::set_mss(const size_t mss, const bool plpmtud) {
+    _path_mtu = PathMTUDiscovery{plpmtud, TCPConfig::MAX_PAYLOAD_SIZE, mss};
+}
+
+void TCPSender::trim() {
+    _stream.trim();
+    _segments_out.trim();
+    _retransmissions.trim();
+}
+
 void TCPSender::fill_window() {
-    // to get a ack when window is reopen
-    size_t window_size = _window_size == 0 ? 1 : _window_size;
+    fill(_window_size);
+    update_persist();
+}
+
+//! \details A zero window sends nothing but the SYN: the persist timer probes it instead.
+void TCPSender::fill(const size_t window_size) {
     // first message : SYN
     if (_state == CLOSED) {
         TCPSegment seg;
         seg.header().syn = true;
         seg.header().seqno = wrap(_next_seqno, _isn);
+        _retransmissions.push(_next_seqno, seg);
+        start_rtt_sample(_next_seqno + seg.length_in_sequence_space());
         _next_seqno += seg.length_in_sequence_space();
         _bytes_in_flight += seg.length_in_sequence_space();
-        _segments_in_flight.push(seg);
         _segments_out.emplace(move(seg));
         // begin timer
         if (!_timer.activated()) {
             _timer.reset(_retransmission_timeout);
-            // cerr<< "_retransmission_timeout "<< _retransmission_timeout<<endl;
         }
         _state = SYN_SENT;
-        // cerr<<"DEBUG: send SYN "<<endl;
     } else if (_state == SYN_ACKED) {
         // stream ongoing
         size_t send_bytes_count = 0;
@@ -53,25 +64,32 @@ void TCPSender::fill_window() {
             return;
         size_t max_tobe_send = window_size - _bytes_in_flight;
         while (send_bytes_count < max_tobe_send && !_stream.buffer_empty()) {
-            // make up a seg
+            // make up a seg: a path MTU probe if one is due and there is enough to fill it
+            size_t payload_size = min(_path_mtu.mss(), max_tobe_send - send_bytes_count);
+            const optional<size_t> probe = _path_mtu.probe_size(_time);
+            const bool probing = probe.has_value() && probe.value() <= max_tobe_send - send_bytes_count &&
+                                 probe.value() <= _stream.buffer_size();
+            if (probing) {
+                payload_size = probe.value();
+                _path_mtu.probe_sent(_next_seqno, payload_size);
+            }
             TCPSegment seg;
-            seg.payload() =
-                Buffer(move(_stream.read(min(TCPConfig::MAX_PAYLOAD_SIZE, max_tobe_send - send_bytes_count))));
+            seg.payload() = Buffer(_stream.read(payload_size, TCPConfig::HEADROOM), TCPConfig::HEADROOM);
             send_bytes_count += seg.payload().size();
             if (_stream.eof() && send_bytes_count < max_tobe_send) {
                 seg.header().fin = 1;
                 _state = FIN_SENT;
-                // cerr<<"DEBUG: send FIN "<<endl;
             }
             seg.header().seqno = wrap(_next_seqno, _isn);
 
+            // backup
+            _retransmissions.push(_next_seqno, seg);
+            start_rtt_sample(_next_seqno + seg.length_in_sequence_space());
+
             // update
             _next_seqno += seg.length_in_sequence_space();
             _bytes_in_flight += seg.length_in_sequence_space();
 
-            // backup
-            _segments_in_flight.push(seg);
-
             // write to stream
             _segments_out.emplace(move(seg));
             if (!_timer.activated()) {
@@ -79,19 +97,18 @@ void TCPSender::fill_window() {
             }
         }
         // send FIN when it's not carried in a TCP package
-        if (window_size - _bytes_in_flight >= 1 && _stream.eof() && _state == SYN_ACKED) {
+        if (window_size > _bytes_in_flight && _stream.eof() && _state == SYN_ACKED) {
             TCPSegment fin_seg;
             fin_seg.header().fin = 1;
             fin_seg.header().seqno = wrap(_next_seqno, _isn);
+            _retransmissions.push(_next_seqno, fin_seg);
             _bytes_in_flight += fin_seg.length_in_sequence_space();
             _next_seqno += fin_seg.length_in_sequence_space();
-            _segments_in_flight.push(fin_seg);
             _segments_out.emplace(move(fin_seg));
             if (!_timer.activated()) {
                 _timer.reset(_retransmission_timeout);
             }
             _state = FIN_SENT;
-            // cerr<<"DEBUG: send FIN "<<endl;
         }
     }
 }
@@ -100,67 +117,210 @@ void TCPSender::fill_window() {
 //! \param window_size The remote receiver's advertised window size
 void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_size) {
     if (unwrap(ackno, _isn, _next_seqno) > _next_seqno) {
-        // cerr<< "-DEBUG: receive abnormal ackno, discard"<<endl;
         return;
     }
     _window_size = window_size;
     if (_state == SYN_SENT && ackno == wrap(1, _isn)) {
         _state = SYN_ACKED;
-        // cerr<< "DEBUG: SYN_SENT -> SYN_ACKED"<<endl;
     }
-    if (_segments_in_flight.empty())
-        return;
-    TCPSegment seg = _segments_in_flight.front();
-    bool successful_receipt_of_new_data = false;
-    while (unwrap(seg.header().seqno, _isn, _next_seqno) + seg.length_in_sequence_space() <=
-           unwrap(ackno, _isn, _next_seqno)) {
-        _bytes_in_flight -= seg.length_in_sequence_space();
-        _segments_in_flight.pop();
-        successful_receipt_of_new_data = true;
-        if (_segments_in_flight.empty())
-            break;
-        seg = _segments_in_flight.front();
-    }
-    if (successful_receipt_of_new_data) {  // reset
+    const uint64_t abs_ackno = unwrap(ackno, _isn, _next_seqno);
+    if (_rtt_seqno.has_value() && abs_ackno >= _rtt_seqno.value()) {
+        const size_t sample = _time - _rtt_start;
+        _srtt = _srtt.has_value() ? (7 * _srtt.value() + sample) / 8 : sample;  // RFC 6298, alpha = 1/8
+        _rtt_samples.record(sample);
+        _rtt_seqno.reset();
+    }
+    _unanswered_probes = 0;
+    _path_mtu.acked(abs_ackno);
+    if (abs_ackno == _next_seqno - _bytes_in_flight && _path_mtu.is_probe(abs_ackno) && _path_mtu.duplicate_ack()) {
+        probe_lost();
+    }
+    const size_t acked = _retransmissions.ack(abs_ackno);
+    if (acked) {  // reset: successful receipt of new data
+        _bytes_in_flight -= acked;
         _retransmission_timeout = _initial_retransmission_timeout;
-        if (!_segments_in_flight.empty()) {
+        if (!_retransmissions.empty()) {
             _timer.reset(_retransmission_timeout);
         } else {
             _timer.stop();
         }
         _consecutive_retransmission_count = 0;
     }
+    update_persist();
+}
+
+//! \details Like RFC 9293 (3.8.6.1), the first probe waits one RTO and each later one twice as long as
+//! the last, up to TCPConfig::PERSIST_TIMEOUT_MAX. The backoff restarts once the window opens.
+void TCPSender::update_persist() {
+    const bool blocked = _window_size == 0 && _state >= SYN_ACKED &&
+                         (_bytes_in_flight > 0 || !_stream.buffer_empty() || (_stream.eof() && _state == SYN_ACKED));
+    if (blocked) {
+        _timer.stop();
+        if (!_persist.activated()) {
+            _persist_timeout = _retransmission_timeout;
+            _persist.reset(_persist_timeout);
+        }
+    } else if (_persist.activated()) {
+        _persist.stop();
+        if (!_retransmissions.empty()) {
+            _timer.reset(_retransmission_timeout);
+        }
+    }
+}
+
+void TCPSender::send_probe() {
+    if (_bytes_in_flight > 0) {
+        _segments_out.push(_retransmissions.retransmission(_isn, 1));
+    } else {
+        fill(1);
+    }
+    _rtt_seqno.reset();  // the probe is only acknowledged once the window opens
+    _timer.stop();
+    _zero_window_probes++;
+    _unanswered_probes++;
 }
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPSender::tick(const size_t ms_since_last_tick) {
+    _time += ms_since_last_tick;
+    if (_persist.activated() && _persist.passing(ms_since_last_tick)) {
+        send_probe();
+        _persist_timeout = min(2 * _persist_timeout, static_cast<unsigned int>(TCPConfig::PERSIST_TIMEOUT_MAX));
+        _persist.reset(_persist_timeout);
+    }
     if (_timer.on_off && _timer.passing(ms_since_last_tick)) {
         // Retransmit the earliest (lowest sequence number) segment
-        TCPSegment seg = _segments_in_flight.front();
-        if (_window_size != 0) {
-            _consecutive_retransmission_count++;
-            _retransmission_timeout *= 2;
+        _rtt_seqno.reset();
+        if (_path_mtu.is_probe(_next_seqno - _bytes_in_flight)) {
+            probe_lost();
+            return;
         }
+        _consecutive_retransmission_count++;
+        _retransmission_timeout *= 2;
         if (_consecutive_retransmission_count <= TCPConfig::MAX_RETX_ATTEMPTS) {
-            _segments_out.push(seg);
+            _segments_out.push(_retransmissions.retransmission(_isn, _path_mtu.mss()));
+            _retransmitted_segments++;
             _timer.reset(_retransmission_timeout);
 
-        } else {
-            cerr << "DEBUG: too many retx : send rst " << endl;
+        } else {  // too many retransmissions: the TCPConnection sends a RST
             _timer.on_off = false;
-            // cerr << "DEBUG: seg info "<< seg.header().summary()<<endl;
-            // cerr << "DEBUG: window size "<< _window_size << " bytes in flight "<< _bytes_in_flight <<endl;
         }
         // Reset the retransmission timer and start it
     }
 }
 
+//! \details The probe was most likely too big for the path, which isn't a reason to back off.
+void TCPSender::probe_lost() {
+    _path_mtu.lost(_time);
+    _lost_mtu_probes++;
+    for (TCPSegment &seg : _retransmissions.split_front(_isn, _path_mtu.mss())) {
+        _segments_out.push(move(seg));
+    }
+    _rtt_seqno.reset();
+    _timer.reset(_retransmission_timeout);
+}
+
+void TCPSender::start_rtt_sample(const uint64_t end) {
+    if (!_rtt_seqno.has_value()) {
+        _rtt_seqno = end;
+        _rtt_start = _time;
+    }
+}
+
+void RetransmissionQueue::push(const uint64_t seqno, const TCPSegment &seg) {
+    _ranges.push_back({seqno, seg.header().syn, seg.header().fin, seg.payload()});
+}
+
+//! \details An ackno inside the earliest range (e.g. acknowledging a 1-byte zero-window probe cut from it)
+//! trims its acknowledged front, so no retransmission or probe resends those bytes.
+size_t RetransmissionQueue::ack(const uint64_t ackno) {
+    size_t acked = 0;
+    while (!_ranges.empty() && _ranges.front().end() <= ackno) {
+        acked += _ranges.front().end() - _ranges.front().seqno;
+        _ranges.pop_front();
+    }
+    if (!_ranges.empty() && _ranges.front().seqno < ackno) {
+        Range &front = _ranges.front();
+        const size_t n = ackno - front.seqno;
+        front.payload.remove_prefix(n - front.syn);  // (n < front.end() - front.seqno, so the FIN stays)
+        front.syn = false;
+        front.seqno = ackno;
+        acked += n;
+    }
+    return acked;
+}
+
+//! \details The common case, one range that fits, reuses the original payload (and its headroom).
+//! Only re-slicing after the maximum payload size shrank, or coalescing small segments, copies bytes.
+TCPSegment RetransmissionQueue::retransmission(const WrappingInt32 isn, const size_t max_payload) const {
+    const Range &first = _ranges.front();
+    TCPSegment seg;
+    seg.header().seqno = wrap(first.seqno, isn);
+    seg.header().syn = first.syn;
+
+    // how many ranges fit in one segment
+    auto last = _ranges.begin();
+    size_t payload_size = first.payload.size();
+    if (!first.syn) {
+        while (!last->fin && next(last) != _ranges.end() &&
+               payload_size + next(last)->payload.size() <= max_payload) {
+            ++last;
+            payload_size += last->payload.size();
+        }
+    }
+
+    if (last == _ranges.begin() && payload_size <= max_payload) {
+        seg.header().fin = first.fin;
+        seg.payload() = first.payload;
+        return seg;
+    }
+
+    seg.header().fin = last->fin && payload_size <= max_payload;
+    payload_size = min(payload_size, max_payload);
+    string payload(TCPConfig::HEADROOM, 0);
+    payload.reserve(TCPConfig::HEADROOM + payload_size);
+    for (auto range = _ranges.begin(); payload.size() < TCPConfig::HEADROOM + payload_size; ++range) {
+        payload.append(range->payload.str().substr(0, TCPConfig::HEADROOM + payload_size - payload.size()));
+    }
+    seg.payload() = Buffer(move(payload), TCPConfig::HEADROOM);
+    return seg;
+}
+
+//! \details Used when a path MTU probe was lost, so that each piece doesn't wait for its own timeout.
+//! The pieces are copies; the probe's SYN flag can't be set, as probes carry data.
+vector<TCPSegment> RetransmissionQueue::split_front(const WrappingInt32 isn, const size_t max_payload) {
+    const Range first = _ranges.front();
+    _ranges.pop_front();
+    vector<Range> pieces;
+    for (size_t offset = 0; offset < first.payload.size(); offset += max_payload) {
+        const size_t len = min(max_payload, first.payload.size() - offset);
+        string payload(TCPConfig::HEADROOM, 0);
+        payload.append(first.payload.str().substr(offset, len));
+        pieces.push_back({first.seqno + offset,
+                          false,
+                          first.fin && offset + len == first.payload.size(),
+                          Buffer(move(payload), TCPConfig::HEADROOM)});
+    }
+    for (auto piece = pieces.rbegin(); piece != pieces.rend(); ++piece) {
+        _ranges.push_front(Range{*piece});
+    }
+
+    vector<TCPSegment> segments;
+    for (const Range &piece : pieces) {
+        TCPSegment seg;
+        seg.header().seqno = wrap(piece.seqno, isn);
+        seg.header().fin = piece.fin;
+        seg.payload() = piece.payload;
+        segments.push_back(move(seg));
+    }
+    return segments;
+}
+
 unsigned int TCPSender::consecutive_retransmissions() const { return _consecutive_retransmission_count; }
 
 void TCPSender::send_empty_ack() {
     TCPSegment seg;
     seg.header().seqno = wrap(_next_seqno, _isn);
-    // cerr<< "in empty_ack _time_rest "<< _timer._time_rest<<endl;
     _segments_out.emplace(move(seg));
 }
 
@@ -2,6 +2,9 @@
 #define TCP_SENDER
 
 #include "byte_stream.hh"
+#include "lazy_deque.hh"
+#include "metrics.hh"
+#include "path_mtu.hh"
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
 #include "wrapping_integers.hh"
@@ -28,6 +31,46 @@ class RetransmissionTimer {
     void stop() { on_off = false; }
 };
 
+//! \brief The sent but not yet acknowledged part of the sequence space
+//! \details Each transmission is kept as a range (absolute seqno, SYN/FIN flags) plus a reference to its
+//! payload bytes, so segments are never copied: acknowledging pops whole ranges (and trims one it splits),
+//! and a retransmission is rebuilt from the ranges, re-sliced or coalesced to the current maximum payload size.
+class RetransmissionQueue {
+  private:
+    struct Range {
+        uint64_t seqno;  //!< absolute seqno of the SYN or first payload byte
+        bool syn;
+        bool fin;
+        Buffer payload;  //!< shares storage with the transmitted payload
+
+        uint64_t end() const { return seqno + syn + payload.size() + fin; }
+    };
+
+    LazyDeque<Range> _ranges{};
+
+  public:
+    //! \brief Record `seg`, just sent at absolute seqno `seqno`
+    void push(const uint64_t seqno, const TCPSegment &seg);
+
+    //! \brief Drop what absolute ackno `ackno` acknowledges: whole ranges, and the front of a range it splits
+    //! \returns the length, in sequence space, of what was dropped
+    size_t ack(const uint64_t ackno);
+
+    //! \returns `true` if nothing is outstanding
+    bool empty() const { return _ranges.empty(); }
+
+    //! Free the queue's memory if nothing is outstanding
+    void trim() { _ranges.trim(); }
+
+    //! \brief Rebuild the earliest outstanding segment, carrying at most `max_payload` bytes
+    //! \details Following ranges are coalesced into it while they fit.
+    TCPSegment retransmission(const WrappingInt32 isn, const size_t max_payload) const;
+
+    //! \brief Split the earliest outstanding segment into segments of at most `max_payload` bytes
+    //! \returns the new segments, to be retransmitted together
+    std::vector<TCPSegment> split_front(const WrappingInt32 isn, const size_t max_payload);
+};
+
 //! \brief The "sender" part of a TCP implementation.
 
 //! Accepts a ByteStream, divides it up into segments and sends the
@@ -40,7 +83,7 @@ class TCPSender {
     WrappingInt32 _isn;
 
     //! outbound queue of segments that the TCPSender wants sent
-    std::queue<TCPSegment> _segments_out{};
+    SegmentQueue _segments_out{};
 
     //! retransmission timer for the connection
     unsigned int _initial_retransmission_timeout;
@@ -58,16 +101,52 @@ class TCPSender {
     enum TCPState { CLOSED, SYN_SENT, SYN_ACKED, FIN_SENT, FIN_ACKED };
     TCPState _state{CLOSED};
 
-    static bool segcmp(const TCPSegment &seg1, const TCPSegment &seg2) {
-        return seg1.header().seqno.raw_value() > seg2.header().seqno.raw_value();
-    }
+    //! segments sent and not yet acknowledged
+    RetransmissionQueue _retransmissions{};
+
+    //! segments retransmitted on timeout, over the connection's life
+    uint64_t _retransmitted_segments{0};
+
+    //! path MTU probes lost, over the connection's life (their bytes are resent, but not counted above)
+    uint64_t _lost_mtu_probes{0};
+
+    //! payload size of the segments sent
+    PathMTUDiscovery _path_mtu{false, TCPConfig::MAX_PAYLOAD_SIZE, TCPConfig::MAX_PAYLOAD_SIZE};
+
+    //! \name Persist timer
+    //! While the peer's window is zero and there is something to send, the retransmission timer is
+    //! stopped and this timer sends zero-window probes, backing off on its own schedule.
+    //!@{
+    RetransmissionTimer _persist{};
+    unsigned int _persist_timeout{0};      //!< interval before the next probe, in milliseconds
+    uint64_t _zero_window_probes{0};       //!< probes sent over the connection's life
+    unsigned int _unanswered_probes{0};    //!< probes sent since the last acknowledgment
+
+    //! Start or stop the persist timer, and hand over between it and the retransmission timer
+    void update_persist();
+
+    //! Send a probe: the first outstanding byte again, or else the next byte (or FIN) of the stream
+    void send_probe();
+    //!@}
+
+    //! Send segments that fit in a window of `window_size`
+    void fill(const size_t window_size);
 
-    // std::priority_queue<TCPSegment,
-    //                     std::vector<TCPSegment>,
-    //                     decltype(&(TCPSender::segcmp))  // todo 更优雅的方式？
-    //                     >
-    //     _segments_in_flight;
-    std::queue<TCPSegment> _segments_in_flight;
+    //! Retransmit the bytes of a lost path MTU probe in segments of mss()
+    void probe_lost();
+
+    //! \name Round-trip time sampling
+    //! Karn's algorithm: one segment is timed at a time, and a retransmission discards its sample.
+    //!@{
+    size_t _time{0};                         //!< milliseconds since construction
+    std::optional<uint64_t> _rtt_seqno{};    //!< absolute ackno that completes the sample being taken
+    size_t _rtt_start{0};                    //!< when the timed segment was sent
+    std::optional<size_t> _srtt{};           //!< smoothed round-trip time, in milliseconds
+    Histogram _rtt_samples{};                //!< every sample taken, in milliseconds
+
+    //! Time the segment ending at absolute seqno `end`, unless one is already being timed
+    void start_rtt_sample(const uint64_t end);
+    //!@}
 
   public:
     //! Initialize a TCPSender
@@ -97,6 +176,20 @@ class TCPSender {
     //! \brief Notifies the TCPSender of the passage of time
     void tick(const size_t ms_since_last_tick);
     //!@}
+
+    //! \name Segment size
+    //!@{
+
+    //! \brief Send payloads of at most `mss` bytes, or if `plpmtud`, search for the largest the path
+    //! carries, from TCPConfig::MAX_PAYLOAD_SIZE up to `mss` (see PathMTUDiscovery)
+    void set_mss(const size_t mss, const bool plpmtud = false);
+
+    //! \brief The peer's MSS option: payloads are never larger
+    void set_peer_mss(const size_t mss) { _path_mtu.set_ceiling(mss); }
+
+    //! \brief Payload size of the segments sent (other than path MTU probes)
+    size_t mss() const { return _path_mtu.mss(); }
+    //!@}
     bool timer_state() const { return _timer.activated(); }
 
     //! \name Accessors
@@ -110,11 +203,47 @@ class TCPSender {
     //! \brief Number of consecutive retransmissions that have occurred in a row
     unsigned int consecutive_retransmissions() const;
 
+    //! \brief Has the remote receiver acknowledged our SYN?
+    bool syn_acked() const { return _state >= SYN_ACKED; }
+
+    //! \brief Smoothed round-trip time in milliseconds, if one has been measured
+    std::optional<size_t> srtt() const { return _srtt; }
+
+    //! \brief Every round-trip time sample taken, in milliseconds
+    const Histogram &rtt_samples() const { return _rtt_samples; }
+
+    //! \brief Number of segments retransmitted on timeout
+    uint64_t retransmitted_segments() const { return _retransmitted_segments; }
+
+    //! \brief Number of path MTU probes lost (not counted as retransmissions: a lost probe isn't congestion)
+    uint64_t lost_mtu_probes() const { return _lost_mtu_probes; }
+
+    //! \brief Number of zero-window probes sent
+    uint64_t zero_window_probes() const { return _zero_window_probes; }
+
+    //! \brief Number of zero-window probes sent since the peer last acknowledged anything
+    unsigned int unanswered_probes() const { return _unanswered_probes; }
+
+    //! \brief Is the persist timer running (the peer's zero window holds back data)?
+    bool persisting() const { return _persist.activated(); }
+
+    //! \brief Interval before the next zero-window probe, in milliseconds
+    unsigned int persist_timeout() const { return _persist_timeout; }
+
+    //! \brief The window size last advertised by the remote receiver
+    size_t window_size() const { return _window_size; }
+
+    //! \brief The current retransmission timeout, in milliseconds
+    unsigned int retransmission_timeout() const { return _retransmission_timeout; }
+
     //! \brief TCPSegments that the TCPSender has enqueued for transmission.
     //! \note These must be dequeued and sent by the TCPConnection,
     //! which will need to fill in the fields that are set by the TCPReceiver
     //! (ackno and window size) before sending.
-    std::queue<TCPSegment> &segments_out() { return _segments_out; }
+    SegmentQueue &segments_out() { return _segments_out; }
+
+    //! \brief Free the memory of the outbound stream and queues that are empty
+    void trim();
     //!@}
 
     //! \name What is the next sequence number? (used for testing)
@@ -12,6 +12,23 @@ void Buffer::remove_prefix(const size_t n) {
     }
 }
 
+char *Buffer::headroom_data(const size_t n) {
+    if (n > headroom()) {
+        throw out_of_range("Buffer::headroom_data");
+    }
+    return _storage->data() + _starting_offset - n;
+}
+
+Buffer Buffer::expand_into_headroom(const size_t n) const {
+    if (n > headroom()) {
+        throw out_of_range("Buffer::expand_into_headroom");
+    }
+    Buffer ret = *this;
+    ret._starting_offset -= n;
+    ret._headroom -= n;
+    return ret;
+}
+
 void BufferList::append(const BufferList &other) {
     for (const auto &buf : other._buffers) {
         _buffers.push_back(buf);
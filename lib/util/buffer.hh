@@ -5,6 +5,7 @@
 #include <deque>
 #include <memory>
 #include <numeric>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/uio.h>
@@ -15,6 +16,7 @@ class Buffer {
   private:
     std::shared_ptr<std::string> _storage{};
     size_t _starting_offset{};
+    size_t _headroom{};  //!< Bytes at the front of `_storage` reserved for headers
 
   public:
     Buffer() = default;
@@ -22,6 +24,14 @@ class Buffer {
     //! \brief Construct by taking ownership of a string
     Buffer(std::string &&str) noexcept : _storage(std::make_shared<std::string>(std::move(str))) {}
 
+    //! \brief Construct by taking ownership of a string whose first `headroom` bytes are reserved for headers
+    Buffer(std::string &&str, const size_t headroom)
+        : _storage(std::make_shared<std::string>(std::move(str))), _starting_offset(headroom), _headroom(headroom) {
+        if (_headroom > _storage->size()) {
+            throw std::out_of_range("Buffer: headroom larger than string");
+        }
+    }
+
     //! \name Expose contents as a std::string_view
     //!@{
     std::string_view str() const {
@@ -47,6 +57,24 @@ class Buffer {
     //! \note Doesn't free any memory until the whole string has been discarded in all copies of the Buffer.
     void remove_prefix(const size_t n);
 
+    //! \name Headroom: reserved bytes directly in front of the contents, for writing headers in place
+    //!@{
+
+    //! \brief Number of headroom bytes available (zero once a prefix has been removed)
+    size_t headroom() const { return (_storage and _starting_offset == _headroom) ? _headroom : 0; }
+
+    //! \brief Writable pointer to the last `n` bytes of headroom, i.e. the `n` bytes just before the contents
+    //! \note The headroom is not part of the contents, so writing it doesn't change any Buffer's value, but
+    //! it is shared by every copy of this Buffer: only the owner of the storage should write it.
+    char *headroom_data(const size_t n);
+
+    //! \brief A Buffer whose contents are the last `n` bytes of headroom followed by these contents
+    Buffer expand_into_headroom(const size_t n) const;
+
+    //! \brief Is this the only Buffer referring to its storage (so its headroom can be rewritten)?
+    bool unshared() const { return _storage.use_count() == 1; }
+    //!@}
+
     friend class BufferPlus;
 };
 
@@ -0,0 +1,43 @@
+#include "byte_ring.hh"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+//! \param[in] capacity is the minimum number of bytes the ring can hold
+ByteRing::ByteRing(const size_t capacity)
+    : _mask((size_t(1) << (64 - __builtin_clzll(max<size_t>(capacity, 2) - 1))) - 1)
+    , _storage(make_unique<char[]>(_mask + 1)) {}
+
+//! \param[in] data is the bytes to push; bytes that don't fit are not consumed
+size_t ByteRing::push(string_view data) {
+    const uint64_t write_index = _write_index.load(memory_order_relaxed);
+    const uint64_t read_index = _read_index.load(memory_order_acquire);
+    const size_t len = min(data.size(), capacity() - size_t(write_index - read_index));
+
+    // copy in at most two pieces: up to the end of the storage, then from its start
+    const size_t offset = write_index & _mask;
+    const size_t first = min(len, capacity() - offset);
+    memcpy(_storage.get() + offset, data.data(), first);
+    memcpy(_storage.get(), data.data() + first, len - first);
+
+    _write_index.store(write_index + len, memory_order_release);
+    return len;
+}
+
+//! \param[out] out is the string the popped bytes are appended to
+//! \param[in] limit is the maximum number of bytes to pop
+size_t ByteRing::pop(string &out, const size_t limit) {
+    const uint64_t read_index = _read_index.load(memory_order_relaxed);
+    const uint64_t write_index = _write_index.load(memory_order_acquire);
+    const size_t len = min<size_t>(limit, write_index - read_index);
+
+    const size_t offset = read_index & _mask;
+    const size_t first = min(len, capacity() - offset);
+    out.append(_storage.get() + offset, first);
+    out.append(_storage.get(), len - first);
+
+    _read_index.store(read_index + len, memory_order_release);
+    return len;
+}
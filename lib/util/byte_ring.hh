@@ -0,0 +1,68 @@
+#ifndef BYTE_RING
+#define BYTE_RING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//! \brief A lock-free, fixed-capacity byte queue for one producer thread and one consumer thread
+//! \details The producer only advances the write index and the consumer only advances the read index,
+//! each publishing its progress with a release store that the other side reads with an acquire load.
+//! The two indices live on separate cache lines so the threads don't false-share. Indices grow
+//! monotonically; the capacity is a power of two, so a position in the storage is `index & _mask`.
+class ByteRing {
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    size_t _mask;                         //!< capacity - 1
+    std::unique_ptr<char[]> _storage;     //!< `_mask + 1` bytes
+    alignas(CACHE_LINE) std::atomic<uint64_t> _write_index{0};  //!< advanced by the producer
+    alignas(CACHE_LINE) std::atomic<uint64_t> _read_index{0};   //!< advanced by the consumer
+    alignas(CACHE_LINE) std::atomic<bool> _closed{false};       //!< set by the producer after its last push
+
+  public:
+    //! Construct a ring holding at least `capacity` bytes (rounded up to a power of two)
+    explicit ByteRing(const size_t capacity);
+
+    //! \name Producer interface
+    //!@{
+
+    //! Copy as much of `data` as fits into the ring
+    //! \returns the number of bytes accepted
+    size_t push(std::string_view data);
+
+    //! Signal that nothing more will be pushed
+    void close() { _closed.store(true, std::memory_order_release); }
+
+    //! \returns the number of bytes that can be pushed right now
+    size_t free_space() const { return capacity() - size(); }
+    //!@}
+
+    //! \name Consumer interface
+    //!@{
+
+    //! Move up to `limit` bytes out of the ring, appending them to `out`
+    //! \returns the number of bytes popped
+    size_t pop(std::string &out, const size_t limit);
+
+    //! \returns `true` if the producer has closed the ring and every byte has been popped
+    bool eof() const { return _closed.load(std::memory_order_acquire) and size() == 0; }
+    //!@}
+
+    //! \returns `true` if the producer has closed the ring
+    bool closed() const { return _closed.load(std::memory_order_acquire); }
+
+    //! \returns the number of bytes in the ring: a lower bound on the consumer side (the producer may have pushed
+    //! more since), an upper bound on the producer side (the consumer may have popped some since)
+    size_t size() const {
+        return _write_index.load(std::memory_order_acquire) - _read_index.load(std::memory_order_acquire);
+    }
+
+    //! \returns the number of bytes the ring can hold
+    size_t capacity() const { return _mask + 1; }
+};
+
+#endif /* BYTE_RING */
@@ -0,0 +1,34 @@
+#include "eventfd.hh"
+
+#include "util.hh"
+
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+EventFD::EventFD() : FileDescriptor(SystemCall("eventfd", ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+void EventFD::notify() {
+    const uint64_t one = 1;
+    SystemCall("write", ::write(fd_num(), &one, sizeof(one)));
+    register_write();
+}
+
+uint64_t EventFD::clear() {
+    uint64_t count = 0;
+    if (SystemCall("read", ::read(fd_num(), &count, sizeof(count)), EAGAIN) < 0) {
+        count = 0;  // nothing to clear
+    }
+    register_read();
+    return count;
+}
+
+//! \param[in] timeout_ms is the timeout passed to [poll(2)](\ref man2::poll); negative waits forever
+void EventFD::wait(const int timeout_ms) {
+    pollfd pfd{fd_num(), POLLIN, 0};
+    SystemCall("poll", ::poll(&pfd, 1, timeout_ms), EINTR);
+    clear();
+}
@@ -0,0 +1,28 @@
+#ifndef EVENTFD
+#define EVENTFD
+
+#include "file_descriptor.hh"
+
+#include <cstdint>
+
+//! \brief A FileDescriptor to a non-blocking Linux [eventfd](\ref man2::eventfd) counter, used as a wakeup signal
+//! \details notify() makes the fd readable, so another thread blocked in wait(), or an EventLoop
+//! polling the fd, wakes up. clear() resets it. Notifications are not lost: one that arrives while
+//! nobody is waiting keeps the fd readable until the next clear().
+class EventFD : public FileDescriptor {
+  public:
+    //! Create an eventfd with a zero counter
+    EventFD();
+
+    //! Make the fd readable (wakes up a waiter)
+    void notify();
+
+    //! Reset the counter without blocking
+    //! \returns the number of notifications since the last clear
+    uint64_t clear();
+
+    //! Block until notified (or for at most `timeout_ms` milliseconds, if not negative), then clear
+    void wait(const int timeout_ms = -1);
+};
+
+#endif /* EVENTFD */
@@ -3,6 +3,8 @@
 #include "util.hh"
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
@@ -98,6 +100,55 @@ size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
     return total_bytes_written;
 }
 
+//! \details Unlike write(BufferViewList), this builds no iovec list, so writing e.g. a datagram
+//! serialized in place doesn't allocate.
+size_t FileDescriptor::write(string_view buffer, const bool write_all) {
+    size_t total_bytes_written = 0;
+
+    do {
+        const ssize_t bytes_written = SystemCall("write", ::write(fd_num(), buffer.data(), buffer.size()));
+        if (bytes_written == 0 and buffer.size() != 0) {
+            throw runtime_error("write returned 0 given non-empty input buffer");
+        }
+
+        if (bytes_written > ssize_t(buffer.size())) {
+            throw runtime_error("write wrote more than length of input buffer");
+        }
+
+        register_write();
+
+        buffer.remove_prefix(bytes_written);
+
+        total_bytes_written += bytes_written;
+    } while (write_all and buffer.size());
+
+    return total_bytes_written;
+}
+
+//! \details Unlike read(), this doesn't size `datagram` for the largest read first: the datagram lands
+//! in a buffer on the stack, and only its own bytes are copied out.
+bool FileDescriptor::read_datagram(string &datagram) {
+    array<char, 65536> buffer;  // the largest IPv4 datagram
+    const ssize_t bytes_read = SystemCall("read", ::read(fd_num(), buffer.data(), buffer.size()), EAGAIN);
+    if (bytes_read <= 0) {
+        _internal_fd->_eof |= bytes_read == 0;
+        return false;
+    }
+    datagram.assign(buffer.data(), bytes_read);
+    register_read();
+    return true;
+}
+
+//! \details For datagram fds (a TUN device or a SOCK_SEQPACKET socket), where a full queue means the
+//! datagram is lost rather than something to wait for.
+bool FileDescriptor::write_datagram(string_view datagram) {
+    if (SystemCall("write", ::write(fd_num(), datagram.data(), datagram.size()), EAGAIN) < 0) {
+        return false;
+    }
+    register_write();
+    return true;
+}
+
 void FileDescriptor::set_blocking(const bool blocking_state) {
     int flags = SystemCall("fcntl", fcntl(fd_num(), F_GETFL));
     if (blocking_state) {
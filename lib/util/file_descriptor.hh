@@ -60,6 +60,15 @@ class FileDescriptor {
     //! Write a buffer (or list of buffers), possibly blocking until all is written
     size_t write(BufferViewList buffer, const bool write_all = true);
 
+    //! Write one contiguous buffer with [write(2)](\ref man2::write), possibly blocking until all is written
+    size_t write(std::string_view buffer, const bool write_all = true);
+
+    //! Read one datagram into `datagram`; on a non-blocking fd, returns false if none is waiting (or at EOF)
+    bool read_datagram(std::string &datagram);
+
+    //! Write one datagram; on a non-blocking fd, returns false (and writes nothing) if it would block
+    bool write_datagram(std::string_view datagram);
+
     //! Close the underlying file descriptor
     void close() { _internal_fd->close(); }
 
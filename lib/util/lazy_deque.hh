@@ -0,0 +1,102 @@
+#ifndef LAZY_DEQUE
+#define LAZY_DEQUE
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <utility>
+
+//! \brief A std::deque that is only allocated while it's in use
+//! \details libstdc++'s std::deque allocates its map and a first node (over 500 bytes) when it is
+//! constructed, and keeps a node when it is emptied. A connection holds several queues that are
+//! empty while it is idle, so this one allocates its deque on the first push, and trim() frees it
+//! once it's empty again. (Freeing on the last pop instead would allocate anew for each burst of a
+//! busy connection.) It has the members std::queue needs of its container, plus iteration, so it
+//! can stand in for std::deque where elements are only added at the back.
+template <typename T>
+class LazyDeque {
+  private:
+    std::unique_ptr<std::deque<T>> _elements{};
+
+    //! The deque, allocated if it isn't yet
+    std::deque<T> &_deque() {
+        if (not _elements) {
+            _elements = std::make_unique<std::deque<T>>();
+        }
+        return *_elements;
+    }
+
+    //! \brief What a LazyDeque that holds nothing iterates over
+    //! \note Shared by every LazyDeque<T> and always empty: its iterators can't reach an element to modify
+    static std::deque<T> &_none() {
+        static std::deque<T> none{};
+        return none;
+    }
+
+  public:
+    using value_type = T;
+    using reference = T &;
+    using const_reference = const T &;
+    using size_type = size_t;
+    using iterator = typename std::deque<T>::iterator;
+    using const_iterator = typename std::deque<T>::const_iterator;
+
+    LazyDeque() = default;
+    LazyDeque(const LazyDeque &other)
+        : _elements(other._elements ? std::make_unique<std::deque<T>>(*other._elements) : nullptr) {}
+    LazyDeque &operator=(const LazyDeque &other) {
+        if (this != &other) {
+            *this = LazyDeque(other);
+        }
+        return *this;
+    }
+    LazyDeque(LazyDeque &&other) noexcept = default;
+    LazyDeque &operator=(LazyDeque &&other) noexcept = default;
+    ~LazyDeque() = default;
+
+    bool empty() const { return not _elements or _elements->empty(); }
+    size_t size() const { return _elements ? _elements->size() : 0; }
+
+    //! \name Elements (the LazyDeque must not be empty)
+    //!@{
+    T &front() { return _elements->front(); }
+    const T &front() const { return _elements->front(); }
+    T &back() { return _elements->back(); }
+    const T &back() const { return _elements->back(); }
+    //!@}
+
+    void push_back(const T &value) { _deque().push_back(value); }
+    void push_back(T &&value) { _deque().push_back(std::move(value)); }
+    void push_front(T &&value) { _deque().push_front(std::move(value)); }
+
+    template <typename... Args>
+    T &emplace_back(Args &&... args) {
+        return _deque().emplace_back(std::forward<Args>(args)...);
+    }
+
+    void pop_front() { _elements->pop_front(); }
+
+    void clear() { _elements.reset(); }
+
+    //! Free the deque if it's empty
+    void trim() {
+        if (empty()) {
+            _elements.reset();
+        }
+    }
+
+    //! Is the deque allocated?
+    bool allocated() const { return _elements != nullptr; }
+
+    void swap(LazyDeque &other) noexcept { _elements.swap(other._elements); }
+
+    //! \name Iteration (invalidated by any push or pop)
+    //!@{
+    iterator begin() { return (_elements ? *_elements : _none()).begin(); }
+    iterator end() { return (_elements ? *_elements : _none()).end(); }
+    const_iterator begin() const { return (_elements ? *_elements : _none()).begin(); }
+    const_iterator end() const { return (_elements ? *_elements : _none()).end(); }
+    //!@}
+};
+
+#endif /* LAZY_DEQUE */
@@ -0,0 +1,99 @@
+#include "metrics.hh"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+void Histogram::write_prometheus(ostream &out, const string &name, const string &labels) const {
+    const string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < BUCKETS; ++i) {
+        cumulative += _buckets[i];
+        out << name << "_bucket{" << labels << sep << "le=\"" << upper_bound(i) - 1 << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << _count << "\n";
+    out << name << "_sum{" << labels << "} " << _sum << "\n";
+    out << name << "_count{" << labels << "} " << _count << "\n";
+}
+
+struct StackMetrics::Registry {
+    mutex lock{};
+    vector<const Slot *> live{};
+    array<uint64_t, COUNTERS> retired{};
+
+    array<uint64_t, COUNTERS> totals() {
+        const lock_guard<mutex> guard(lock);
+        auto sums = retired;
+        for (const Slot *slot : live) {
+            for (size_t i = 0; i < COUNTERS; ++i) {
+                sums[i] += slot->counters[i].load(memory_order_relaxed);
+            }
+        }
+        return sums;
+    }
+};
+
+StackMetrics::Registry &StackMetrics::_registry() {
+    static Registry registry;
+    return registry;
+}
+
+StackMetrics::Slot &StackMetrics::_slot() {
+    // registers the thread's slot on first use, and folds it into the retired totals on thread exit
+    struct Owner {
+        unique_ptr<Slot> slot{make_unique<Slot>()};
+
+        Owner() {
+            const lock_guard<mutex> guard(_registry().lock);
+            _registry().live.push_back(slot.get());
+        }
+        ~Owner() {
+            Registry &r = _registry();
+            const lock_guard<mutex> guard(r.lock);
+            for (size_t i = 0; i < COUNTERS; ++i) {
+                r.retired[i] += slot->counters[i].load(memory_order_relaxed);
+            }
+            r.live.erase(find(r.live.begin(), r.live.end(), slot.get()));
+        }
+        Owner(const Owner &other) = delete;
+        Owner &operator=(const Owner &other) = delete;
+    };
+    static thread_local Owner owner;
+    return *owner.slot;
+}
+
+StackMetrics::Snapshot StackMetrics::snapshot() {
+    const auto sums = _registry().totals();
+    Snapshot s;
+    for (size_t r = 0; r < PARSE_RESULTS; ++r) {
+        s.ipv4_parse_failures[r] = sums[IPV4_PARSE + r];
+        s.tcp_parse_failures[r] = sums[TCP_PARSE + r];
+    }
+    s.demux_misses = sums[DEMUX_MISS];
+    s.outbound_drops = sums[OUTBOUND_DROP];
+    s.listen_overflows = sums[LISTEN_OVERFLOW];
+    return s;
+}
+
+void StackMetrics::write_prometheus(ostream &out) {
+    const Snapshot s = snapshot();
+    out << "# TYPE starfish_parse_failures_total counter\n";
+    for (size_t r = 1; r < PARSE_RESULTS; ++r) {
+        const string reason = as_string(static_cast<ParseResult>(r));
+        out << "starfish_parse_failures_total{layer=\"ipv4\",reason=\"" << reason << "\"} "
+            << s.ipv4_parse_failures[r] << "\n";
+        out << "starfish_parse_failures_total{layer=\"tcp\",reason=\"" << reason << "\"} " << s.tcp_parse_failures[r]
+            << "\n";
+    }
+    out << "# TYPE starfish_checksum_failures_total counter\n";
+    out << "starfish_checksum_failures_total " << s.checksum_failures() << "\n";
+    out << "# TYPE starfish_demux_misses_total counter\n";
+    out << "starfish_demux_misses_total " << s.demux_misses << "\n";
+    out << "# TYPE starfish_outbound_drops_total counter\n";
+    out << "starfish_outbound_drops_total " << s.outbound_drops << "\n";
+    out << "# TYPE starfish_listen_overflows_total counter\n";
+    out << "starfish_listen_overflows_total " << s.listen_overflows << "\n";
+}
@@ -0,0 +1,109 @@
+#ifndef METRICS
+#define METRICS
+
+#include "parser.hh"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//! \brief A histogram with power-of-two buckets, for one writer thread
+//! \details Bucket 0 counts zeros; bucket `i > 0` counts values in [2^(i-1), 2^i). Recording is a
+//! count-leading-zeros and three increments.
+class Histogram {
+  public:
+    static constexpr size_t BUCKETS = 32;
+
+  private:
+    std::array<uint64_t, BUCKETS> _buckets{};
+    uint64_t _count{0};
+    uint64_t _sum{0};
+
+  public:
+    //! Count one occurrence of `value` (values of 2^31 or more land in the last bucket)
+    void record(const uint64_t value) {
+        const size_t bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+        _buckets[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+        _count++;
+        _sum += value;
+    }
+
+    //! Exclusive upper bound of the values in `bucket` (the last bucket has none)
+    static uint64_t upper_bound(const size_t bucket) { return uint64_t{1} << bucket; }
+
+    uint64_t bucket(const size_t i) const { return _buckets[i]; }
+    uint64_t count() const { return _count; }
+    uint64_t sum() const { return _sum; }
+
+    //! Append the histogram to `out` in the Prometheus text format, as `name` with `labels` (e.g. `conn="1"`)
+    void write_prometheus(std::ostream &out, const std::string &name, const std::string &labels) const;
+};
+
+//! \brief Process-wide counters of the packet path (parsing and demultiplexing), kept per thread
+//! \details Every thread that counts gets its own slot, padded to a cache line, which only it writes:
+//! an increment is a relaxed load and store, with no contention and no false sharing. snapshot()
+//! sums the slots of live threads and the totals left by threads that have exited.
+class StackMetrics {
+  public:
+    //! Number of ParseResult values
+    static constexpr size_t PARSE_RESULTS = static_cast<size_t>(ParseResult::Unsupported) + 1;
+
+    //! What a snapshot() reports
+    struct Snapshot {
+        std::array<uint64_t, PARSE_RESULTS> ipv4_parse_failures{};  //!< by ParseResult (NoError is unused)
+        std::array<uint64_t, PARSE_RESULTS> tcp_parse_failures{};   //!< by ParseResult (NoError is unused)
+        uint64_t demux_misses{0};      //!< TCP-in-IPv4 datagrams that matched no connection or listener
+        uint64_t outbound_drops{0};    //!< datagrams dropped because a TUNStack's outbound queue was full
+        uint64_t listen_overflows{0};  //!< SYNs dropped because their listener's backlog was full
+
+        //! IPv4 header and TCP checksum failures
+        uint64_t checksum_failures() const {
+            const auto bad = static_cast<size_t>(ParseResult::BadChecksum);
+            return ipv4_parse_failures[bad] + tcp_parse_failures[bad];
+        }
+    };
+
+    //! \name Counting (from any thread)
+    //!@{
+    static void ipv4_parse_failure(const ParseResult r) { _count(IPV4_PARSE + static_cast<size_t>(r)); }
+    static void tcp_parse_failure(const ParseResult r) { _count(TCP_PARSE + static_cast<size_t>(r)); }
+    static void demux_miss() { _count(DEMUX_MISS); }
+    static void outbound_drop() { _count(OUTBOUND_DROP); }
+    static void listen_overflow() { _count(LISTEN_OVERFLOW); }
+    //!@}
+
+    //! Current totals
+    static Snapshot snapshot();
+
+    //! Append the totals to `out` in the Prometheus text format
+    static void write_prometheus(std::ostream &out);
+
+  private:
+    static constexpr size_t IPV4_PARSE = 0;
+    static constexpr size_t TCP_PARSE = IPV4_PARSE + PARSE_RESULTS;
+    static constexpr size_t DEMUX_MISS = TCP_PARSE + PARSE_RESULTS;
+    static constexpr size_t OUTBOUND_DROP = DEMUX_MISS + 1;
+    static constexpr size_t LISTEN_OVERFLOW = OUTBOUND_DROP + 1;
+    static constexpr size_t COUNTERS = LISTEN_OVERFLOW + 1;
+
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, COUNTERS> counters{};
+    };
+
+    //! Every live thread's slot, and the totals of exited threads
+    struct Registry;
+    static Registry &_registry();
+
+    //! The calling thread's slot (registered on first use, retired when the thread exits)
+    static Slot &_slot();
+
+    static void _count(const size_t counter) {
+        std::atomic<uint64_t> &c = _slot().counters[counter];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+#endif /* METRICS */
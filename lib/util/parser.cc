@@ -12,6 +12,7 @@ string as_string(const ParseResult r) {
         "WrongIPVersion",
         "HeaderTooShort",
         "TruncatedPacket",
+        "Unsupported",
     };
 
     return _names[static_cast<size_t>(r)];
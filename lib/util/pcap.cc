@@ -0,0 +1,112 @@
+#include "pcap.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/time.h>
+
+using namespace std;
+
+//! \name pcap file format (host byte order; readers detect it from the magic number)
+//!@{
+static constexpr uint32_t PCAP_MAGIC = 0xa1b2c3d4;  //!< microsecond timestamps
+static constexpr uint16_t PCAP_VERSION_MAJOR = 2;
+static constexpr uint16_t PCAP_VERSION_MINOR = 4;
+static constexpr uint32_t LINKTYPE_RAW = 101;  //!< packets begin with an IPv4 or IPv6 header
+
+struct PcapFileHeader {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+};
+
+struct PcapRecordHeader {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+//!@}
+
+//! The configuration, if it is valid
+static const PcapConfig &checked(const PcapConfig &cfg) {
+    if (cfg.sample_every == 0) {
+        throw runtime_error("PcapCapture: sample_every must be at least 1");
+    }
+    return cfg;
+}
+
+//! \param[in] path is the file to create
+//! \param[in] cfg sets the snapshot length, sampling and ring size
+PcapCapture::PcapCapture(const string &path, const PcapConfig &cfg)
+    : _cfg(checked(cfg))
+    , _file(SystemCall("open", ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)))
+    , _ring(cfg.ring_bytes) {
+    const PcapFileHeader header{PCAP_MAGIC,
+                                PCAP_VERSION_MAJOR,
+                                PCAP_VERSION_MINOR,
+                                0,
+                                0,
+                                static_cast<uint32_t>(_cfg.snaplen),
+                                LINKTYPE_RAW};
+    _file.write(string_view{reinterpret_cast<const char *>(&header), sizeof(header)});
+    _writer = thread([this] { _write_loop(); });
+}
+
+PcapCapture::~PcapCapture() {
+    _ring.close();
+    _wakeup.notify();
+    _writer.join();
+}
+
+//! \param[in] datagram is the whole datagram, as read from or written to the TUN device
+void PcapCapture::capture(const string_view datagram) {
+    if (_seen++ % _cfg.sample_every != 0) {
+        return;
+    }
+
+    const size_t incl_len = min(datagram.size(), _cfg.snaplen);
+    if (_ring.free_space() < sizeof(PcapRecordHeader) + incl_len) {
+        _dropped.store(dropped() + 1, memory_order_relaxed);
+        return;
+    }
+
+    timeval now{};
+    gettimeofday(&now, nullptr);
+    const PcapRecordHeader record{static_cast<uint32_t>(now.tv_sec),
+                                  static_cast<uint32_t>(now.tv_usec),
+                                  static_cast<uint32_t>(incl_len),
+                                  static_cast<uint32_t>(datagram.size())};
+    const bool was_below_half = _ring.size() <= _ring.capacity() / 2;
+    _ring.push(string_view{reinterpret_cast<const char *>(&record), sizeof(record)});
+    _ring.push(datagram.substr(0, incl_len));
+    _captured.store(captured() + 1, memory_order_relaxed);
+
+    // wake the writer early rather than let the ring fill up
+    if (was_below_half and _ring.size() > _ring.capacity() / 2) {
+        _wakeup.notify();
+    }
+}
+
+//! \details The writer may write part of a record; the rest follows on its next pass.
+void PcapCapture::_write_loop() {
+    string chunk;
+    while (true) {
+        const bool closed = _ring.closed();
+        chunk.clear();
+        _ring.pop(chunk, _ring.capacity());
+        if (not chunk.empty()) {
+            _file.write(chunk);
+        }
+        if (closed and _ring.eof()) {
+            return;
+        }
+        _wakeup.wait(_cfg.flush_interval_ms);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef PCAP
+#define PCAP
+
+#include "byte_ring.hh"
+#include "eventfd.hh"
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+
+//! Config for PcapCapture
+class PcapConfig {
+  public:
+    size_t snaplen = 65535;       //!< Bytes kept of each datagram (the rest is only counted in its length)
+    uint32_t sample_every = 1;    //!< Keep one datagram out of this many (at least 1)
+    size_t ring_bytes = 4 << 20;  //!< Bytes of records that may wait for the writer before captures are dropped
+    int flush_interval_ms = 100;  //!< Longest time a record waits before the writer wakes up
+};
+
+//! \brief Captures IPv4 datagrams into a pcap file, written by a background thread
+//! \details capture() copies (the first `snaplen` bytes of) a datagram and a pcap record header into a
+//! lock-free ByteRing and returns; it never blocks on the file. The writer thread drains the ring
+//! every `flush_interval_ms`, or as soon as it is half full. When the ring is full the datagram is
+//! dropped and counted, so a slow disk costs capture coverage rather than throughput.
+//!
+//! The file uses LINKTYPE_RAW (each packet starts with its IPv4 header), so tcpdump and Wireshark read
+//! it as is. Datagrams must be captured by one thread at a time (e.g. the thread that owns the adapter).
+class PcapCapture {
+  private:
+    PcapConfig _cfg;
+    FileDescriptor _file;
+    ByteRing _ring;
+    EventFD _wakeup{};
+    uint64_t _seen{0};  //!< datagrams offered to capture(), for sampling
+    std::atomic<uint64_t> _captured{0};
+    std::atomic<uint64_t> _dropped{0};
+    std::thread _writer{};
+
+    //! Write what the ring holds to the file, until it is closed and empty
+    void _write_loop();
+
+  public:
+    //! \brief Create (or truncate) the pcap file at `path` and start its writer thread
+    //! \throws unix_error if the file can't be created
+    //! \throws std::runtime_error (before creating the file) if `cfg.sample_every` is 0
+    explicit PcapCapture(const std::string &path, const PcapConfig &cfg = {});
+
+    //! Write every captured datagram, then stop the writer
+    ~PcapCapture();
+
+    PcapCapture(const PcapCapture &other) = delete;
+    PcapCapture &operator=(const PcapCapture &other) = delete;
+
+    //! Capture `datagram` (an IPv4 datagram), subject to sampling and to room in the ring
+    void capture(std::string_view datagram);
+
+    //! Datagrams captured (written, or waiting to be)
+    uint64_t captured() const { return _captured.load(std::memory_order_relaxed); }
+
+    //! Datagrams dropped because the ring was full
+    uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+};
+
+#endif /* PCAP */
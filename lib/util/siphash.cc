@@ -0,0 +1,76 @@
+#include "siphash.hh"
+
+#include <cstring>
+#include <random>
+
+using namespace std;
+
+static uint64_t rotl(const uint64_t x, const int b) { return (x << b) | (x >> (64 - b)); }
+
+namespace {
+//! The four words of SipHash state
+struct SipState {
+    uint64_t v0, v1, v2, v3;
+
+    void round() {
+        v0 += v1;
+        v1 = rotl(v1, 13);
+        v1 ^= v0;
+        v0 = rotl(v0, 32);
+        v2 += v3;
+        v3 = rotl(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = rotl(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = rotl(v1, 17);
+        v1 ^= v2;
+        v2 = rotl(v2, 32);
+    }
+
+    void compress(const uint64_t m) {
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+};
+}  // namespace
+
+//! \details Words are read little-endian, as in the reference implementation (this only runs on
+//! little-endian hosts, like the rest of the stack's raw-memory code).
+uint64_t siphash24(const SipKey &key, const void *data, const size_t len) {
+    SipState s{key[0] ^ 0x736f6d6570736575ULL,
+               key[1] ^ 0x646f72616e646f6dULL,
+               key[0] ^ 0x6c7967656e657261ULL,
+               key[1] ^ 0x7465646279746573ULL};
+
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t m;
+        memcpy(&m, bytes + i, sizeof(m));
+        s.compress(m);
+    }
+    uint64_t last = uint64_t{len & 0xff} << 56;
+    for (size_t j = 0; i + j < len; ++j) {
+        last |= uint64_t{bytes[i + j]} << (8 * j);
+    }
+    s.compress(last);
+
+    s.v2 ^= 0xff;
+    for (int r = 0; r < 4; ++r) {
+        s.round();
+    }
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+SipKey random_sip_key() {
+    random_device rd;
+    SipKey key{};
+    for (auto &word : key) {
+        word = uint64_t{rd()} << 32 | rd();
+    }
+    return key;
+}
@@ -0,0 +1,19 @@
+#ifndef SIPHASH
+#define SIPHASH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+//! A 128-bit SipHash key
+using SipKey = std::array<uint64_t, 2>;
+
+//! \brief SipHash-2-4 of `len` bytes at `data`, keyed by `key`
+//! \details A keyed pseudo-random function: without the key, its output can't be predicted from its
+//! input. See Aumasson and Bernstein, "SipHash: a fast short-input PRF" (2012).
+uint64_t siphash24(const SipKey &key, const void *data, const size_t len);
+
+//! A key read from std::random_device (call once, and keep it)
+SipKey random_sip_key();
+
+#endif /* SIPHASH */
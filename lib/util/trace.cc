@@ -0,0 +1,97 @@
+#include "trace.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+
+struct Tracer::Registry {
+    mutex lock{};
+    vector<shared_ptr<Ring>> rings{};  //!< of live and exited threads, until drained
+    uint64_t dropped{0};               //!< by threads whose rings have been released
+};
+
+Tracer::Registry &Tracer::_registry() {
+    static Registry registry;
+    return registry;
+}
+
+Tracer::Ring &Tracer::_ring() {
+    // the registry shares the ring, so records of an exited thread can still be drained
+    struct Owner {
+        shared_ptr<Ring> ring{make_shared<Ring>()};
+
+        Owner() {
+            const lock_guard<mutex> guard(_registry().lock);
+            _registry().rings.push_back(ring);
+        }
+    };
+    static thread_local Owner owner;
+    return *owner.ring;
+}
+
+void Tracer::record(TraceRecord rec) {
+    Ring &ring = _ring();
+    const uint64_t head = ring.head.load(memory_order_relaxed);
+    if (head - ring.tail.load(memory_order_acquire) == RING_RECORDS) {
+        ring.dropped.store(ring.dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+    rec.timestamp_ns =
+        chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    ring.records[head % RING_RECORDS] = rec;
+    ring.head.store(head + 1, memory_order_release);
+}
+
+//! \param[out] out receives the records, ring by ring
+size_t Tracer::drain(ostream &out) {
+    Registry &r = _registry();
+    const lock_guard<mutex> guard(r.lock);
+    size_t n = 0;
+    for (auto it = r.rings.begin(); it != r.rings.end();) {
+        Ring &ring = **it;
+        const uint64_t head = ring.head.load(memory_order_acquire);
+        uint64_t tail = ring.tail.load(memory_order_relaxed);
+        for (; tail != head; ++tail, ++n) {
+            out.write(reinterpret_cast<const char *>(&ring.records[tail % RING_RECORDS]), sizeof(TraceRecord));
+        }
+        ring.tail.store(tail, memory_order_release);
+        // a drained ring that only the registry holds belonged to a thread that has exited
+        if (it->use_count() == 1) {
+            r.dropped += ring.dropped.load(memory_order_relaxed);
+            it = r.rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return n;
+}
+
+uint64_t Tracer::dropped() {
+    Registry &r = _registry();
+    const lock_guard<mutex> guard(r.lock);
+    uint64_t n = r.dropped;
+    for (const auto &ring : r.rings) {
+        n += ring->dropped.load(memory_order_relaxed);
+    }
+    return n;
+}
+
+vector<TraceRecord> Tracer::read(istream &in) {
+    vector<TraceRecord> records;
+    TraceRecord rec{};
+    while (in.read(reinterpret_cast<char *>(&rec), sizeof(rec))) {
+        records.push_back(rec);
+    }
+    if (in.gcount() != 0) {
+        throw runtime_error("Tracer::read(): truncated trace record");
+    }
+    stable_sort(records.begin(), records.end(), [](const TraceRecord &x, const TraceRecord &y) {
+        return x.timestamp_ns < y.timestamp_ns;
+    });
+    return records;
+}
@@ -0,0 +1,86 @@
+#ifndef TRACE
+#define TRACE
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+//! What a TraceRecord describes
+enum class TraceEvent : uint8_t {
+    SegmentReceived = 0,  //!< a segment arrived (seqno, ackno, win, flags, payload length)
+    SegmentSent,          //!< a segment was queued for sending (same fields)
+    StateChanged,         //!< the connection moved from state `a` to state `b`
+    RtoFired,             //!< the retransmission timer expired: `a` consecutive retransmissions, RTO now `len` ms
+    WindowUpdated,        //!< the peer's advertised window went from `a` to `b` bytes
+};
+
+//! \brief One tracepoint hit: a fixed-size binary record, written to a file as is
+//! \details The meaning of `a`, `b`, `win`, `len` and `flags` depends on the event (see TraceEvent).
+struct TraceRecord {
+    uint64_t timestamp_ns;  //!< monotonic clock
+    uint64_t object;        //!< the traced object (e.g. the TCPConnection's address)
+    uint32_t a;
+    uint32_t b;
+    uint32_t len;
+    uint16_t win;
+    TraceEvent event;
+    uint8_t flags;
+};
+
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord is written to trace files as is");
+
+//! \brief Per-thread lock-free rings of TraceRecords, and a consumer that drains them
+//! \details A thread's first record allocates its ring. Recording is a timestamp, a copy into the ring
+//! and a release store; when the ring is full the record is dropped (and counted) rather than
+//! waiting for the consumer. drain() may run on any one thread at a time.
+class Tracer {
+  public:
+    //! Records per thread that may wait to be drained
+    static constexpr size_t RING_RECORDS = 1 << 16;
+
+    //! Add `rec` to the calling thread's ring, stamping it with the current time
+    static void record(TraceRecord rec);
+
+    //! \brief Append every record recorded so far to `out`, as raw TraceRecords
+    //! \returns the number of records written
+    static size_t drain(std::ostream &out);
+
+    //! Records dropped because a ring was full
+    static uint64_t dropped();
+
+    //! \brief Read a file written by drain(), ordered by timestamp
+    //! \throws std::runtime_error if the file is truncated
+    static std::vector<TraceRecord> read(std::istream &in);
+
+  private:
+    struct Ring {
+        std::array<TraceRecord, RING_RECORDS> records{};
+        std::atomic<uint64_t> head{0};  //!< next record to write (producer)
+        std::atomic<uint64_t> tail{0};  //!< next record to drain (consumer)
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    struct Registry;
+    static Registry &_registry();
+
+    //! The calling thread's ring (registered on first use, kept for drain() after the thread exits)
+    static Ring &_ring();
+};
+
+//! \name Tracepoints
+//! Compiled in only with `-DSTARFISH_TRACING` (the `STARFISH_TRACING` CMake option); otherwise they
+//! expand to nothing and their arguments are not evaluated.
+//!@{
+#ifdef STARFISH_TRACING
+#define STARFISH_TRACE(rec) Tracer::record(rec)
+#define STARFISH_TRACING_ONLY(...) __VA_ARGS__
+#else
+#define STARFISH_TRACE(rec) static_cast<void>(0)
+#define STARFISH_TRACING_ONLY(...)
+#endif
+//!@}
+
+#endif /* TRACE */
@@ -9,7 +9,20 @@
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <string>
+#include <utility>
+
+//! The MTU of the network interface `ifname`, in bytes (see SIOCGIFMTU in [netdevice](\ref man7::netdevice))
+inline size_t interface_mtu(const std::string &ifname) {
+    struct ifreq req {};
+    strncpy(static_cast<char *>(req.ifr_name), ifname.data(), IFNAMSIZ - 1);
+    req.ifr_name[IFNAMSIZ - 1] = '\0';
+
+    FileDescriptor sock{SystemCall("socket", socket(AF_INET, SOCK_DGRAM, 0))};
+    SystemCall("ioctl", ioctl(sock.fd_num(), SIOCGIFMTU, static_cast<void *>(&req)));
+    return req.ifr_mtu;
+}
 
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -28,10 +41,25 @@ class TunFD : public FileDescriptor  {
     tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
     SystemCall("ioctl", ioctl(fd_num(), TUNSETIFF, static_cast<void *>(&tun_req)));
+    _name = static_cast<char *>(tun_req.ifr_name);
   }
 
+  //! Wrap `fd`, a datagram socket that stands in for a TUN device (e.g. one end of a socketpair, in tests)
+  explicit TunFD(FileDescriptor &&fd) : FileDescriptor(std::move(fd)) {}
+
+  //! Is this an actual TUN device (rather than a stand-in)?
+  bool is_device() const { return not _name.empty(); }
+
+  //! The device's name
+  const std::string &name() const { return _name; }
+
+  //! The device's MTU, in bytes
+  size_t mtu() const { return interface_mtu(_name); }
+
   private:
     static constexpr const char *CLONEDEV = "/dev/net/tun";
+
+    std::string _name{};
 };
 
 
@@ -0,0 +1,201 @@
+#include "work_pool.hh"
+
+#include <exception>
+#include <iostream>
+#include <utility>
+
+using namespace std;
+
+//! Set on each worker thread: posts from a job go to its own worker's deque
+static thread_local const WorkPool *tl_pool = nullptr;
+static thread_local size_t tl_worker = 0;
+
+//! Run `job`, reporting (rather than propagating) anything it throws, so the thread running it carries on
+//! \param[in] where names the thread's role, for the report
+static void run_job(const function<void()> &job, const char *where) {
+    try {
+        job();
+    } catch (const exception &e) {
+        cerr << "Exception in " << where << " job: " << e.what() << "\n";
+    } catch (...) {
+        cerr << "Unknown exception in " << where << " job\n";
+    }
+}
+
+CompletionQueue::CompletionQueue() : _head(&_stub), _tail(&_stub) {}
+
+CompletionQueue::~CompletionQueue() {
+    while (Node *node = _pop()) {
+        delete node;
+    }
+}
+
+void CompletionQueue::_push(Node *node) {
+    node->next.store(nullptr, memory_order_relaxed);
+    Node *prev = _head.exchange(node, memory_order_acq_rel);
+    prev->next.store(node, memory_order_release);
+}
+
+//! \details Returns nullptr if a producer has swapped in a new head but not yet linked it: that
+//! producer's push is not complete, and it will notify the EventFD once it is.
+CompletionQueue::Node *CompletionQueue::_pop() {
+    Node *tail = _tail;
+    Node *next = tail->next.load(memory_order_acquire);
+    if (tail == &_stub) {
+        if (not next) {
+            return nullptr;
+        }
+        _tail = next;
+        tail = next;
+        next = next->next.load(memory_order_acquire);
+    }
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != _head.load(memory_order_acquire)) {
+        return nullptr;
+    }
+    _push(&_stub);
+    next = tail->next.load(memory_order_acquire);
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void CompletionQueue::push(Job job) {
+    Node *node = new Node;
+    node->job = move(job);
+    _push(node);
+    if (not _signaled.exchange(true)) {
+        _wakeup.notify();
+    }
+}
+
+size_t CompletionQueue::run() {
+    _signaled.store(false);
+    size_t count = 0;
+    while (Node *node = _pop()) {
+        const unique_ptr<Node> owner{node};
+        run_job(owner->job, "CompletionQueue");
+        ++count;
+    }
+    return count;
+}
+
+//! \param[in] loop is the EventLoop of the thread that consumes completions
+void CompletionQueue::install_rules(EventLoop &loop) {
+    loop.add_rule(_wakeup, EventLoop::Direction::In, [this] {
+        _wakeup.clear();
+        run();
+    });
+}
+
+//! \details The strand runs at most BATCH jobs, then requeues itself behind the pool's other work.
+void WorkPool::Strand::_drain() {
+    for (size_t i = 0; i < BATCH; ++i) {
+        Job job;
+        {
+            const lock_guard<mutex> lock(_mutex);
+            if (_jobs.empty()) {
+                _scheduled = false;
+                return;
+            }
+            job = move(_jobs.front());
+            _jobs.pop_front();
+        }
+        run_job(job, "WorkPool::Strand");
+    }
+    _pool.post([self = shared_from_this()] { self->_drain(); });
+}
+
+void WorkPool::Strand::post(Job job) {
+    {
+        const lock_guard<mutex> lock(_mutex);
+        _jobs.push_back(move(job));
+        if (_scheduled) {
+            return;
+        }
+        _scheduled = true;
+    }
+    _pool.post([self = shared_from_this()] { self->_drain(); });
+}
+
+//! \param[in] nthreads is the number of worker threads
+WorkPool::WorkPool(const size_t nthreads) {
+    for (size_t i = 0; i < nthreads; ++i) {
+        _workers.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < nthreads; ++i) {
+        _threads.emplace_back([this, i] { _work(i); });
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        const lock_guard<mutex> lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _sleep_cv.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+void WorkPool::post(Job job) {
+    const size_t index = tl_pool == this ? tl_worker : _next_worker++ % _workers.size();
+    {
+        Worker &worker = *_workers[index];
+        const lock_guard<mutex> lock(worker.mutex);
+        worker.jobs.push_back(move(job));
+    }
+    _queued++;
+    {
+        // taking the lock orders this with a worker that is about to sleep
+        const lock_guard<mutex> lock(_sleep_mutex);
+    }
+    _sleep_cv.notify_one();
+}
+
+bool WorkPool::_take(const size_t index, Job &job) {
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        Worker &victim = *_workers[(index + i) % _workers.size()];
+        const lock_guard<mutex> lock(victim.mutex);
+        if (victim.jobs.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            job = move(victim.jobs.back());
+            victim.jobs.pop_back();
+        } else {
+            job = move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+        _queued--;
+        return true;
+    }
+    return false;
+}
+
+//! \param[in] index is the worker this thread runs
+void WorkPool::_work(const size_t index) {
+    tl_pool = this;
+    tl_worker = index;
+
+    Job job;
+    while (true) {
+        if (_take(index, job)) {
+            run_job(job, "WorkPool");
+            job = nullptr;
+            continue;
+        }
+
+        unique_lock<mutex> lock(_sleep_mutex);
+        _sleep_cv.wait(lock, [&] { return _queued > 0 or _stopping; });
+        if (_queued == 0 and _stopping) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,151 @@
+#ifndef WORK_POOL
+#define WORK_POOL
+
+#include "eventfd.hh"
+#include "eventloop.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \brief A lock-free queue of closures, pushed by any thread and run on the EventLoop's thread
+//! \details Workers hand results back to the I/O thread by pushing a completion. The queue is
+//! Vyukov's intrusive multi-producer single-consumer list: a push is one atomic exchange, and the
+//! consumer never blocks a producer. The first push after the consumer has drained the queue
+//! notifies an EventFD, so a burst of completions costs one wakeup. A job that throws is reported on
+//! std::cerr, and the jobs behind it still run.
+class CompletionQueue {
+  public:
+    using Job = std::function<void()>;
+
+  private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        Job job{};
+    };
+
+    std::atomic<Node *> _head;  //!< last node pushed (producers)
+    Node *_tail;                //!< next node to pop (consumer)
+    Node _stub{};               //!< keeps the list non-empty
+    std::atomic<bool> _signaled{false};
+    EventFD _wakeup{};
+
+    void _push(Node *node);
+
+    //! Unlink the oldest node, or nullptr if the queue is (or appears, mid-push) empty
+    Node *_pop();
+
+  public:
+    CompletionQueue();
+    ~CompletionQueue();
+
+    CompletionQueue(const CompletionQueue &other) = delete;
+    CompletionQueue &operator=(const CompletionQueue &other) = delete;
+
+    //! Queue `job` to run on the consumer thread (callable from any thread)
+    void push(Job job);
+
+    //! Run every queued job, in the order each producer pushed them (consumer thread only)
+    //! \returns the number of jobs run
+    size_t run();
+
+    //! Add a rule to `loop` that runs queued jobs whenever some arrive
+    void install_rules(EventLoop &loop);
+};
+
+//! \brief A fixed set of worker threads that run jobs posted from the I/O thread (or from other jobs)
+//! \details Each worker owns a deque of jobs. A worker runs its own newest job first and, when its
+//! deque is empty, steals the oldest job of another worker, so a burst of work posted to one worker
+//! spreads across the pool. Jobs posted from outside the pool are dealt round-robin.
+//!
+//! Jobs posted directly to the pool run in no particular order; jobs posted to the same Strand run
+//! one at a time, in order. Give each connection its own Strand to keep its application processing
+//! ordered, while different connections proceed in parallel.
+//!
+//! A job that throws is reported on std::cerr; its worker, and its strand, go on to the next job.
+class WorkPool {
+  public:
+    using Job = std::function<void()>;
+
+    //! \brief A serial queue of jobs that runs on the pool's workers
+    class Strand : public std::enable_shared_from_this<Strand> {
+      private:
+        friend class WorkPool;
+
+        //! Jobs a strand runs before giving its worker back to other strands
+        static constexpr size_t BATCH = 16;
+
+        WorkPool &_pool;
+        std::mutex _mutex{};
+        std::deque<Job> _jobs{};
+        bool _scheduled = false;  //!< is a drain of this strand queued on (or running in) the pool?
+
+        explicit Strand(WorkPool &pool) : _pool(pool) {}
+
+        void _drain();
+
+      public:
+        //! Queue `job` to run after every job previously posted to this strand
+        void post(Job job);
+    };
+
+  private:
+    struct Worker {
+        std::mutex mutex{};
+        std::deque<Job> jobs{};
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers{};
+    std::vector<std::thread> _threads{};
+    std::atomic<size_t> _next_worker{0};  //!< round-robin cursor for posts from outside the pool
+    std::atomic<size_t> _queued{0};       //!< jobs in all workers' deques
+
+    std::mutex _sleep_mutex{};
+    std::condition_variable _sleep_cv{};
+    bool _stopping = false;
+
+    void _work(const size_t index);
+
+    //! Take a job: the newest of worker `index`'s own, else the oldest of another worker's
+    bool _take(const size_t index, Job &job);
+
+  public:
+    //! Start `nthreads` workers
+    explicit WorkPool(const size_t nthreads = std::max(1U, std::thread::hardware_concurrency()));
+
+    //! Run every job already posted, then join the workers
+    ~WorkPool();
+
+    WorkPool(const WorkPool &other) = delete;
+    WorkPool &operator=(const WorkPool &other) = delete;
+
+    //! Queue `job` to run on some worker
+    void post(Job job);
+
+    //! A new serial queue, e.g. one per connection
+    std::shared_ptr<Strand> make_strand() { return std::shared_ptr<Strand>(new Strand(*this)); }
+
+    //! Number of worker threads
+    size_t size() const { return _threads.size(); }
+};
+
+//! \class WorkPool
+//! Protocol processing stays on the I/O thread; only application work is handed to the pool. E.g., to
+//! encrypt what a TUNConnection reads without stalling the packet loop:
+//!
+//! ~~~{.cpp}
+//! // on the I/O thread
+//! strand->post([&, data = conn->read()] {
+//!     // on a worker, in order with this connection's other jobs
+//!     completions.push([&, out = encrypt(data)] { peer->write(out); });  // back on the I/O thread
+//! });
+//! ~~~
+
+#endif /* WORK_POOL */
@@ -0,0 +1,107 @@
+#include "connection_harness.hh"
+#include "tcp_autotuner.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! Send from `a` to `b` for `rounds` ticks, as fast as the windows allow; returns the bytes received
+static size_t transfer(TCPConnection &a, TCPConnection &b, const unsigned rounds) {
+    size_t received = 0;
+    for (unsigned round = 0; round < rounds; ++round) {
+        a.write(string(a.remaining_outbound_capacity(), 'x'));
+        deliver(a, b);
+        received += b.inbound_stream().read(b.inbound_stream().buffer_size()).size();
+        b.window_update();
+        deliver(b, a);
+        a.tick(1);
+        b.tick(1);
+    }
+    return received;
+}
+
+//! Stop writing, and let `a` and `b` idle (once what was written is received) for `rounds` ticks
+static void idle(TCPConnection &a, TCPConnection &b, const unsigned rounds) {
+    for (unsigned round = 0; round < rounds; ++round) {
+        deliver(a, b);
+        b.inbound_stream().read(b.inbound_stream().buffer_size());
+        b.window_update();
+        deliver(b, a);
+        a.tick(1);
+        b.tick(1);
+    }
+}
+
+int main() {
+    try {
+        TCPConfig cfg;
+        cfg.autotune = true;
+        cfg.send_capacity = TCPConfig::AUTOTUNE_MIN_CAPACITY;
+
+        // the send capacity grows with a flow it holds back, and shrinks back to the initial one only
+        // once the flow has idled for a while; the receive capacity is left alone
+        {
+            const size_t before = TCPAutotuner::in_use();
+            TCPConnection a{cfg}, b{cfg};
+            test_err_if(TCPAutotuner::in_use() != before + 2 * TCPConfig::AUTOTUNE_MIN_CAPACITY,
+                        "initial capacities not charged to the budget");
+            handshake(a, b);
+
+            transfer(a, b, 100);
+            test_err_if(a.send_capacity() < 2 * TCPConfig::DEFAULT_CAPACITY, "send capacity didn't grow to the window");
+            test_err_if(a.send_capacity() > cfg.max_send_capacity, "send capacity grew past its limit");
+            test_err_if(b.recv_capacity() != cfg.recv_capacity, "receive capacity changed");
+            test_err_if(TCPAutotuner::in_use() != before + a.send_capacity() + b.send_capacity(),
+                        "growth not charged to the budget");
+
+            const size_t grown = a.send_capacity();
+            idle(a, b, 2);
+            test_err_if(a.send_capacity() != grown, "capacity shrank after a round trip of idleness");
+            idle(a, b, 2 * TCPAutotuner::IDLE_EPOCHS);
+            test_err_if(a.send_capacity() != cfg.send_capacity, "idle capacity not back to the initial one");
+            test_err_if(TCPAutotuner::in_use() != before + 2 * TCPConfig::AUTOTUNE_MIN_CAPACITY,
+                        "shrinking not returned to the budget");
+        }
+
+        // an idle connection keeps the capacity it was configured with
+        {
+            TCPConfig big = cfg;
+            big.send_capacity = TCPConfig::DEFAULT_CAPACITY;
+            TCPConnection a{big}, b{big};
+            handshake(a, b);
+            idle(a, b, 2 * TCPAutotuner::IDLE_EPOCHS);
+            test_err_if(a.send_capacity() != TCPConfig::DEFAULT_CAPACITY,
+                        "idle connection shrank below its configuration");
+        }
+
+        // growth stops at the budget, and a connection that doesn't fit in it starts at the minimum
+        {
+            const size_t before = TCPAutotuner::in_use();
+            TCPAutotuner::set_budget(before + 3 * TCPConfig::AUTOTUNE_MIN_CAPACITY);
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            test_err_if(transfer(a, b, 100) == 0, "transfer stalled at the budget");
+            test_err_if(TCPAutotuner::in_use() > TCPAutotuner::budget(), "budget exceeded");
+            test_err_if(a.send_capacity() > 2 * TCPConfig::AUTOTUNE_MIN_CAPACITY, "grew past the budget");
+
+            TCPConfig big = cfg;
+            big.send_capacity = TCPConfig::DEFAULT_CAPACITY;
+            const TCPConnection c{big};
+            test_err_if(c.send_capacity() != TCPConfig::AUTOTUNE_MIN_CAPACITY,
+                        "connection over the budget not started at the minimum");
+            TCPAutotuner::set_budget(TCPConfig::AUTOTUNE_BUDGET);
+        }
+        test_err_if(TCPAutotuner::in_use() != 0, "capacity not returned to the budget");
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
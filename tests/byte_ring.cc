@@ -0,0 +1,86 @@
+#include "byte_ring.hh"
+#include "eventfd.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace std;
+
+static constexpr size_t STREAM_LEN = 4 * 1024 * 1024;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // capacity rounds up to a power of two; pushes beyond it are refused
+        {
+            ByteRing ring{1000};
+            test_err_if(ring.capacity() != 1024, "capacity not rounded up");
+            test_err_if(ring.push(string(1500, 'x')) != 1024, "push beyond capacity");
+            test_err_if(ring.free_space() != 0, "full ring has free space");
+
+            string out;
+            test_err_if(ring.pop(out, 1000) != 1000 or ring.size() != 24, "pop");
+            test_err_if(ring.push("abcdef") != 6, "push after wrap");
+            out.clear();
+            test_err_if(ring.pop(out, 100) != 30 or out != string(24, 'x') + "abcdef", "pop across the wrap");
+            test_err_if(ring.eof(), "eof before close");
+            ring.close();
+            test_err_if(not ring.eof(), "no eof after close");
+        }
+
+        // one producer and one consumer thread, waking each other through eventfds
+        {
+            string stream(STREAM_LEN, 0);
+            for (auto &ch : stream) {
+                ch = rd();
+            }
+
+            ByteRing ring{4096};
+            EventFD data_ready, space_ready;
+
+            thread producer([&] {
+                string_view remaining{stream};
+                auto prd = get_random_generator();
+                while (not remaining.empty()) {
+                    const size_t pushed = ring.push(remaining.substr(0, 1 + prd() % 3000));
+                    remaining.remove_prefix(pushed);
+                    if (pushed > 0) {
+                        data_ready.notify();
+                    } else {
+                        space_ready.wait();
+                    }
+                }
+                ring.close();
+                data_ready.notify();
+            });
+
+            string received;
+            received.reserve(STREAM_LEN);
+            while (true) {
+                const bool closed = ring.closed();
+                if (ring.pop(received, 1 + rd() % 5000) > 0) {
+                    space_ready.notify();
+                } else if (closed) {
+                    break;
+                } else {
+                    data_ready.wait();
+                }
+            }
+            producer.join();
+
+            test_err_if(received != stream, "bytes received differ from bytes sent");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
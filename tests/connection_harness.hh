@@ -0,0 +1,42 @@
+#ifndef SPONGE_CONNECTION_HARNESS_HH
+#define SPONGE_CONNECTION_HARNESS_HH
+
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_segment.hh"
+#include "wrapping_integers.hh"
+
+#include <cstddef>
+#include <string>
+
+// Helpers for tests that join two TCPConnections back to back, with no network in between
+
+//! Hand every segment `from` has queued to `to`, dropping payloads larger than `path_mss`
+inline void deliver(TCPConnection &from, TCPConnection &to, const size_t path_mss = TCPConfig::MAX_MSS) {
+    for (; not from.segments_out().empty(); from.segments_out().pop()) {
+        if (from.segments_out().front().payload().size() <= path_mss) {
+            to.segment_received(from.segments_out().front());
+        }
+    }
+}
+
+//! Connect `a` to `b`: a's SYN, b's SYN/ACK and a's ACK
+inline void handshake(TCPConnection &a, TCPConnection &b) {
+    a.connect();
+    deliver(a, b);
+    deliver(b, a);
+    deliver(a, b);
+}
+
+//! A data segment with ACK set, advertising the default window
+inline TCPSegment data_segment(const WrappingInt32 seqno, const WrappingInt32 ackno, const std::string &payload) {
+    TCPSegment seg;
+    seg.header().seqno = seqno;
+    seg.header().ackno = ackno;
+    seg.header().ack = true;
+    seg.header().win = TCPConfig::DEFAULT_CAPACITY;
+    seg.payload() = std::string(payload);
+    return seg;
+}
+
+#endif  // SPONGE_CONNECTION_HARNESS_HH
@@ -0,0 +1,99 @@
+#include "flow_key.hh"
+#include "ipv4_datagram.hh"
+#include "metrics.hh"
+#include "tcp_config.hh"
+#include "test_err_if.hh"
+#include "tun_adapter.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+//! What `from` sends `seg` as, parsed back into a datagram
+static InternetDatagram wrapped(TCPOverIPv4Adapter &from, TCPSegment seg) {
+    InternetDatagram dgram;
+    test_err_if(dgram.parse(from.wrap_tcp_in_ip(seg).serialize().concatenate()) != ParseResult::NoError,
+                "wrapped datagram doesn't parse");
+    return dgram;
+}
+
+int main() {
+    try {
+        FdAdapterConfig client_cfg;
+        client_cfg.source = {"169.254.144.9", 40000};
+        client_cfg.destination = {"169.254.144.1", 9090};
+        FdAdapterConfig server_cfg;
+        server_cfg.source = client_cfg.destination;
+        server_cfg.destination = client_cfg.source;
+
+        // the key is taken from the Addresses once, in host byte order
+        {
+            const FlowKey k = FlowKey::from(client_cfg);
+            test_err_if(k.local_address != 0xa9fe9009 or k.remote_address != 0xa9fe9001, "wrong addresses");
+            test_err_if(k.local_port != 40000 or k.remote_port != 9090, "wrong ports");
+            test_err_if(k == FlowKey::from(server_cfg), "a flow equals its reverse");
+
+            unordered_set<size_t> hashes;
+            for (uint16_t port = 1; port <= 1000; ++port) {
+                FlowKey other = k;
+                other.remote_port = port;
+                hashes.insert(FlowKeyHash{}(other));
+            }
+            test_err_if(hashes.size() != 1000, "hash collisions between neighbouring ports");
+        }
+
+        TCPOverIPv4Adapter client, server;
+        client.set_config(client_cfg);
+        server.set_config(server_cfg);
+
+        // headers are filled from the cached key, and the peer matches them
+        {
+            TCPSegment seg;
+            seg.header().syn = true;
+            const InternetDatagram dgram = wrapped(client, seg);
+            test_err_if(dgram.header().src != 0xa9fe9009 or dgram.header().dst != 0xa9fe9001, "wrong IPv4 addresses");
+            const auto received = server.unwrap_tcp_in_ip(dgram);
+            test_err_if(not received or received->header().sport != 40000 or received->header().dport != 9090,
+                        "segment not accepted by its peer");
+        }
+
+        // another flow's segments are demultiplexed away
+        {
+            const uint64_t misses = StackMetrics::snapshot().demux_misses;
+            FdAdapterConfig stranger_cfg = client_cfg;
+            stranger_cfg.source = {"169.254.144.9", 40001};
+            TCPOverIPv4Adapter stranger;
+            stranger.set_config(stranger_cfg);
+            test_err_if(server.unwrap_tcp_in_ip(wrapped(stranger, TCPSegment{})).has_value(),
+                        "segment from the wrong port accepted");
+            test_err_if(StackMetrics::snapshot().demux_misses != misses + 1, "demux miss not counted");
+        }
+
+        // a listening adapter takes its flow from the first SYN
+        {
+            FdAdapterConfig listen_cfg;
+            listen_cfg.source = {"0", 9090};
+            TCPOverIPv4Adapter listener;
+            listener.set_config(listen_cfg);
+            listener.set_listening(true);
+
+            TCPSegment syn;
+            syn.header().syn = true;
+            test_err_if(not listener.unwrap_tcp_in_ip(wrapped(client, syn)), "SYN not accepted");
+            test_err_if(listener.flow() != FlowKey::from(server_cfg), "listener's flow not taken from the SYN");
+            test_err_if(listener.config().destination.to_string() != "169.254.144.9:40000",
+                        "listener's config not updated");
+            test_err_if(not listener.unwrap_tcp_in_ip(wrapped(client, TCPSegment{})), "peer's next segment refused");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
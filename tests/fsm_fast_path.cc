@@ -0,0 +1,105 @@
+#include "tcp_config.hh"
+#include "tcp_expectation.hh"
+#include "tcp_fsm_test_harness.hh"
+#include "tcp_header.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using State = TCPTestHarness::State;
+
+static constexpr unsigned NREPS = 32;
+static constexpr size_t SEG_SIZE = 40;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        TCPConfig cfg{};
+
+        // test 1: in-order data and pure ACKs take the fast path, and behave as before
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            const WrappingInt32 tx_isn(rd()), rx_isn(rd());
+            TCPTestHarness test_1 = TCPTestHarness::in_established(cfg, tx_isn, rx_isn);
+
+            string d(3 * SEG_SIZE, 0);
+            generate(d.begin(), d.end(), [&] { return rd(); });
+
+            // in-order data: appended to the stream and ACKed
+            for (size_t offset = 0; offset < d.size(); offset += SEG_SIZE) {
+                const size_t hits = test_1._fsm.fast_path_hits();
+                test_1.send_data(rx_isn + 1 + offset, tx_isn + 1, d.cbegin() + offset, d.cbegin() + offset + SEG_SIZE);
+                test_1.execute(ExpectOneSegment{}.with_ack(true).with_ackno(rx_isn + 1 + offset + SEG_SIZE),
+                               "test 1 failed: in-order data not ACKed");
+                test_1.execute(ExpectData{}.with_data(d.substr(offset, SEG_SIZE)), "test 1 failed: data mismatch");
+                test_err_if(test_1._fsm.fast_path_hits() != hits + 1, "test 1 failed: in-order data missed fast path");
+            }
+
+            // pure ACK of new data
+            test_1.execute(Write{"hello"});
+            test_1.execute(ExpectOneSegment{}.with_payload_size(5).with_seqno(tx_isn + 1));
+            const size_t hits = test_1._fsm.fast_path_hits();
+            test_1.send_ack(rx_isn + 1 + d.size(), tx_isn + 1 + 5);
+            test_1.execute(ExpectNoSegment{}, "test 1 failed: pure ACK was ACKed");
+            test_1.execute(ExpectBytesInFlight{0}, "test 1 failed: pure ACK not processed");
+            test_err_if(test_1._fsm.fast_path_hits() != hits + 1, "test 1 failed: pure ACK missed fast path");
+            test_1.execute(ExpectState{State::ESTABLISHED});
+        }
+
+        // test 2: out-of-order data and duplicate ACKs take the full path
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            const WrappingInt32 tx_isn(rd()), rx_isn(rd());
+            TCPTestHarness test_2 = TCPTestHarness::in_established(cfg, tx_isn, rx_isn);
+
+            string d(2 * SEG_SIZE, 0);
+            generate(d.begin(), d.end(), [&] { return rd(); });
+
+            test_2.send_data(rx_isn + 1 + SEG_SIZE, tx_isn + 1, d.cbegin() + SEG_SIZE, d.cend());
+            test_2.execute(ExpectOneSegment{}.with_ack(true).with_ackno(rx_isn + 1),
+                           "test 2 failed: out-of-order data not ACKed");
+            test_2.execute(ExpectUnassembledBytes{SEG_SIZE});
+
+            // fills the hole, but the reassembler holds data: full path
+            test_2.send_data(rx_isn + 1, tx_isn + 1, d.cbegin(), d.cbegin() + SEG_SIZE);
+            test_2.execute(ExpectOneSegment{}.with_ack(true).with_ackno(rx_isn + 1 + d.size()),
+                           "test 2 failed: hole-filling data not ACKed");
+            test_2.execute(ExpectData{}.with_data(d), "test 2 failed: data mismatch");
+
+            // duplicate ACK
+            test_2.send_ack(rx_isn + 1 + d.size(), tx_isn + 1);
+            test_2.execute(ExpectNoSegment{});
+
+            test_err_if(test_2._fsm.fast_path_hits() != 0, "test 2 failed: fast path taken");
+        }
+
+        // test 3: in-order data that reaches a FIN which arrived early ends the stream
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            const WrappingInt32 tx_isn(rd()), rx_isn(rd());
+            TCPTestHarness test_3 = TCPTestHarness::in_established(cfg, tx_isn, rx_isn);
+
+            string d(SEG_SIZE, 0);
+            generate(d.begin(), d.end(), [&] { return rd(); });
+
+            test_3.send_fin(rx_isn + 1 + SEG_SIZE, tx_isn + 1);
+            test_3.execute(ExpectOneSegment{}.with_ack(true).with_ackno(rx_isn + 1),
+                           "test 3 failed: early FIN not ACKed");
+            test_3.send_data(rx_isn + 1, tx_isn + 1, d.cbegin(), d.cend());
+            test_3.execute(ExpectOneSegment{}.with_ack(true).with_ackno(rx_isn + 1 + SEG_SIZE + 1),
+                           "test 3 failed: FIN not ACKed with the data before it");
+            test_3.execute(ExpectData{}.with_data(d), "test 3 failed: data mismatch");
+            test_3.execute(ExpectState{State::CLOSE_WAIT});
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+#include "fast_parser.hh"
+#include "ipv4_datagram.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_header.hh"
+#include "tcp_config.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static constexpr unsigned NREPS = 1024;
+
+static TCPHeader random_tcp_header(mt19937 &rd) {
+    TCPHeader h;
+    h.sport = rd();
+    h.dport = rd();
+    h.seqno = WrappingInt32{static_cast<uint32_t>(rd())};
+    h.ackno = WrappingInt32{static_cast<uint32_t>(rd())};
+    h.urg = rd() & 1;
+    h.ack = rd() & 1;
+    h.psh = rd() & 1;
+    h.rst = rd() & 1;
+    h.syn = rd() & 1;
+    h.fin = rd() & 1;
+    h.win = rd();
+    h.uptr = rd();
+    return h;
+}
+
+static string random_payload(mt19937 &rd) {
+    string payload(rd() % 1500, 0);
+    for (auto &ch : payload) {
+        ch = rd();
+    }
+    return payload;
+}
+
+//! Build a complete IPv4 datagram carrying a TCP segment, the slow way
+static string build_datagram(mt19937 &rd, TCPSegment &seg, IPv4Header &ip) {
+    ip.src = rd();
+    ip.dst = rd();
+    ip.id = rd();
+    ip.ttl = rd();
+    ip.len = IPv4Header::LENGTH + TCPHeader::LENGTH + seg.payload().size();
+
+    IPv4Datagram dgram;
+    dgram.header() = ip;
+    dgram.payload() = seg.serialize(ip.pseudo_cksum());
+    return dgram.serialize().concatenate();
+}
+
+static bool same_ip(const IPv4Header &a, const IPv4Header &b) {
+    return a.ver == b.ver && a.hlen == b.hlen && a.tos == b.tos && a.len == b.len && a.id == b.id && a.df == b.df &&
+           a.mf == b.mf && a.offset == b.offset && a.ttl == b.ttl && a.proto == b.proto && a.cksum == b.cksum &&
+           a.src == b.src && a.dst == b.dst;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // fast and generic parsers agree on well-formed datagrams
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            TCPSegment seg;
+            seg.header() = random_tcp_header(rd);
+            seg.payload() = Buffer{random_payload(rd)};
+
+            IPv4Header ip;
+            const string wire = build_datagram(rd, seg, ip);
+
+            IPv4Header slow_ip;
+            NetParser p{Buffer{string(wire)}};
+            test_err_if(slow_ip.parse(p) != ParseResult::NoError, "generic IPv4 parse failed");
+
+            IPv4Datagram dgram;
+            test_err_if(dgram.parse(Buffer{string(wire)}) != ParseResult::NoError, "fast IPv4 parse failed");
+            test_err_if(not same_ip(slow_ip, dgram.header()), "IPv4 headers differ");
+            test_err_if(dgram.payload().concatenate() != p.buffer().copy(), "IPv4 payloads differ");
+
+            TCPHeader slow_tcp;
+            NetParser tp{p.buffer()};
+            test_err_if(slow_tcp.parse(tp) != ParseResult::NoError, "generic TCP parse failed");
+
+            TCPSegment fast_seg;
+            test_err_if(fast_seg.parse(dgram.payload().concatenate(), dgram.header().pseudo_cksum()) !=
+                            ParseResult::NoError,
+                        "fast TCP parse failed");
+            test_err_if(not(fast_seg.header() == slow_tcp) or fast_seg.header().sport != slow_tcp.sport or
+                            fast_seg.header().dport != slow_tcp.dport or fast_seg.header().cksum != slow_tcp.cksum,
+                        "TCP headers differ");
+            test_err_if(fast_seg.payload().copy() != seg.payload().copy(), "TCP payloads differ");
+        }
+
+        // serializing into payload headroom produces the same bytes as the legacy path
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            TCPSegment seg;
+            seg.header() = random_tcp_header(rd);
+            string payload = random_payload(rd);
+            seg.payload() = Buffer{string(payload)};
+
+            IPv4Header ip;
+            const string wire = build_datagram(rd, seg, ip);
+            ip.cksum = 0;
+
+            TCPSegment in_place;
+            in_place.header() = seg.header();
+            in_place.payload() = Buffer{string(TCPConfig::HEADROOM, 0) + payload, TCPConfig::HEADROOM};
+
+            Buffer tcp_part = in_place.serialize_in_place(ip.pseudo_cksum());
+            test_err_if(tcp_part.copy() != wire.substr(IPv4Header::LENGTH), "in-place TCP serialization differs");
+            test_err_if(IPv4Datagram::serialize_in_place(ip, tcp_part).copy() != wire,
+                        "in-place IPv4 serialization differs");
+            test_err_if(in_place.payload().copy() != payload, "in-place serialization changed the payload");
+
+            // the BufferList path copies, leaving the headroom alone
+            TCPSegment untouched;
+            untouched.header() = seg.header();
+            untouched.payload() = Buffer{string(TCPConfig::HEADROOM, 0) + payload, TCPConfig::HEADROOM};
+            test_err_if(untouched.serialize(ip.pseudo_cksum()).concatenate() != wire.substr(IPv4Header::LENGTH),
+                        "TCP serialize with headroom differs");
+            test_err_if(untouched.payload().expand_into_headroom(TCPConfig::HEADROOM).copy() !=
+                            string(TCPConfig::HEADROOM, 0) + payload,
+                        "TCP serialize wrote into the headroom");
+        }
+
+        // malformed datagrams are rejected with the same reasons
+        {
+            TCPSegment seg;
+            seg.header() = random_tcp_header(rd);
+            IPv4Header ip;
+            const string wire = build_datagram(rd, seg, ip);
+
+            IPv4Datagram dgram;
+            test_err_if(dgram.parse(Buffer{wire.substr(0, 12)}) != ParseResult::PacketTooShort,
+                        "short datagram accepted");
+            test_err_if(dgram.parse(Buffer{wire.substr(0, wire.size() - 1)}) != ParseResult::TruncatedPacket,
+                        "truncated datagram accepted");
+
+            string bad_version = wire;
+            bad_version[0] = char(0x65);
+            test_err_if(dgram.parse(Buffer{move(bad_version)}) != ParseResult::WrongIPVersion,
+                        "wrong IP version accepted");
+
+            string bad_cksum = wire;
+            bad_cksum[8] ^= 1;
+            test_err_if(dgram.parse(Buffer{move(bad_cksum)}) != ParseResult::BadChecksum, "bad checksum accepted");
+
+            TCPSegment short_seg;
+            test_err_if(short_seg.parse(Buffer{string(TCPHeader::LENGTH - 1, 0)}) == ParseResult::NoError,
+                        "short segment accepted");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#include "flow_key.hh"
+#include "header_template.hh"
+#include "ipv4_datagram.hh"
+#include "tcp_config.hh"
+#include "tcp_header.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+#include "tun_adapter.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static constexpr unsigned NREPS = 1024;
+
+//! A segment as TCPSender makes them: random fields, and a payload with HEADROOM bytes of headroom
+static TCPSegment random_segment(mt19937 &rd) {
+    TCPSegment seg;
+    TCPHeader &h = seg.header();
+    h.seqno = WrappingInt32{static_cast<uint32_t>(rd())};
+    h.ackno = WrappingInt32{static_cast<uint32_t>(rd())};
+    h.ack = rd() & 1;
+    h.psh = rd() & 1;
+    h.rst = rd() & 1;
+    h.fin = rd() & 1;
+    h.win = rd();
+    string payload(TCPConfig::HEADROOM + rd() % 1500, 0);
+    for (auto &ch : payload) {
+        ch = rd();
+    }
+    seg.payload() = Buffer{move(payload), TCPConfig::HEADROOM};
+    return seg;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // the template writes the datagrams the generic serializers would
+        for (unsigned rep_no = 0; rep_no < NREPS; ++rep_no) {
+            const FlowKey flow{static_cast<uint32_t>(rd()), static_cast<uint32_t>(rd()), static_cast<uint16_t>(rd()),
+                               static_cast<uint16_t>(rd())};
+            HeaderTemplate tmpl{flow};
+            TCPSegment seg = random_segment(rd);
+            seg.header().sport = flow.local_port;
+            seg.header().dport = flow.remote_port;
+            test_err_if(not HeaderTemplate::fits(seg), "segment doesn't fit the template");
+
+            IPv4Header ip;
+            ip.src = flow.local_address;
+            ip.dst = flow.remote_address;
+            ip.len = IPv4Header::LENGTH + TCPHeader::LENGTH + seg.payload().size();
+            InternetDatagram expected;
+            expected.header() = ip;
+            expected.payload() = seg.serialize(ip.pseudo_cksum()).concatenate();
+            const string wire = expected.serialize().concatenate();
+
+            test_err_if(tmpl.write(seg.header(), seg.payload()).copy() != wire, "template datagram differs");
+            InternetDatagram parsed;
+            test_err_if(parsed.parse(Buffer{string(wire)}) != ParseResult::NoError, "template datagram doesn't parse");
+            TCPSegment parsed_seg;
+            test_err_if(parsed_seg.parse(parsed.payload().concatenate(), parsed.header().pseudo_cksum()) !=
+                            ParseResult::NoError,
+                        "template segment doesn't parse");
+        }
+
+        // segments with options, or without the headroom, don't fit
+        {
+            TCPSegment syn;
+            syn.header().syn = true;
+            syn.header().mss = 1460;
+            syn.header().doff = TCPHeader::MSS_LENGTH / 4;
+            syn.payload() = Buffer{string(TCPConfig::HEADROOM, 0), TCPConfig::HEADROOM};
+            test_err_if(HeaderTemplate::fits(syn), "segment with options fits");
+            TCPSegment no_headroom;
+            no_headroom.payload() = string("data");
+            test_err_if(HeaderTemplate::fits(no_headroom), "segment without headroom fits");
+        }
+
+        // an adapter's datagrams, from the template or not, match its flow
+        {
+            FdAdapterConfig cfg;
+            cfg.source = {"169.254.144.9", 40000};
+            cfg.destination = {"169.254.144.1", 9090};
+            TCPOverIPv4Adapter adapter;
+            adapter.set_config(cfg);
+            for (const bool syn : {false, true}) {
+                TCPSegment seg;
+                seg.header().ack = true;
+                seg.header().syn = syn;
+                seg.header().mss = syn ? 1460 : 0;
+                seg.header().doff = (syn ? TCPHeader::MSS_LENGTH : TCPHeader::LENGTH) / 4;
+                const optional<Buffer> dgram = adapter.wrap_tcp_in_ip_in_place(seg);
+                // (HEADROOM leaves room for a SYN's MSS option too)
+                test_err_if(not dgram.has_value(), "header-only segment not wrapped in place");
+                const string wire = dgram->copy();
+                InternetDatagram parsed;
+                test_err_if(parsed.parse(Buffer{string(wire)}) != ParseResult::NoError, "datagram doesn't parse");
+                const optional<TCPSegment> unwrapped = adapter.unwrap_tcp_in_ip(parsed);
+                test_err_if(unwrapped.has_value(), "own datagram accepted as the peer's");
+                test_err_if(parsed.header().src != adapter.flow().local_address or
+                                parsed.header().dst != adapter.flow().remote_address,
+                            "wrong addresses");
+                TCPSegment parsed_seg;
+                test_err_if(parsed_seg.parse(parsed.payload().concatenate(), parsed.header().pseudo_cksum()) !=
+                                ParseResult::NoError,
+                            "segment doesn't parse");
+                test_err_if(parsed_seg.header().sport != 40000 or parsed_seg.header().dport != 9090 or
+                                parsed_seg.header().syn != syn,
+                            "wrong segment");
+            }
+        }
+
+        // pure ACKs reuse the adapter's headroom, unless a datagram written into it is still held
+        {
+            FdAdapterConfig cfg;
+            cfg.source = {"169.254.144.9", 40000};
+            cfg.destination = {"169.254.144.1", 9090};
+            TCPOverIPv4Adapter adapter;
+            adapter.set_config(cfg);
+            TCPSegment ack;
+            ack.header().ack = true;
+            ack.header().ackno = WrappingInt32{1};
+            const char *first = adapter.wrap_tcp_in_ip_in_place(ack)->str().data();
+            test_err_if(adapter.wrap_tcp_in_ip_in_place(ack)->str().data() != first, "headroom not reused");
+
+            const optional<Buffer> held = adapter.wrap_tcp_in_ip_in_place(ack);
+            const string wire = held->copy();
+            ack.header().ackno = WrappingInt32{2};
+            const optional<Buffer> next = adapter.wrap_tcp_in_ip_in_place(ack);
+            test_err_if(next->str().data() == held->str().data(), "headroom of a held datagram reused");
+            test_err_if(held->copy() != wire, "held datagram overwritten");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include "ephemeral_ports.hh"
+#include "isn_generator.hh"
+#include "siphash.hh"
+#include "test_err_if.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <numeric>
+#include <set>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        const SipKey key{0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+
+        // reference vectors: key 00..0f, message 00..(len - 1)
+        {
+            string msg(64, 0);
+            iota(msg.begin(), msg.end(), 0);
+            test_err_if(siphash24(key, msg.data(), 0) != 0x726fdb47dd0e0e31ULL, "SipHash of 0 bytes");
+            test_err_if(siphash24(key, msg.data(), 7) != 0xab0200f58b01d137ULL, "SipHash of 7 bytes");
+            test_err_if(siphash24(key, msg.data(), 8) != 0x93f5f5799a932462ULL, "SipHash of 8 bytes");
+            test_err_if(siphash24(key, msg.data(), 15) != 0xa129ca6149be45e5ULL, "SipHash of 15 bytes");
+            test_err_if(siphash24(key, msg.data(), 63) != 0x958a324ceb064572ULL, "SipHash of 63 bytes");
+        }
+
+        const FlowKey flow{0xa9fe9009, 0xa9fe9001, 40000, 9090};
+
+        // ISNs of a flow advance with the 4 µs clock; other flows and other keys are unrelated
+        {
+            ISNGenerator isns{key};
+            const WrappingInt32 isn = isns.isn(flow, 1000);
+            test_err_if(isns.isn(flow, 1000) != isn, "ISN isn't a function of the flow and the time");
+            test_err_if(isns.isn(flow, 1400) != isn + 100, "ISN doesn't tick every 4 us");
+
+            FlowKey next_port = flow;
+            next_port.local_port++;
+            test_err_if(isns.isn(next_port, 1000) - isn < 1000 and isn - isns.isn(next_port, 1000) < 1000,
+                        "neighbouring flows have neighbouring ISNs");
+            ISNGenerator other{SipKey{1, 2}};
+            test_err_if(other.isn(flow, 1000) == isn, "the key doesn't change the ISN");
+
+            set<uint32_t> seen;
+            for (int i = 0; i < 1000; ++i) {
+                seen.insert(isns.unpredictable().raw_value());
+            }
+            test_err_if(seen.size() != 1000, "unpredictable() repeated itself");
+        }
+
+        // ports are unique per destination, and every one of them can be allocated
+        {
+            EphemeralPorts ports{key};
+            set<uint16_t> allocated;
+            for (size_t i = 0; i < EphemeralPorts::COUNT; ++i) {
+                const auto port = ports.allocate(flow);
+                test_err_if(not port, "ran out of ports after " + to_string(i));
+                test_err_if(*port < EphemeralPorts::FIRST, "port outside the ephemeral range");
+                test_err_if(not allocated.insert(*port).second, "port allocated twice: " + to_string(*port));
+            }
+            test_err_if(ports.allocate(flow).has_value(), "allocated a port to a full destination");
+            test_err_if(ports.in_use(flow) != EphemeralPorts::COUNT, "wrong count of ports in use");
+
+            FlowKey elsewhere = flow;
+            elsewhere.remote_port = 9091;
+            test_err_if(not ports.allocate(elsewhere), "another destination shares the bitmap");
+
+            FlowKey freed = flow;
+            freed.local_port = 50000;
+            ports.release(freed);
+            const auto again = ports.allocate(flow);
+            test_err_if(not again or *again != 50000, "released port not allocated again");
+        }
+
+        // a reserved port is skipped, and consecutive allocations differ
+        {
+            EphemeralPorts ports{key};
+            const auto first = ports.allocate(flow);
+            FlowKey chosen = flow;
+            chosen.local_port = *first + 1;
+            test_err_if(not ports.reserve(chosen), "reserving a free port failed");
+            test_err_if(ports.reserve(chosen), "reserved a port twice");
+            const auto second = ports.allocate(flow);
+            test_err_if(not second or *second == *first or *second == chosen.local_port, "collision");
+
+            chosen.local_port = 80;
+            test_err_if(not ports.reserve(chosen) or not ports.reserve(chosen), "well-known ports are tracked");
+
+            chosen.local_port = *first;
+            ports.release(chosen);
+            chosen.local_port = *second;
+            ports.release(chosen);
+            chosen.local_port = *first + 1;
+            ports.release(chosen);
+            test_err_if(ports.in_use(flow) != 0, "ports still in use after release");
+
+            // the forgotten destination's bitmap, reused for another, has every port free
+            FlowKey elsewhere = flow;
+            elsewhere.remote_port = 9091;
+            for (size_t i = 0; i < EphemeralPorts::COUNT; ++i) {
+                test_err_if(not ports.allocate(elsewhere), "reused bitmap has ports in use");
+            }
+            test_err_if(ports.in_use(flow) != 0, "destinations share a bitmap");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
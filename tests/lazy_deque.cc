@@ -0,0 +1,106 @@
+#include "byte_stream.hh"
+#include "lazy_deque.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_segment.hh"
+#include "test_err_if.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main() {
+    try {
+        // allocated on the first push, and only freed by trim() once empty
+        {
+            LazyDeque<int> q;
+            test_err_if(not q.empty() or q.size() != 0 or q.allocated(), "new LazyDeque not empty");
+            test_err_if(q.begin() != q.end(), "empty LazyDeque iterates");
+            for (int i = 0; i < 1000; ++i) {
+                q.push_back(i);
+            }
+            test_err_if(not q.allocated() or q.size() != 1000 or q.front() != 0 or q.back() != 999, "wrong contents");
+            test_err_if(accumulate(q.begin(), q.end(), 0) != 999 * 1000 / 2, "wrong iteration");
+            q.trim();
+            test_err_if(not q.allocated() or q.size() != 1000, "trim() freed a LazyDeque in use");
+
+            LazyDeque<int> copy = q;
+            while (not q.empty()) {
+                q.pop_front();
+            }
+            test_err_if(not q.allocated(), "freed before trim()");
+            q.trim();
+            test_err_if(q.allocated() or not q.empty(), "trim() didn't free an empty LazyDeque");
+            test_err_if(copy.size() != 1000 or copy.front() != 0, "copy shares its elements");
+
+            const LazyDeque<int> &none = q;
+            test_err_if(none.begin() != none.end(), "trimmed LazyDeque iterates");
+            test_err_if(distance(q.begin(), q.end()) != 0, "trimmed LazyDeque iterates");
+            q.emplace_back(7);
+            test_err_if(q.size() != 1 or q.front() != 7, "LazyDeque not usable after trim()");
+        }
+
+        // as a std::queue's container
+        {
+            SegmentQueue segments;
+            segments.push(TCPSegment{});
+            segments.emplace().header().seqno = WrappingInt32{5};
+            test_err_if(segments.size() != 2 or segments.back().header().seqno != WrappingInt32{5}, "wrong back");
+            segments.pop();
+            segments.pop();
+            segments.trim();
+            test_err_if(not segments.empty(), "SegmentQueue not empty");
+        }
+
+        // a ByteStream that is drained and trimmed keeps working
+        {
+            ByteStream stream{100};
+            stream.write("hello");
+            stream.trim();
+            test_err_if(stream.read(5) != "hello", "trim() dropped bytes");
+            stream.trim();
+            stream.write(string("world"));
+            test_err_if(stream.buffer_size() != 5 or stream.read(5) != "world", "stream broken after trim()");
+        }
+
+        // connections that tick between every exchange carry data as before
+        {
+            TCPConfig cfg;
+            TCPConnection x{cfg}, y{cfg};
+            const auto deliver = [](TCPConnection &from, TCPConnection &to) {
+                for (; not from.segments_out().empty(); from.segments_out().pop()) {
+                    to.segment_received(from.segments_out().front());
+                }
+                from.tick(1);
+                to.tick(1);
+            };
+            x.connect();
+            deliver(x, y);
+            deliver(y, x);
+            string received;
+            for (int i = 0; i < 100; ++i) {
+                x.write(to_string(i));
+                deliver(x, y);
+                deliver(y, x);
+                received += y.inbound_stream().read(y.inbound_stream().buffer_size());
+            }
+            string expected;
+            for (int i = 0; i < 100; ++i) {
+                expected += to_string(i);
+            }
+            test_err_if(received != expected, "data mismatch");
+            test_err_if(x.bytes_in_flight() != 0, "data left unacknowledged");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include "link_emulator.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//! A segment numbered `n`, with `payload` bytes
+static TCPSegment numbered(const uint32_t n, const size_t payload = 0) {
+    TCPSegment seg;
+    seg.header().seqno = WrappingInt32{n};
+    seg.payload() = string(payload, 'x');
+    return seg;
+}
+
+//! Send `count` numbered segments at `now_us` and return the numbers that arrive by `until_us`
+static vector<uint32_t> run(LinkEmulator &link,
+                            const uint32_t count,
+                            const uint64_t until_us,
+                            const size_t payload = 0) {
+    for (uint32_t n = 0; n < count; ++n) {
+        link.send(numbered(n, payload), 0);
+    }
+    vector<uint32_t> arrived;
+    for (const auto &seg : link.receive(until_us)) {
+        arrived.push_back(seg.header().seqno.raw_value());
+    }
+    return arrived;
+}
+
+int main() {
+    try {
+        // 85 bytes of payload + 40 of headers = 1000 bits = 1 ms at 1 Mbit/s, then 10 ms of delay
+        {
+            LinkConfig cfg;
+            cfg.bandwidth_bps = 1000 * 1000;
+            cfg.delay_us = 10000;
+            LinkEmulator link{cfg};
+            test_err_if(not run(link, 10, 10999, 85).empty(), "segment arrived before its delay");
+            test_err_if(link.receive(15000).size() != 5, "bandwidth not enforced");
+            test_err_if(link.receive(20000).size() != 5 or link.in_flight() != 0, "segments lost");
+        }
+
+        // a full queue drops the tail
+        {
+            LinkConfig cfg;
+            cfg.bandwidth_bps = 1000 * 1000;
+            cfg.queue_limit = 3;
+            LinkEmulator link{cfg};
+            test_err_if((run(link, 5, 1000000, 85) != vector<uint32_t>{0, 1, 2}), "tail not dropped");
+            test_err_if(link.stats().overflowed != 2, "overflow not counted");
+        }
+
+        // the same seed makes the same choices
+        {
+            LinkConfig cfg;
+            cfg.loss = 0.3;
+            cfg.jitter_us = 1000;
+            cfg.duplicate = 0.1;
+            cfg.seed = 42;
+            LinkEmulator a{cfg}, b{cfg};
+            const auto arrived = run(a, 1000, 10000);
+            test_err_if(arrived != run(b, 1000, 10000), "same seed, different runs");
+            cfg.seed = 43;
+            LinkEmulator c{cfg};
+            test_err_if(arrived == run(c, 1000, 10000), "different seeds, same run");
+            test_err_if(a.stats().lost < 250 or a.stats().lost > 350, "loss rate far from 30%");
+        }
+
+        // Gilbert-Elliott losses come in bursts
+        {
+            LinkConfig cfg;
+            cfg.burst_enter = 0.01;
+            cfg.burst_exit = 0.1;
+            LinkEmulator link{cfg};
+            const auto arrived = run(link, 100000, 0);
+            size_t bursts = 0;
+            for (size_t i = 1; i < arrived.size(); ++i) {
+                bursts += arrived[i] != arrived[i - 1] + 1;
+            }
+            test_err_if(link.stats().lost == 0 or bursts == 0, "no bursts");
+            test_err_if(link.stats().lost / bursts < 5, "losses not bursty");
+        }
+
+        // duplication and reordering
+        {
+            LinkConfig cfg;
+            cfg.duplicate = 1;
+            LinkEmulator dup{cfg};
+            test_err_if(run(dup, 10, 0).size() != 20, "segments not duplicated");
+
+            cfg.duplicate = 0;
+            cfg.reorder = 0.5;
+            cfg.reorder_us = 10;
+            LinkEmulator reorder{cfg};
+            auto arrived = run(reorder, 100, 10);
+            test_err_if(is_sorted(arrived.begin(), arrived.end()), "segments not reordered");
+            sort(arrived.begin(), arrived.end());
+            test_err_if(arrived.size() != 100 or arrived.back() != 99, "reordered segments lost");
+        }
+
+        // TCP delivers a stream intact over an impaired link
+        {
+            LinkConfig cfg;
+            cfg.bandwidth_bps = 10 * 1000 * 1000;
+            cfg.delay_us = 5000;
+            cfg.jitter_us = 1000;
+            cfg.loss = 0.05;
+            cfg.duplicate = 0.02;
+            cfg.reorder = 0.05;
+            cfg.reorder_us = 3000;
+            LinkEmulator forward{cfg}, backward{cfg};
+
+            TCPConfig tcp_cfg;
+            tcp_cfg.rt_timeout = 100;
+            TCPConnection x{tcp_cfg}, y{tcp_cfg};
+            auto rd = get_random_generator();
+            string data(100000, 0);
+            generate(data.begin(), data.end(), [&] { return rd(); });
+            size_t written = 0;
+            bool x_closed = false;
+            string received;
+            x.connect();
+            for (uint64_t now_ms = 0; not y.inbound_stream().eof(); ++now_ms) {
+                test_err_if(now_ms > 60000, "transfer stalled");
+                written += x.write(data.substr(written, x.remaining_outbound_capacity()));
+                if (written == data.size() and not x_closed) {
+                    x.end_input_stream();
+                    x_closed = true;
+                }
+                for (; not x.segments_out().empty(); x.segments_out().pop()) {
+                    forward.send(x.segments_out().front(), now_ms * 1000);
+                }
+                for (; not y.segments_out().empty(); y.segments_out().pop()) {
+                    backward.send(y.segments_out().front(), now_ms * 1000);
+                }
+                for (const auto &seg : forward.receive(now_ms * 1000)) {
+                    y.segment_received(seg);
+                }
+                for (const auto &seg : backward.receive(now_ms * 1000)) {
+                    x.segment_received(seg);
+                }
+                received += y.inbound_stream().read(y.inbound_stream().buffer_size());
+                x.tick(1);
+                y.tick(1);
+            }
+            test_err_if(received != data, "stream corrupted");
+            test_err_if(forward.stats().lost == 0 or x.metrics().retransmissions == 0, "nothing was lost");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
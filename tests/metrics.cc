@@ -0,0 +1,115 @@
+#include "connection_harness.hh"
+#include "metrics.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_metrics.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static constexpr size_t NTHREADS = 4;
+static constexpr size_t NCOUNTS = 10000;
+
+int main() {
+    try {
+        // histogram buckets
+        {
+            Histogram h;
+            for (const uint64_t v : {0, 1, 2, 3, 4, 1000}) {
+                h.record(v);
+            }
+            test_err_if(h.count() != 6 or h.sum() != 1010, "histogram totals wrong");
+            test_err_if(h.bucket(0) != 1 or h.bucket(1) != 1 or h.bucket(2) != 2 or h.bucket(3) != 1,
+                        "histogram buckets wrong");
+            test_err_if(h.bucket(10) != 1, "1000 not in [512, 1024)");
+        }
+
+        // per-thread stack counters add up, including those of threads that have exited
+        {
+            const auto before = StackMetrics::snapshot();
+            vector<thread> threads;
+            for (size_t t = 0; t < NTHREADS; ++t) {
+                threads.emplace_back([] {
+                    for (size_t i = 0; i < NCOUNTS; ++i) {
+                        StackMetrics::tcp_parse_failure(ParseResult::BadChecksum);
+                        StackMetrics::demux_miss();
+                    }
+                });
+            }
+            for (auto &t : threads) {
+                t.join();
+            }
+            StackMetrics::ipv4_parse_failure(ParseResult::Unsupported);
+
+            const auto after = StackMetrics::snapshot();
+            test_err_if(after.demux_misses - before.demux_misses != NTHREADS * NCOUNTS, "demux misses lost");
+            test_err_if(after.checksum_failures() - before.checksum_failures() != NTHREADS * NCOUNTS,
+                        "checksum failures lost");
+
+            ostringstream dump;
+            StackMetrics::write_prometheus(dump);
+            test_err_if(dump.str().find("starfish_parse_failures_total{layer=\"ipv4\",reason=\"Unsupported\"} 1") ==
+                            string::npos,
+                        "Prometheus dump missing parse failures");
+        }
+
+        // connection counters
+        {
+            TCPConfig cfg{};
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+
+            // a segment lost, then one that arrives out of order
+            a.write(string(1000, 'x'));
+            a.segments_out() = {};
+            a.write(string(500, 'y'));
+            deliver(a, b);
+            deliver(b, a);  // duplicate ACK
+            test_err_if(b.metrics().out_of_order_bytes != 500, "out-of-order bytes not counted");
+            test_err_if(a.metrics().duplicate_acks != 1, "duplicate ACK not counted");
+
+            // a window update acknowledges nothing new either, but isn't a duplicate ACK
+            TCPSegment update = data_segment(b.next_seqno(), b.ackno().value(), "");
+            update.header().win = 1234;
+            a.segment_received(update);
+            test_err_if(a.metrics().duplicate_acks != 1, "window update counted as a duplicate ACK");
+
+            a.tick(cfg.rt_timeout);  // retransmission
+            deliver(a, b);
+            deliver(b, a);
+            test_err_if(a.metrics().retransmissions != 1, "retransmission not counted");
+            test_err_if(b.inbound_stream().buffer_size() != 1500, "data not delivered");
+
+            // a clean round trip gives an RTT sample (the handshake gave one of 0 ms)
+            a.write("z");
+            a.tick(7);
+            deliver(a, b);
+            deliver(b, a);
+            const TCPConnectionMetrics m = a.metrics();
+            test_err_if(m.rtt_ms.count() != 2 or m.rtt_ms.sum() != 7, "RTT sample not recorded");
+            test_err_if(m.bytes_out != 2501 or b.metrics().bytes_in != 1501, "payload bytes miscounted");
+            test_err_if(m.segments_out != a.metrics().segments_out or m.segments_in == 0, "segments miscounted");
+
+            ostringstream dump;
+            m.write_prometheus(dump, "conn=\"a\"");
+            test_err_if(dump.str().find("starfish_tcp_retransmissions_total{conn=\"a\"} 1") == string::npos,
+                        "Prometheus dump missing retransmissions");
+            test_err_if(dump.str().find("starfish_tcp_rtt_ms_bucket{conn=\"a\",le=\"7\"} 2") == string::npos,
+                        "Prometheus dump missing RTT bucket");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
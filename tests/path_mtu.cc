@@ -0,0 +1,161 @@
+#include "connection_harness.hh"
+#include "fast_parser.hh"
+#include "parser.hh"
+#include "path_mtu.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_header.hh"
+#include "test_err_if.hh"
+#include "tun.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! A serialized header whose options area (`4 * doff - 20` bytes) holds `options`, zero-padded
+static string with_options(const string &options, const uint8_t doff) {
+    TCPHeader h;
+    h.doff = doff;
+    string wire = h.serialize();
+    wire.replace(TCPHeader::LENGTH, options.size(), options);
+    return wire;
+}
+
+//! The MSS option of `wire`, as read by both parsers (which must agree)
+static uint16_t parsed_mss(const string &wire) {
+    TCPHeader slow;
+    NetParser p{Buffer{string(wire)}};
+    test_err_if(slow.parse(p) != ParseResult::NoError, "generic TCP parse failed");
+    TCPHeader fast;
+    fast.mss = 1;
+    test_err_if(FastParser::parse_tcp(Buffer{string(wire)}, fast) != ParseResult::NoError, "fast TCP parse failed");
+    test_err_if(slow.mss != fast.mss, "parsers disagree on the MSS option");
+    return fast.mss;
+}
+
+int main() {
+    try {
+        // the MSS option round-trips, among other options, and a malformed option ends the parsing
+        {
+            TCPHeader h;
+            h.doff = TCPHeader::MSS_LENGTH / 4;
+            h.mss = 8960;
+            test_err_if(parsed_mss(h.serialize()) != 8960, "MSS option didn't round-trip");
+            h.doff = TCPHeader::LENGTH / 4;
+            test_err_if(parsed_mss(h.serialize()) != 0, "MSS option sent without room for it");
+
+            test_err_if(parsed_mss(with_options(string("\x01\x04\x02\x02\x04\x04\x00", 7), 7)) != 1024,
+                        "MSS option not found after NOP and SACK-permitted");
+            test_err_if(parsed_mss(with_options(string("\x00\x00\x02\x04\x04\x00", 6), 7)) != 0,
+                        "MSS option read after the end of the options");
+            test_err_if(parsed_mss(with_options(string("\x02\x04\x05\xb4\x08\x20", 6), 7)) != 1460,
+                        "option running past the header not tolerated");
+            test_err_if(parsed_mss(with_options(string("\x08\x01\x02\x04\x05\xb4", 6), 7)) != 0,
+                        "MSS option read after a malformed option");
+        }
+
+        // the MSS comes from the configuration, or an MTU
+        {
+            TCPConfig cfg;
+            test_err_if(cfg.effective_mss() != TCPConfig::MAX_PAYLOAD_SIZE, "wrong default MSS");
+            cfg.mss = 100000;
+            test_err_if(cfg.effective_mss() != TCPConfig::MAX_MSS, "MSS not capped");
+            test_err_if(TCPConfig::mss_for_mtu(1500) != 1460 or TCPConfig::mss_for_mtu(9000) != 8960,
+                        "wrong MSS for an MTU");
+            test_err_if(interface_mtu("lo") == 0, "no MTU for the loopback interface");
+        }
+
+        // each side announces its MSS in its SYN, and sends at most the smaller of the two
+        {
+            TCPConfig small, big;
+            small.mss = 1000;
+            big.mss = 8960;
+            TCPConnection a{big}, b{small};
+            a.connect();
+            test_err_if(a.segments_out().front().header().mss != 8960, "SYN doesn't carry the MSS");
+            deliver(a, b);
+            test_err_if(b.segments_out().front().header().mss != 1000, "SYN-ACK doesn't carry the MSS");
+            deliver(b, a);
+            deliver(a, b);
+            test_err_if(a.mss() != 1000 or b.mss() != 1000, "MSS not negotiated down");
+
+            a.write(string(3000, 'x'));
+            test_err_if(a.segments_out().size() != 3 or a.segments_out().front().payload().size() != 1000,
+                        "segments larger than the peer's MSS");
+        }
+
+        // a peer's MSS option below MIN_MSS is raised to it
+        {
+            TCPConfig cfg;
+            cfg.fixed_isn = WrappingInt32{1000};
+            TCPConnection a{cfg};
+            a.connect();
+            TCPSegment syn_ack = data_segment(WrappingInt32{5000}, WrappingInt32{1001}, "");
+            syn_ack.header().syn = true;
+            syn_ack.header().mss = 1;
+            a.segment_received(syn_ack);
+            test_err_if(a.mss() != TCPConfig::MIN_MSS, "tiny peer MSS honored");
+        }
+
+        // the search climbs the ladder of common MTUs to the ceiling, and gives a size up at its first loss
+        {
+            PathMTUDiscovery pmtu{true, 1000, 9000};
+            test_err_if(pmtu.mss() != 1000 or pmtu.probe_size(0) != 1460, "search doesn't start at Ethernet's MTU");
+            pmtu.probe_sent(1, 1460);
+            test_err_if(not pmtu.is_probe(1) or pmtu.probe_size(0).has_value(), "two probes in flight");
+            pmtu.acked(1461);
+            test_err_if(pmtu.mss() != 1460 or pmtu.probe_size(0) != 1962, "acknowledged probe not taken");
+            pmtu.probe_sent(2000, 1962);
+            pmtu.acked(3962);
+            pmtu.probe_sent(4000, 4312);
+            pmtu.acked(8312);
+            pmtu.probe_sent(9000, 8960);
+            pmtu.acked(17960);
+            test_err_if(pmtu.mss() != 8960 or pmtu.probe_size(0) != 9000, "ceiling off the ladder not probed");
+
+            pmtu.probe_sent(20000, 9000);
+            test_err_if(pmtu.duplicate_ack() or pmtu.duplicate_ack() or not pmtu.duplicate_ack(),
+                        "wrong count of duplicate ACKs");
+            pmtu.lost(0);
+            test_err_if(pmtu.mss() != 8960 or not pmtu.done() or pmtu.probe_size(0).has_value(),
+                        "lost size not given up");
+            test_err_if(pmtu.probe_size(PathMTUDiscovery::RESEARCH_MS) != 9000, "search not started again");
+
+            PathMTUDiscovery off{false, 1000, 9000};
+            test_err_if(off.mss() != 9000 or off.probe_size(0).has_value(), "probing when off");
+        }
+
+        // over a path that carries 8960-byte payloads, the search settles on them after losing one probe
+        {
+            constexpr size_t PATH_MSS = 8960;
+            TCPConfig cfg;
+            cfg.mss = TCPConfig::MAX_MSS;
+            cfg.plpmtud = true;
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            test_err_if(a.mss() != TCPConfig::MAX_PAYLOAD_SIZE, "search doesn't start from the base");
+
+            size_t received = 0;
+            for (unsigned int round = 0; round < 1000 and received < 4 * 1024 * 1024; ++round) {
+                a.write(string(a.remaining_outbound_capacity(), 'x'));
+                deliver(a, b, PATH_MSS);
+                received += b.inbound_stream().read(b.inbound_stream().buffer_size()).size();
+                b.window_update();
+                deliver(b, a);
+                a.tick(1);
+            }
+            test_err_if(received < 4 * 1024 * 1024, "transfer stalled while searching");
+            test_err_if(a.mss() != PATH_MSS, "search didn't settle on the path MSS");
+            test_err_if(a.metrics().mtu_probes_lost != 1 or a.metrics().retransmissions != 0,
+                        "lost probes not counted apart from retransmissions");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+#include "pcap.hh"
+#include "tcp_config.hh"
+#include "test_err_if.hh"
+#include "tun_stack.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+//! A captured packet: its bytes and its length on the wire
+struct Packet {
+    string data;
+    uint32_t orig_len;
+};
+
+//! Read the pcap file at `path` (checking its header) and return its packets
+static vector<Packet> read_pcap(const string &path, const uint32_t snaplen) {
+    FileDescriptor file{SystemCall("open", ::open(path.c_str(), O_RDONLY))};
+    string contents;
+    while (not file.eof()) {
+        contents += file.read();
+    }
+
+    const auto u32 = [&](const size_t offset) {
+        uint32_t v = 0;
+        memcpy(&v, contents.data() + offset, sizeof(v));
+        return v;
+    };
+    test_err_if(contents.size() < 24, "pcap file header missing");
+    test_err_if(u32(0) != 0xa1b2c3d4, "bad pcap magic");
+    test_err_if(u32(16) != snaplen, "wrong snaplen");
+    test_err_if(u32(20) != 101, "not LINKTYPE_RAW");
+
+    vector<Packet> packets;
+    size_t offset = 24;
+    while (offset < contents.size()) {
+        test_err_if(offset + 16 > contents.size(), "truncated record header");
+        const uint32_t incl_len = u32(offset + 8);
+        test_err_if(offset + 16 + incl_len > contents.size(), "truncated record");
+        packets.push_back({contents.substr(offset + 16, incl_len), u32(offset + 12)});
+        offset += 16 + incl_len;
+    }
+    return packets;
+}
+
+int main() {
+    try {
+        const string path = "pcap_test." + to_string(getpid()) + ".pcap";
+
+        // snaplen truncates, and the original length is kept
+        {
+            PcapConfig cfg{};
+            cfg.snaplen = 60;
+            {
+                PcapCapture capture{path, cfg};
+                for (char c = 'a'; c < 'd'; ++c) {
+                    capture.capture(string(100, c));
+                }
+                test_err_if(capture.captured() != 3 or capture.dropped() != 0, "wrong capture counts");
+            }
+            const auto packets = read_pcap(path, 60);
+            test_err_if(packets.size() != 3, "wrong number of packets");
+            for (const auto &p : packets) {
+                test_err_if(p.data.size() != 60 or p.orig_len != 100, "packet not truncated to snaplen");
+            }
+            test_err_if(packets[2].data != string(60, 'c'), "packets out of order");
+        }
+
+        // sampling keeps one in N, and a full ring drops instead of blocking
+        {
+            PcapConfig cfg{};
+            cfg.sample_every = 2;
+            cfg.ring_bytes = 256;
+            {
+                PcapCapture capture{path, cfg};
+                for (size_t i = 0; i < 4; ++i) {
+                    capture.capture(string(50, 'x'));
+                }
+                capture.capture(string(300, 'y'));  // sampled, but bigger than the ring
+                test_err_if(capture.captured() != 2 or capture.dropped() != 1, "wrong sampling or drop counts");
+            }
+            test_err_if(read_pcap(path, cfg.snaplen).size() != 2, "wrong number of sampled packets");
+        }
+
+        // a sample_every of 0 is refused, before the file is created
+        {
+            PcapConfig cfg{};
+            cfg.sample_every = 0;
+            const string unused_path = path + ".unused";
+            bool refused = false;
+            try {
+                PcapCapture capture{unused_path, cfg};
+            } catch (const runtime_error &) {
+                refused = true;
+            }
+            test_err_if(not refused, "sample_every of 0 accepted");
+            test_err_if(access(unused_path.c_str(), F_OK) == 0, "file created for a refused configuration");
+        }
+
+        // a TUNStack captures what it writes and what it reads
+        {
+            int fds[2];
+            SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+            TUNStack client_stack{FileDescriptor{fds[0]}};
+            TUNStack server_stack{FileDescriptor{fds[1]}};
+            EventLoop loop;
+            client_stack.install_rules(loop);
+            server_stack.install_rules(loop);
+
+            TCPConfig cfg{};
+            FdAdapterConfig ad_cfg{};
+            ad_cfg.source = {"169.254.144.9", 40000};
+            ad_cfg.destination = {"169.254.144.1", 9090};
+            server_stack.listen(cfg, ad_cfg.destination);
+            {
+                client_stack.set_capture(make_shared<PcapCapture>(path));
+                const auto client = client_stack.connect(cfg, ad_cfg);
+                while (loop.wait_next_event(0) == EventLoop::Result::Success) {
+                }
+                test_err_if(client->state() != TCPState::State::ESTABLISHED, "handshake failed");
+                client_stack.set_capture(nullptr);
+            }
+
+            // SYN, SYN/ACK, ACK
+            const auto packets = read_pcap(path, PcapConfig{}.snaplen);
+            test_err_if(packets.size() != 3, "handshake not captured");
+            for (const auto &p : packets) {
+                InternetDatagram dgram;
+                test_err_if(dgram.parse(string(p.data)) != ParseResult::NoError, "captured datagram doesn't parse");
+            }
+        }
+
+        unlink(path.c_str());
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#include "connection_harness.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_sender.hh"
+#include "test_err_if.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! Pop the one segment `sender` has queued
+static TCPSegment pop_one(TCPSender &sender, const string &what) {
+    test_err_if(sender.segments_out().size() != 1, what);
+    TCPSegment seg = sender.segments_out().front();
+    sender.segments_out().pop();
+    return seg;
+}
+
+int main() {
+    try {
+        constexpr uint16_t RTO = 1000;
+        const WrappingInt32 isn{12345};
+
+        // probes back off on their own schedule, without counting as retransmissions
+        {
+            TCPSender sender{TCPConfig::DEFAULT_CAPACITY, RTO, isn};
+            sender.fill_window();
+            pop_one(sender, "no SYN");
+            sender.ack_received(isn + 1, 0);
+            sender.stream_in().write("hello");
+            sender.fill_window();
+            test_err_if(not sender.segments_out().empty(), "sent into a zero window");
+            test_err_if(not sender.persisting() or sender.timer_state(), "persist timer not running instead");
+
+            sender.tick(RTO - 1);
+            test_err_if(not sender.segments_out().empty(), "probe sent early");
+            sender.tick(1);
+            TCPSegment probe = pop_one(sender, "no probe after one RTO");
+            test_err_if(probe.header().seqno != isn + 1 or probe.payload().str() != "h", "bad first probe");
+
+            unsigned int interval = 2 * RTO;
+            for (unsigned int i = 0; i < 2 * TCPConfig::MAX_RETX_ATTEMPTS; ++i) {
+                sender.ack_received(isn + 1, 0);  // the peer answers, still with a zero window
+                test_err_if(sender.persist_timeout() != interval, "wrong probe backoff");
+                sender.tick(interval - 1);
+                test_err_if(not sender.segments_out().empty(), "probe sent before its backoff");
+                sender.tick(1);
+                probe = pop_one(sender, "no probe after backoff");
+                test_err_if(probe.header().seqno != isn + 1 or probe.payload().str() != "h", "bad repeated probe");
+                interval = min(2 * interval, static_cast<unsigned int>(TCPConfig::PERSIST_TIMEOUT_MAX));
+            }
+            test_err_if(sender.persist_timeout() != TCPConfig::PERSIST_TIMEOUT_MAX, "backoff not capped");
+            test_err_if(sender.retransmitted_segments() != 0 or sender.consecutive_retransmissions() != 0,
+                        "probes counted as retransmissions");
+            test_err_if(sender.zero_window_probes() != 2 * TCPConfig::MAX_RETX_ATTEMPTS + 1, "probes not counted");
+            test_err_if(sender.retransmission_timeout() != RTO, "RTO backed off by probes");
+
+            // the window opens: the retransmission timer takes over, and the rest is sent
+            sender.ack_received(isn + 2, 1000);
+            test_err_if(sender.persisting(), "persist timer still running");
+            sender.fill_window();
+            test_err_if(pop_one(sender, "rest not sent").payload().str() != "ello", "wrong data after the probe");
+            test_err_if(not sender.timer_state(), "retransmission timer not running");
+
+            // a zero window with data in flight probes the first outstanding byte
+            sender.ack_received(isn + 2, 0);
+            test_err_if(not sender.persisting() or sender.timer_state(), "persist timer not running");
+            sender.tick(RTO);
+            probe = pop_one(sender, "no probe with data in flight");
+            test_err_if(probe.header().seqno != isn + 2 or probe.payload().str() != "e", "bad in-flight probe");
+
+            // the probe's byte is acknowledged (the window still zero): the next probe carries the next byte
+            sender.ack_received(isn + 3, 0);
+            test_err_if(sender.bytes_in_flight() != 3, "partial ACK not counted");
+            sender.tick(2 * RTO);
+            probe = pop_one(sender, "no probe after a partial ACK");
+            test_err_if(probe.header().seqno != isn + 3 or probe.payload().str() != "l", "acknowledged byte probed");
+            sender.ack_received(isn + 6, 1000);
+            test_err_if(sender.persisting() or sender.timer_state() or sender.bytes_in_flight() != 0,
+                        "timers running with nothing in flight");
+        }
+
+        // a FIN waiting for the window is probed too
+        {
+            TCPSender sender{TCPConfig::DEFAULT_CAPACITY, RTO, isn};
+            sender.fill_window();
+            pop_one(sender, "no SYN");
+            sender.ack_received(isn + 1, 0);
+            sender.stream_in().end_input();
+            sender.fill_window();
+            test_err_if(not sender.segments_out().empty() or not sender.persisting(), "FIN not held back");
+            sender.tick(RTO);
+            test_err_if(not pop_one(sender, "no FIN probe").header().fin, "probe doesn't carry the FIN");
+        }
+
+        TCPConfig cfg;
+        cfg.rt_timeout = RTO;
+        TCPConfig small = cfg;
+        small.recv_capacity = 1000;
+
+        // a peer that keeps answering with a zero window is never given up on
+        {
+            TCPConnection a{cfg}, b{small};
+            handshake(a, b);
+            a.write(string(2000, 'x'));
+            deliver(a, b);
+            deliver(b, a);
+            for (unsigned int i = 0; i < 4 * TCPConfig::MAX_RETX_ATTEMPTS; ++i) {
+                a.tick(TCPConfig::PERSIST_TIMEOUT_MAX);
+                deliver(a, b);
+                deliver(b, a);
+            }
+            test_err_if(not a.active() or a.metrics().retransmissions != 0, "zero window aborted the connection");
+            test_err_if(a.metrics().zero_window_probes != 4 * TCPConfig::MAX_RETX_ATTEMPTS, "probes not counted");
+
+            b.inbound_stream().read(1000);
+            b.window_update();
+            deliver(b, a);
+            test_err_if(a.bytes_in_flight() != 1000, "rest not sent once the window opened");
+        }
+
+        // a peer that doesn't answer probes at all is given up on
+        {
+            TCPConnection a{cfg}, b{small};
+            handshake(a, b);
+            a.write(string(2000, 'x'));
+            deliver(a, b);
+            deliver(b, a);
+            for (unsigned int i = 0; i <= TCPConfig::MAX_RETX_ATTEMPTS and a.active(); ++i) {
+                a.tick(TCPConfig::PERSIST_TIMEOUT_MAX);
+            }
+            test_err_if(a.active() or not a.segments_out().back().header().rst, "unanswered probes not given up on");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+#include "connection_harness.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "segment_coalescer.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "tun_stack.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+int main() {
+    try {
+        const WrappingInt32 seqno{1000}, ackno{5000};
+
+        // only data segments that continue the run, and acknowledge the same ackno, are merged
+        {
+            CoalescedSegment run{data_segment(seqno, ackno, "hello")};
+            TCPSegment next = data_segment(seqno + 5, ackno, ", ");
+            next.header().win = 100;
+            next.header().psh = true;
+            test_err_if(not run.append(next), "next segment not merged");
+            TCPSegment gap = data_segment(seqno + 8, ackno, "world");
+            test_err_if(run.append(gap), "segment after a gap merged");
+            TCPSegment new_ack = data_segment(seqno + 7, ackno + 1, "world");
+            test_err_if(run.append(new_ack), "segment with a new ackno merged");
+            TCPSegment fin = data_segment(seqno + 7, ackno, "world");
+            fin.header().fin = true;
+            test_err_if(run.append(fin), "FIN merged");
+            TCPSegment pure_ack = data_segment(seqno + 7, ackno, "");
+            test_err_if(run.append(pure_ack), "pure ACK merged");
+            TCPSegment last = data_segment(seqno + 7, ackno, "world");
+            test_err_if(not run.append(last), "last segment not merged");
+
+            test_err_if(run.segments() != 3 or run.payload_size() != 12, "wrong run size");
+            test_err_if(run.header().seqno != seqno or run.header().win != TCPConfig::DEFAULT_CAPACITY or
+                            not run.header().psh,
+                        "wrong run header");
+            test_err_if(run.first().payload().str() != "hello" or run.rest().size() != 2 or
+                            run.rest()[0].str() != ", " or run.rest()[1].str() != "world",
+                        "wrong payload chain");
+        }
+
+        // each flow's segments are merged into its own runs, which keep their order
+        {
+            const FlowKey a{1, 2, 3, 4}, b{1, 2, 3, 5};
+            SegmentCoalescer coalescer;
+            coalescer.add(a, data_segment(seqno, ackno, "a1"));
+            coalescer.add(b, data_segment(seqno, ackno, "b1"));
+            coalescer.add(a, data_segment(seqno + 2, ackno, "a2"));
+            TCPSegment fin = data_segment(seqno + 4, ackno, "");
+            fin.header().fin = true;
+            coalescer.add(a, move(fin));
+            coalescer.add(a, data_segment(seqno + 5, ackno, "a3"));
+            coalescer.add(b, data_segment(seqno + 2, ackno, "b2"));
+
+            const auto &runs = coalescer.runs();
+            test_err_if(runs.size() != 4, "wrong number of runs");
+            test_err_if(runs[0].flow != a or runs[0].segment.segments() != 2, "first flow's run not merged");
+            test_err_if(runs[1].flow != b or runs[1].segment.segments() != 2, "second flow's run not merged");
+            test_err_if(runs[2].flow != a or not runs[2].segment.header().fin, "FIN not in a run of its own");
+            test_err_if(runs[3].flow != a or runs[3].segment.first().payload().str() != "a3",
+                        "segment after the FIN merged or reordered");
+            coalescer.clear();
+            test_err_if(not coalescer.runs().empty(), "runs not cleared");
+        }
+
+        // a connection takes a run as one segment, and sends one ACK for it
+        {
+            TCPConfig cfg;
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            b.segments_out() = {};
+
+            a.write(string(3 * TCPConfig::MAX_PAYLOAD_SIZE, 'x'));
+            test_err_if(a.segments_out().size() != 3, "expected three segments");
+            CoalescedSegment run{move(a.segments_out().front())};
+            for (a.segments_out().pop(); not a.segments_out().empty(); a.segments_out().pop()) {
+                test_err_if(not run.append(a.segments_out().front()), "in-order segment not merged");
+            }
+            b.segment_received(run);
+            test_err_if(b.inbound_stream().buffer_size() != 3 * TCPConfig::MAX_PAYLOAD_SIZE, "run not received");
+            test_err_if(b.segments_out().size() != 1 or
+                            b.segments_out().front().header().ackno != run.header().seqno + run.payload_size(),
+                        "not one ACK for the run");
+            test_err_if(b.metrics().segments_in != 3 + 2 or b.metrics().coalesced_segments != 2,
+                        "run not counted");
+            deliver(b, a);
+            test_err_if(a.bytes_in_flight() != 0, "run not acknowledged");
+        }
+
+        // a run that arrives ahead of a gap is stored until the gap is filled
+        {
+            TCPConfig cfg;
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+
+            a.write(string(3 * TCPConfig::MAX_PAYLOAD_SIZE, 'y'));
+            const TCPSegment first = a.segments_out().front();
+            a.segments_out().pop();
+            CoalescedSegment run{move(a.segments_out().front())};
+            a.segments_out().pop();
+            test_err_if(not run.append(a.segments_out().front()), "in-order segment not merged");
+            a.segments_out().pop();
+
+            b.segment_received(run);
+            test_err_if(b.inbound_stream().buffer_size() != 0 or
+                            b.unassembled_bytes() != 2 * TCPConfig::MAX_PAYLOAD_SIZE,
+                        "out-of-order run not stored");
+            b.segment_received(first);
+            test_err_if(b.inbound_stream().buffer_size() != 3 * TCPConfig::MAX_PAYLOAD_SIZE or
+                            b.unassembled_bytes() != 0,
+                        "run not reassembled");
+        }
+
+        // a run that reaches a FIN which arrived early ends the stream
+        {
+            TCPConfig cfg;
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+
+            a.write(string(2 * TCPConfig::MAX_PAYLOAD_SIZE, 'f'));
+            a.end_input_stream();
+            test_err_if(a.segments_out().size() != 3, "expected two data segments and a FIN");
+            CoalescedSegment run{move(a.segments_out().front())};
+            a.segments_out().pop();
+            test_err_if(not run.append(a.segments_out().front()), "in-order segment not merged");
+            a.segments_out().pop();
+
+            b.segment_received(a.segments_out().front());
+            a.segments_out().pop();
+            b.segments_out() = {};
+            b.segment_received(run);
+            test_err_if(not b.inbound_stream().input_ended(), "stream not ended by the run");
+            test_err_if(b.segments_out().size() != 1 or
+                            b.segments_out().front().header().ackno != run.header().seqno + run.payload_size() + 1,
+                        "FIN not ACKed with the run");
+        }
+
+        // a TUNStack coalesces the segments it reads together
+        {
+            int fds[2];
+            SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+            TUNStack client_stack{FileDescriptor{fds[0]}};
+            TUNStack server_stack{FileDescriptor{fds[1]}};
+            EventLoop loop;
+            client_stack.install_rules(loop);
+            server_stack.install_rules(loop);
+            const auto run = [&] {
+                while (loop.wait_next_event(0) == EventLoop::Result::Success) {
+                }
+            };
+
+            TCPConfig cfg{};
+            FdAdapterConfig ad_cfg{};
+            ad_cfg.source = {"169.254.144.9", 40000};
+            ad_cfg.destination = {"169.254.144.1", 9090};
+            server_stack.listen(cfg, ad_cfg.destination);
+            const auto client = client_stack.connect(cfg, ad_cfg);
+            run();
+            const auto server = server_stack.accept();
+            test_err_if(server == nullptr, "connection not accepted");
+
+            const string d(16 * TCPConfig::MAX_PAYLOAD_SIZE, 'z');
+            test_err_if(client->write(d) != d.size(), "write refused");
+            run();
+            // (the SYN and each run of data are answered, the ACK of the handshake isn't)
+            const TCPConnectionMetrics m = server->metrics();
+            test_err_if(m.coalesced_segments == 0, "segments read together not coalesced");
+            test_err_if(m.segments_out != m.segments_in - m.coalesced_segments - 1, "not one ACK per run");
+            test_err_if(server->read() != d, "data mismatch");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
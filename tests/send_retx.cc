@@ -0,0 +1,64 @@
+#include "sender_harness.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            cfg.fixed_isn = isn;
+
+            TCPSenderTestHarness test{"Retransmission coalesces small segments", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(1000));
+            test.execute(WriteBytes{"abc"});
+            test.execute(ExpectSegment{}.with_data("abc").with_seqno(isn + 1));
+            test.execute(WriteBytes{"def"});
+            test.execute(ExpectSegment{}.with_data("def").with_seqno(isn + 4));
+            test.execute(Tick{cfg.rt_timeout});
+            test.execute(ExpectSegment{}.with_no_flags().with_data("abcdef").with_seqno(isn + 1));
+            test.execute(ExpectBytesInFlight{6});
+
+            // a partly acknowledged retransmission leaves the remaining range outstanding
+            test.execute(AckReceived{WrappingInt32{isn + 4}}.with_win(1000));
+            test.execute(ExpectBytesInFlight{3});
+            test.execute(Tick{cfg.rt_timeout});
+            test.execute(ExpectSegment{}.with_no_flags().with_data("def").with_seqno(isn + 4));
+        }
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            cfg.fixed_isn = isn;
+
+            TCPSenderTestHarness test{"Retransmission carries the FIN of the last range", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(1000));
+            test.execute(WriteBytes{"abc"});
+            test.execute(ExpectSegment{}.with_data("abc").with_seqno(isn + 1));
+            test.execute(WriteBytes{"def"}.with_end_input(true));
+            test.execute(ExpectSegment{}.with_fin(true).with_data("def").with_seqno(isn + 4));
+            test.execute(ExpectBytesInFlight{7});
+            test.execute(Tick{cfg.rt_timeout});
+            test.execute(ExpectSegment{}.with_fin(true).with_data("abcdef").with_seqno(isn + 1));
+            test.execute(AckReceived{WrappingInt32{isn + 8}}.with_win(1000));
+            test.execute(ExpectState{TCPSenderStateSummary::FIN_ACKED});
+            test.execute(ExpectBytesInFlight{0});
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#include "connection_harness.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_memory.hh"
+#include "test_err_if.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! The window of the last segment `conn` queued (the rest are discarded)
+static uint16_t last_window(TCPConnection &conn) {
+    uint16_t win = 0;
+    for (; not conn.segments_out().empty(); conn.segments_out().pop()) {
+        win = conn.segments_out().front().header().win;
+    }
+    return win;
+}
+
+int main() {
+    try {
+        const TCPMemory::Limits defaults = TCPMemory::limits();
+        constexpr size_t KiB = 1024;
+        TCPMemory::Limits limits;
+        limits.low = 100 * KiB;
+        limits.pressure = 200 * KiB;
+        limits.drop_out_of_order = 400 * KiB;
+        limits.refuse_connections = 800 * KiB;
+        TCPMemory::set_limits(limits);
+
+        // charges are rounded up to a quantum, and move with the object
+        {
+            const size_t base = TCPMemory::buffered();
+            TCPMemory m;
+            m.charge(1);
+            test_err_if(m.charged() != TCPMemory::QUANTUM or TCPMemory::buffered() != base + TCPMemory::QUANTUM,
+                        "charge not rounded up to a quantum");
+            m.charge(TCPMemory::QUANTUM + 1);
+            test_err_if(TCPMemory::buffered() != base + 2 * TCPMemory::QUANTUM, "charge not replaced");
+            TCPMemory n{move(m)};
+            test_err_if(n.charged() != 2 * TCPMemory::QUANTUM or m.charged() != 0, "charge didn't move");
+            {
+                TCPMemory o;
+                o.charge(5 * TCPMemory::QUANTUM);
+                o = move(n);
+                test_err_if(TCPMemory::buffered() != base + 2 * TCPMemory::QUANTUM, "overwritten charge kept");
+            }
+            test_err_if(TCPMemory::buffered() != base, "charge not returned");
+        }
+
+        // the pressure levels, with hysteresis between `low` and `pressure`
+        TCPMemory hog;
+        {
+            hog.charge(150 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::None, "pressure below its threshold");
+            hog.charge(300 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::ShrinkWindows, "no pressure");
+            hog.charge(150 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::ShrinkWindows, "pressure ended above low");
+            hog.charge(50 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::None, "pressure didn't end below low");
+            hog.charge(500 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::DropOutOfOrder, "out-of-order data kept");
+            hog.charge(900 * KiB);
+            test_err_if(TCPMemory::pressure() != MemoryPressure::RefuseConnections, "connections not refused");
+        }
+
+        TCPConfig cfg;
+        cfg.recv_capacity = 4000;
+
+        // new connections are refused: a SYN is ignored, and connect() throws
+        {
+            const uint64_t refused = TCPMemory::refused();
+            TCPConnection client{cfg};
+            TCPConnection server{cfg};
+            bool threw = false;
+            try {
+                client.connect();
+            } catch (const runtime_error &) {
+                threw = true;
+            }
+            test_err_if(not threw or not client.segments_out().empty(), "connect() not refused");
+
+            TCPSegment syn;
+            syn.header().syn = true;
+            syn.header().seqno = WrappingInt32{1000};
+            server.segment_received(syn);
+            test_err_if(not server.segments_out().empty() or server.state() != TCPState::State::LISTEN,
+                        "SYN not refused");
+            test_err_if(TCPMemory::refused() != refused + 2, "refusals not counted");
+        }
+
+        // out-of-order data is pruned, and no more is stored
+        {
+            hog.charge(0);
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            test_err_if(b.state() != TCPState::State::ESTABLISHED, "not established");
+
+            const WrappingInt32 ackno = b.ackno().value();
+            b.segment_received(data_segment(ackno + 100, a.ackno().value(), "hello"));
+            test_err_if(b.unassembled_bytes() != 5, "out-of-order data not stored without pressure");
+
+            hog.charge(500 * KiB);
+            const uint64_t dropped = TCPMemory::dropped();
+            b.segment_received(data_segment(ackno + 200, a.ackno().value(), "world"));
+            test_err_if(b.unassembled_bytes() != 0, "out-of-order data stored under pressure");
+            test_err_if(TCPMemory::dropped() != dropped + 5, "pruned bytes not counted");
+
+            b.segment_received(data_segment(ackno, a.ackno().value(), "in order"));
+            test_err_if(b.inbound_stream().buffer_size() != 8, "in-order data dropped under pressure");
+        }
+
+        // the window closes as data arrives, but reading doesn't reopen it
+        {
+            hog.charge(0);
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            b.segments_out() = {};
+
+            // (enough data that reading it would otherwise move the edge past the SWS threshold and,
+            // with under half the capacity left advertised, send a window update)
+            hog.charge(300 * KiB);
+            a.write(string(2100, 'x'));
+            deliver(a, b);
+            test_err_if(last_window(b) != 1900, "window not closed by data");
+            b.inbound_stream().read(2100);
+            b.window_update();
+            test_err_if(not b.segments_out().empty(), "window update sent under pressure");
+            a.write(string(100, 'y'));
+            deliver(a, b);
+            test_err_if(last_window(b) != 1800, "window reopened under pressure");
+
+            hog.charge(0);
+            a.write(string(100, 'z'));
+            deliver(a, b);
+            test_err_if(last_window(b) != 3800, "window not reopened after pressure");
+        }
+
+        hog.charge(0);
+        TCPMemory::set_limits(defaults);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include "connection_harness.hh"
+#include "flow_key.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+#include "time_wait.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+using namespace std;
+
+static TCPSegment segment(const uint32_t seqno, const bool syn, const bool fin, const bool rst) {
+    TCPSegment seg;
+    seg.header().seqno = WrappingInt32{seqno};
+    seg.header().ack = not syn;
+    seg.header().syn = syn;
+    seg.header().fin = fin;
+    seg.header().rst = rst;
+    return seg;
+}
+
+int main() {
+    try {
+        const FlowKey flow{0xa9fe9001, 0xa9fe9009, 9090, 40000};
+
+        // a closed connection's TIME_WAIT is taken over from the TCPConnection
+        {
+            TCPConfig cfg;
+            cfg.fixed_isn = WrappingInt32{1000};
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            a.end_input_stream();  // a closes first, so it's a that lingers
+            deliver(a, b);
+            deliver(b, a);
+            b.end_input_stream();
+            deliver(b, a);
+            deliver(a, b);
+            test_err_if(not a.lingering() or b.lingering() or b.active(), "wrong closer lingers");
+            test_err_if(a.linger_remaining() != 10 * cfg.rt_timeout, "wrong linger time");
+
+            TimeWaitTable table;
+            table.add(flow, a);
+            test_err_if(not table.contains(flow) or table.size() != 1, "flow not in TIME_WAIT");
+
+            // b's FIN, again: ACKed as a would have
+            const auto ack = table.segment_received(flow, segment(1000 + 1, false, true, false));
+            test_err_if(not ack or not ack->header().ack, "retransmitted FIN not ACKed");
+            test_err_if(ack->header().seqno != a.next_seqno() or ack->header().ackno != *a.ackno(), "wrong ACK");
+            test_err_if(ack->header().win != a.receive_window(), "wrong window");
+        }
+
+        const TimeWaitTable::Entry entry{WrappingInt32{500}, WrappingInt32{9000}, 0, 0, 1000};
+
+        // entries expire after their linger time, and a retransmitted FIN restarts it
+        {
+            TimeWaitTable table{100};
+            vector<FlowKey> expired;
+            const auto on_expiry = [&](const FlowKey &f) { expired.push_back(f); };
+            table.add(flow, entry, 1000);
+            table.tick(600, on_expiry);
+            test_err_if(table.segment_received(flow, segment(8999, false, true, false)) == nullopt, "FIN not ACKed");
+            table.tick(900, on_expiry);
+            test_err_if(not table.contains(flow), "restarted entry expired early");
+            table.tick(100, on_expiry);
+            test_err_if(table.contains(flow) or expired.size() != 1 or expired[0] != flow, "entry not expired");
+        }
+
+        // an entry that expires now, on a slot boundary, goes at the next tick (not a turn of the wheel later)
+        {
+            TimeWaitTable table{100};
+            table.tick(100);
+            table.add(flow, entry, 0);
+            table.tick(100);
+            test_err_if(table.contains(flow), "entry added on a slot boundary not expired");
+        }
+
+        // RSTs and pure ACKs are absorbed; a newer SYN reopens the flow
+        {
+            TimeWaitTable table;
+            table.add(flow, entry, 1000);
+            test_err_if(table.segment_received(flow, segment(9000, false, false, true)).has_value(), "RST answered");
+            test_err_if(table.segment_received(flow, segment(9000, false, false, false)).has_value(), "ACK answered");
+            test_err_if(table.segment_received(flow, segment(8000, true, false, false)).has_value(), "SYN answered");
+            test_err_if(not table.contains(flow), "old SYN or RST ended TIME_WAIT");
+            table.segment_received(flow, segment(100000, true, false, false));
+            test_err_if(table.contains(flow), "newer SYN did not reopen the flow");
+        }
+
+        // many entries, and a clock that jumps past a whole turn of the wheel
+        {
+            TimeWaitTable table{10};
+            FlowKey f = flow;
+            for (uint16_t port = 1; port <= 1000; ++port) {
+                f.remote_port = port;
+                table.add(f, entry, port * 100);
+            }
+            table.tick(50000);
+            test_err_if(table.size() != 500, "wrong number of entries expired: " + to_string(1000 - table.size()));
+            table.tick(10 * TimeWaitTable::SLOTS * 10);
+            test_err_if(table.size() != 0, "entries left after a long jump");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
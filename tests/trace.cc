@@ -0,0 +1,132 @@
+#include "connection_harness.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "tcp_trace.hh"
+#include "test_err_if.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static constexpr size_t NTHREADS = 4;
+static constexpr size_t NRECORDS = 1000;
+
+//! Drain every ring and read the records back
+static vector<TraceRecord> drain() {
+    stringstream file;
+    Tracer::drain(file);
+    return Tracer::read(file);
+}
+
+int main() {
+    try {
+        drain();
+
+        // records from several threads, including ones that have exited, come back in time order
+        {
+            vector<thread> threads;
+            for (size_t t = 0; t < NTHREADS; ++t) {
+                threads.emplace_back([t] {
+                    for (size_t i = 0; i < NRECORDS; ++i) {
+                        TraceRecord rec{};
+                        rec.object = t;
+                        rec.a = i;
+                        Tracer::record(rec);
+                    }
+                });
+            }
+            for (auto &t : threads) {
+                t.join();
+            }
+            const auto records = drain();
+            test_err_if(records.size() != NTHREADS * NRECORDS, "trace records lost");
+            test_err_if(not is_sorted(records.begin(),
+                                      records.end(),
+                                      [](const TraceRecord &x, const TraceRecord &y) {
+                                          return x.timestamp_ns < y.timestamp_ns;
+                                      }),
+                        "trace records out of order");
+            vector<uint32_t> next(NTHREADS, 0);
+            for (const auto &rec : records) {
+                test_err_if(rec.a != next[rec.object]++, "a thread's records out of order");
+            }
+        }
+
+        // a full ring drops records instead of blocking
+        {
+            const uint64_t dropped = Tracer::dropped();
+            for (size_t i = 0; i < Tracer::RING_RECORDS + 10; ++i) {
+                Tracer::record(TraceRecord{});
+            }
+            test_err_if(Tracer::dropped() - dropped != 10, "dropped records not counted");
+            test_err_if(drain().size() != Tracer::RING_RECORDS, "ring did not keep the oldest records");
+        }
+
+        // a truncated file is an error
+        {
+            stringstream file{string(sizeof(TraceRecord) + 1, '\0')};
+            bool threw = false;
+            try {
+                Tracer::read(file);
+            } catch (const exception &) {
+                threw = true;
+            }
+            test_err_if(not threw, "truncated trace file accepted");
+        }
+
+        // records render like TCPHeader::summary()
+        {
+            TCPSegment seg{};
+            seg.header().ack = true;
+            seg.header().seqno = WrappingInt32{1};
+            seg.header().ackno = WrappingInt32{2};
+            seg.header().win = 3;
+            seg.payload() = string(100, 'x');
+            TraceRecord rec = TCPTrace::segment(TraceEvent::SegmentSent, nullptr, seg);
+            rec.timestamp_ns = 1500000;
+            const string line = TCPTrace::render(rec, 500000);
+            test_err_if(line != "0.001000 conn=0x0 tx " + seg.header().summary() + " payload=100",
+                        "segment rendered as `" + line + "`");
+
+            const uint8_t established = TCPTrace::state_code(TCPState::State::ESTABLISHED);
+            const uint8_t fin_wait_1 = TCPTrace::state_code(TCPState::State::FIN_WAIT_1);
+            const string state = TCPTrace::render(TCPTrace::state_changed(nullptr, established, fin_wait_1), 0);
+            test_err_if(state.find("state ESTABLISHED -> FIN_WAIT_1") == string::npos,
+                        "state change rendered as `" + state + "`");
+        }
+
+#ifdef STARFISH_TRACING
+        // the tracepoints of a handshake and a retransmission
+        {
+            TCPConfig cfg{};
+            TCPConnection a{cfg}, b{cfg};
+            handshake(a, b);
+            a.write("x");
+            a.tick(cfg.rt_timeout);
+
+            string lines;
+            for (const auto &rec : drain()) {
+                lines += TCPTrace::render(rec, 0) + "\n";
+            }
+            test_err_if(lines.find("tx Header(flags=S,") == string::npos, "SYN not traced");
+            test_err_if(lines.find("rx Header(flags=SA,") == string::npos, "SYN/ACK not traced");
+            test_err_if(lines.find("state LISTEN -> SYN_SENT") == string::npos, "connect() not traced");
+            test_err_if(lines.find("state SYN_SENT -> ESTABLISHED") == string::npos, "handshake not traced");
+            test_err_if(lines.find("rto consecutive=1") == string::npos, "retransmission not traced");
+        }
+#endif
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
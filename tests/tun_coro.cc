@@ -0,0 +1,125 @@
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "tcp_config.hh"
+#include "test_err_if.hh"
+#include "tun_coro.hh"
+#include "tun_stack.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+using namespace std;
+
+static constexpr size_t DATA_SIZE = 300000;
+
+static CoroTask echo_one(CoroStack &stack) {
+    CoroConnection conn = co_await stack.accept();
+    string buf;
+    while (true) {
+        const size_t n = co_await conn.read(buf);
+        if (n == 0) {
+            break;
+        }
+        co_await conn.write(buf);
+        buf.clear();
+    }
+    conn.shutdown_write();
+}
+
+static CoroTask send_all(CoroConnection &conn, const string &data) {
+    test_err_if(co_await conn.write(data) != data.size(), "short write");
+    conn.shutdown_write();
+}
+
+static CoroTask receive_all(CoroConnection &conn, string &received) {
+    size_t n = 1;
+    while (n > 0) {
+        n = co_await conn.read(received);
+    }
+}
+
+static CoroTask client(CoroStack &stack, const FdAdapterConfig &ad_cfg, const string &data) {
+    CoroConnection conn = co_await stack.connect(TCPConfig{}, ad_cfg);
+    test_err_if(conn.state() != TCPState::State::ESTABLISHED, "client not established");
+
+    // writing and reading concurrently: the echo server can't make progress unless both do
+    string received;
+    CoroTask receiver = receive_all(conn, received);
+    stack.spawn(send_all(conn, data));
+    co_await receiver;
+    test_err_if(received != data, "echoed data mismatch");
+    test_err_if(not conn.eof(), "client did not see the FIN");
+}
+
+static CoroTask sleeper(CoroStack &stack, const uint64_t ms) {
+    const uint64_t start = timestamp_ms();
+    co_await stack.sleep_for(ms);
+    test_err_if(timestamp_ms() - start < ms, "woke up early");
+}
+
+static CoroTask failer(CoroStack &stack) {
+    co_await stack.sleep_for(1);
+    throw runtime_error("expected failure");
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // one stack talks to itself: a reflector sends every outbound datagram straight back
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+        TUNStack tun_stack{FileDescriptor{fds[0]}};
+        FileDescriptor reflector{fds[1]};
+        reflector.set_blocking(false);
+        deque<string> reflected;
+
+        EventLoop loop;
+        loop.add_rule(reflector, EventLoop::Direction::In, [&] { reflected.push_back(reflector.read()); });
+        loop.add_rule(
+            reflector,
+            EventLoop::Direction::Out,
+            [&] {
+                while (not reflected.empty() and reflector.write_datagram(reflected.front())) {
+                    reflected.pop_front();
+                }
+            },
+            [&] { return not reflected.empty(); });
+        CoroStack stack{tun_stack, loop};
+
+        FdAdapterConfig ad_cfg{};
+        ad_cfg.source = {"169.254.144.9", 40000};
+        ad_cfg.destination = {"169.254.144.1", 9090};
+        tun_stack.listen(TCPConfig{}, ad_cfg.destination);
+
+        string d(DATA_SIZE, 0);
+        generate(d.begin(), d.end(), [&] { return rd(); });
+
+        stack.spawn(echo_one(stack));
+        stack.spawn(client(stack, ad_cfg, d));
+        stack.spawn(sleeper(stack, 20));
+        stack.run();
+
+        // exceptions escaping a spawned task come out of run()
+        stack.spawn(failer(stack));
+        bool threw = false;
+        try {
+            stack.run();
+        } catch (const runtime_error &e) {
+            threw = string(e.what()) == "expected failure";
+        }
+        test_err_if(not threw, "task exception not propagated");
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include "file_descriptor.hh"
+#include "tcp_config.hh"
+#include "tcp_tun_socket.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+
+using namespace std;
+
+static constexpr size_t STREAM_LEN = 1024 * 1024;
+
+//! `len` random bytes
+static string random_string(mt19937 &rd, const size_t len) {
+    string ret(len, 0);
+    for (auto &ch : ret) {
+        ch = rd();
+    }
+    return ret;
+}
+
+//! Write `data` to `sock`, then shut down its outbound stream
+static void send_all(TUNSocket &sock, const string &data) {
+    sock.stream_write(data);
+    sock.stream_shutdown(SHUT_WR);
+}
+
+//! Read `sock`'s inbound stream to its end
+static string receive_all(TUNSocket &sock) {
+    string ret;
+    while (not sock.stream_eof()) {
+        ret += sock.stream_read();
+    }
+    return ret;
+}
+
+//! send_all() and receive_all() through the names TUNSocket shares with FileDescriptor
+static void write_all(TUNSocket &sock, const string &data) {
+    sock.write(data);
+    sock.shutdown(SHUT_WR);
+}
+static string read_all(TUNSocket &sock) {
+    string ret;
+    while (not sock.eof()) {
+        ret += sock.read();
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // two TUNSockets with the ring transport, over a socketpair standing in for the tun device
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+        TUNSocket client{FileDescriptor{fds[0]}, TUNSocket::Transport::Ring};
+        TUNSocket server{FileDescriptor{fds[1]}, TUNSocket::Transport::Ring};
+
+        TCPConfig cfg;
+        cfg.rt_timeout = 100;
+        FdAdapterConfig client_cfg, server_cfg;
+        client_cfg.source = {"169.254.144.9", 40000};
+        client_cfg.destination = server_cfg.source = {"169.254.144.1", 9090};
+        thread acceptor{[&] { server.listen_and_accept(cfg, server_cfg); }};
+        client.connect(cfg, client_cfg);
+        acceptor.join();
+
+        // both ways at once, each larger than a ring (the download through read() and write(), which in Ring
+        // mode go through the rings too)
+        const string upload = random_string(rd, STREAM_LEN);
+        const string download = random_string(rd, STREAM_LEN);
+        thread uploader{[&] { send_all(client, upload); }};
+        thread downloader{[&] { write_all(server, download); }};
+        const string uploaded = receive_all(server);
+        const string downloaded = read_all(client);
+        uploader.join();
+        downloader.join();
+        client.wait_until_closed();
+        server.wait_until_closed();
+
+        test_err_if(uploaded != upload, "client to server stream mismatch");
+        test_err_if(downloaded != download, "server to client stream mismatch");
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+#include "metrics.hh"
+#include "tcp_config.hh"
+#include "test_err_if.hh"
+#include "tun.hh"
+#include "tun_stack.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <optional>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static constexpr size_t DATA_SIZE = 200000;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // two stacks joined by a datagram-preserving socketpair stand in for a TUN device and its peer
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(fds)));
+        FileDescriptor client_wire{SystemCall("dup", ::dup(fds[0]))};  // to act for the client once it's gone
+        TUNStack client_stack{FileDescriptor{fds[0]}};
+        TUNStack server_stack{FileDescriptor{fds[1]}};
+
+        EventLoop loop;
+        client_stack.install_rules(loop);
+        server_stack.install_rules(loop);
+        const auto run = [&] {
+            while (loop.wait_next_event(0) == EventLoop::Result::Success) {
+            }
+        };
+
+        TCPConfig cfg{};
+        FdAdapterConfig ad_cfg{};
+        ad_cfg.source = {"169.254.144.9", 40000};
+        ad_cfg.destination = {"169.254.144.1", 9090};
+
+        // (fixed ISNs, to forge the client's segments later)
+        TCPConfig client_cfg = cfg, server_cfg = cfg;
+        client_cfg.fixed_isn = WrappingInt32{1000};
+        server_cfg.fixed_isn = WrappingInt32{5000};
+        server_stack.listen(server_cfg, ad_cfg.destination);
+        test_err_if(server_stack.accept() != nullptr, "accepted before any connection");
+
+        const auto client = client_stack.connect(client_cfg, ad_cfg);
+        test_err_if(client->writable(), "writable before the handshake");
+        run();
+
+        const auto server = server_stack.accept();
+        test_err_if(server == nullptr, "connection not accepted");
+        test_err_if(server_stack.accept() != nullptr, "connection accepted twice");
+        test_err_if(client->state() != TCPState::State::ESTABLISHED, "client not established");
+        test_err_if(server->state() != TCPState::State::ESTABLISHED, "server not established");
+        test_err_if(server->config().destination.port() != 40000, "wrong peer port");
+        test_err_if(client_stack.size() != 1 or server_stack.size() != 1, "wrong connection count");
+
+        string d(DATA_SIZE, 0);
+        generate(d.begin(), d.end(), [&] { return rd(); });
+
+        // client -> server, through windows much smaller than the data
+        string received;
+        size_t sent = 0;
+        while (received.size() < d.size()) {
+            sent += client->write(string_view(d).substr(sent));
+            run();
+            server->read(received);
+        }
+        test_err_if(received != d, "data mismatch (client to server)");
+
+        // server -> client, then both sides close
+        test_err_if(server->write("hello, client") != 13, "write refused");
+        server->shutdown_write();
+        run();
+        test_err_if(not client->readable(), "client not readable");
+        test_err_if(client->read() != "hello, client", "data mismatch (server to client)");
+        test_err_if(not client->eof(), "client did not see the FIN");
+
+        client->shutdown_write();
+        run();
+        test_err_if(not server->eof(), "server did not see the FIN");
+        test_err_if(client->active(), "passive closer still active");
+        test_err_if(client_stack.size() != 0, "passive closer not reaped");
+
+        // the active closer's TIME_WAIT is kept in a compact entry, until tick() expires it
+        test_err_if(server_stack.size() != 0 or server_stack.time_wait_size() != 1, "active closer not in TIME_WAIT");
+        test_err_if(server->active() or server->state() != TCPState::State::TIME_WAIT, "TUNConnection still active");
+        test_err_if(client_stack.time_wait_size() != 0, "passive closer in TIME_WAIT");
+
+        // a retransmission of the client's FIN is ACKed from the entry, and restarts its timer
+        server_stack.tick(5 * cfg.rt_timeout);
+        {
+            const WrappingInt32 client_fin = client_cfg.fixed_isn.value() + 1 + DATA_SIZE;
+            const WrappingInt32 server_end = server_cfg.fixed_isn.value() + 1 + 13 + 1;
+            TCPOverIPv4Adapter client_side;
+            client_side.set_config(ad_cfg);
+            TCPSegment fin;
+            fin.header().fin = true;
+            fin.header().ack = true;
+            fin.header().seqno = client_fin;
+            fin.header().ackno = server_end;
+            fin.header().win = TCPConfig::DEFAULT_CAPACITY;
+            test_err_if(not client_wire.write_datagram(client_side.wrap_tcp_in_ip(fin).serialize().concatenate()),
+                        "forged FIN not written");
+            server_stack.receive();
+
+            string raw;
+            test_err_if(not client_wire.read_datagram(raw), "retransmitted FIN not ACKed");
+            InternetDatagram dgram;
+            test_err_if(dgram.parse(Buffer{move(raw)}) != ParseResult::NoError, "ACK doesn't parse");
+            const optional<TCPSegment> ack = client_side.unwrap_tcp_in_ip(dgram);
+            test_err_if(not ack.has_value() or not ack->header().ack or ack->header().ackno != client_fin + 1 or
+                            ack->header().seqno != server_end,
+                        "wrong ACK of the retransmitted FIN");
+        }
+        server_stack.tick(10 * cfg.rt_timeout - 1);
+        test_err_if(server_stack.time_wait_size() != 1, "TIME_WAIT expired early");
+        server_stack.tick(1);
+        test_err_if(server_stack.time_wait_size() != 0, "TIME_WAIT not expired");
+
+        // datagrams that find the fd full wait in the stack, up to MAX_OUTBOUND; more are dropped and counted
+        {
+            int pair_fds[2];
+            SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(pair_fds)));
+            TUNStack sender_stack{FileDescriptor{pair_fds[0]}};
+            TUNStack receiver_stack{FileDescriptor{pair_fds[1]}};
+            EventLoop pair_loop;
+            sender_stack.install_rules(pair_loop);
+            receiver_stack.install_rules(pair_loop);
+
+            // a tiny MSS, so one window is many more datagrams than the fd and the queue hold together
+            TCPConfig tiny = cfg;
+            tiny.mss = 16;
+            receiver_stack.listen(cfg, ad_cfg.destination);
+            const auto sender = sender_stack.connect(tiny, ad_cfg);
+            while (pair_loop.wait_next_event(0) == EventLoop::Result::Success) {
+            }
+            test_err_if(receiver_stack.accept() == nullptr, "connection not accepted");
+
+            // (nothing runs the loop now, so nothing drains the fd)
+            const uint64_t drops = StackMetrics::snapshot().outbound_drops;
+            test_err_if(sender->write(string(8 * TUNStack::MAX_OUTBOUND * tiny.mss, 'x')) == 0, "write refused");
+            test_err_if(sender_stack.outbound_size() != TUNStack::MAX_OUTBOUND, "outbound queue not capped");
+            test_err_if(StackMetrics::snapshot().outbound_drops == drops, "dropped datagrams not counted");
+        }
+
+        // a listener keeps at most its backlog of connections in their handshake or waiting for accept();
+        // the SYNs beyond it are dropped (and counted), and retransmitted once there is room
+        {
+            int pair_fds[2];
+            SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, static_cast<int *>(pair_fds)));
+            TUNStack peer_stack{FileDescriptor{pair_fds[0]}};
+            TUNStack listen_stack{TunFD{FileDescriptor{pair_fds[1]}}};  // (a TunFD that is no device has no MTU)
+            EventLoop pair_loop;
+            peer_stack.install_rules(pair_loop);
+            listen_stack.install_rules(pair_loop);
+            const auto pair_run = [&] {
+                while (pair_loop.wait_next_event(0) == EventLoop::Result::Success) {
+                }
+            };
+
+            constexpr size_t BACKLOG = 2;
+            listen_stack.listen(cfg, ad_cfg.destination, BACKLOG);
+            const uint64_t overflows = StackMetrics::snapshot().listen_overflows;
+            vector<shared_ptr<TUNConnection>> peers;
+            for (uint16_t port = 41000; port < 41000 + BACKLOG + 1; ++port) {
+                FdAdapterConfig peer_cfg = ad_cfg;
+                peer_cfg.source = {"169.254.144.9", port};
+                peers.push_back(peer_stack.connect(cfg, peer_cfg));
+            }
+            pair_run();
+            test_err_if(listen_stack.size() != BACKLOG, "backlog not capped");
+            test_err_if(StackMetrics::snapshot().listen_overflows != overflows + 1, "dropped SYN not counted");
+            test_err_if(peers.back()->state() != TCPState::State::SYN_SENT, "SYN beyond the backlog answered");
+
+            // accept() makes room, and the retransmitted SYN takes it
+            test_err_if(listen_stack.accept() == nullptr, "connection not accepted");
+            peer_stack.tick(cfg.rt_timeout);
+            pair_run();
+            test_err_if(peers.back()->state() != TCPState::State::ESTABLISHED, "retransmitted SYN not accepted");
+            test_err_if(listen_stack.accept() == nullptr or listen_stack.accept() == nullptr, "not all accepted");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
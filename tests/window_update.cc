@@ -0,0 +1,88 @@
+#include "connection_harness.hh"
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+#include "test_err_if.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! Fill `b`'s receive window with data from `a`, and let `a` see the zero window
+static void fill_window(TCPConnection &a, TCPConnection &b, const size_t capacity) {
+    handshake(a, b);
+    a.write(string(capacity, 'x'));
+    deliver(a, b);
+    deliver(b, a);
+}
+
+int main() {
+    try {
+        constexpr size_t CAPACITY = 4000;
+        TCPConfig cfg;
+        cfg.recv_capacity = CAPACITY;
+
+        // a zero window reopens with an explicit update, once it can open by an MSS
+        {
+            TCPConnection a{cfg}, b{cfg};
+            fill_window(a, b, CAPACITY);
+            test_err_if(b.receive_window() != 0 or a.bytes_in_flight() != 0, "window not closed");
+
+            b.inbound_stream().read(100);
+            b.window_update();
+            test_err_if(not b.segments_out().empty(), "window opened by a sliver (SWS)");
+            test_err_if(b.receive_window() != 0, "advertised window opened by a sliver (SWS)");
+
+            b.inbound_stream().read(TCPConfig::MAX_PAYLOAD_SIZE - 100);
+            b.window_update();
+            test_err_if(b.segments_out().size() != 1, "no window update");
+            const TCPSegment &update = b.segments_out().front();
+            test_err_if(not update.header().ack or update.payload().size() != 0 or
+                            update.header().win != TCPConfig::MAX_PAYLOAD_SIZE,
+                        "bad window update");
+            test_err_if(b.metrics().window_updates != 1, "window update not counted");
+
+            // the peer sends into the reopened window at once, rather than waiting to probe
+            deliver(b, a);
+            test_err_if(a.bytes_in_flight() != 0 or not a.segments_out().empty(), "sent past the window");
+            a.write(string(CAPACITY, 'y'));
+            test_err_if(a.bytes_in_flight() != TCPConfig::MAX_PAYLOAD_SIZE, "reopened window not used");
+
+            // a second call has nothing new to advertise
+            b.window_update();
+            test_err_if(not b.segments_out().empty(), "duplicate window update");
+        }
+
+        // an owner that doesn't call window_update() gets the update at the next tick
+        {
+            TCPConnection a{cfg}, b{cfg};
+            fill_window(a, b, CAPACITY);
+            b.inbound_stream().read(CAPACITY);
+            test_err_if(not b.segments_out().empty(), "update sent without being asked");
+            b.tick(1);
+            test_err_if(b.segments_out().size() != 1 or b.segments_out().front().header().win != CAPACITY,
+                        "no window update at the tick");
+        }
+
+        // while more than half the window is open, the ACKs of data carry it
+        {
+            TCPConnection a{cfg}, b{cfg};
+            fill_window(a, b, CAPACITY / 2);
+            b.inbound_stream().read(CAPACITY / 2);
+            b.window_update();
+            b.tick(1);
+            test_err_if(not b.segments_out().empty(), "unneeded window update");
+            a.write("z");
+            deliver(a, b);
+            test_err_if(b.segments_out().empty() or b.segments_out().back().header().win != CAPACITY - 1,
+                        "window not carried by the ACK");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}
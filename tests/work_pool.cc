@@ -0,0 +1,119 @@
+#include "eventloop.hh"
+#include "test_err_if.hh"
+#include "util.hh"
+#include "work_pool.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static constexpr size_t NSTRANDS = 64;
+static constexpr size_t NJOBS = 1000;
+
+int main() {
+    try {
+        // plain jobs all run, on the workers, before the pool is destroyed
+        {
+            atomic<size_t> ran{0};
+            {
+                WorkPool pool{4};
+                test_err_if(pool.size() != 4, "wrong pool size");
+                for (size_t i = 0; i < NJOBS; ++i) {
+                    pool.post([&] { ran++; });
+                }
+                // jobs posted by jobs
+                pool.post([&] {
+                    for (size_t i = 0; i < NJOBS; ++i) {
+                        pool.post([&] { ran++; });
+                    }
+                });
+            }
+            test_err_if(ran != 2 * NJOBS, "jobs lost");
+        }
+
+        // a job that throws takes down neither its worker, nor its strand, nor the completion queue
+        {
+            atomic<size_t> ran{0};
+            {
+                WorkPool pool{1};
+                const auto strand = pool.make_strand();
+                pool.post([] { throw runtime_error("pool job failed (expected)"); });
+                pool.post([&] { ran++; });
+                strand->post([] { throw runtime_error("strand job failed (expected)"); });
+                strand->post([&] { ran++; });
+            }
+            test_err_if(ran != 2, "jobs behind a throwing job lost");
+
+            CompletionQueue completions;
+            size_t completed = 0;
+            completions.push([] { throw runtime_error("completion failed (expected)"); });
+            completions.push([&] { completed++; });
+            test_err_if(completions.run() != 2 or completed != 1, "completions behind a throwing one lost");
+        }
+
+        // per-strand ordering, with results handed back to the EventLoop thread
+        {
+            WorkPool pool{4};
+            CompletionQueue completions;
+            EventLoop loop;
+            completions.install_rules(loop);
+
+            const auto io_thread = this_thread::get_id();
+            vector<shared_ptr<WorkPool::Strand>> strands;
+            vector<vector<size_t>> worker_order(NSTRANDS), io_order(NSTRANDS);
+            vector<unique_ptr<atomic<bool>>> busy;
+            for (size_t s = 0; s < NSTRANDS; ++s) {
+                strands.push_back(pool.make_strand());
+                busy.push_back(make_unique<atomic<bool>>(false));
+            }
+
+            bool wrong_thread = false, overlapped = false;
+            for (size_t i = 0; i < NJOBS; ++i) {
+                for (size_t s = 0; s < NSTRANDS; ++s) {
+                    strands[s]->post([&, s, i] {
+                        // no other job of this strand may be running
+                        if (busy[s]->exchange(true)) {
+                            overlapped = true;
+                        }
+                        worker_order[s].push_back(i);
+                        busy[s]->store(false);
+                        completions.push([&, s, i] {
+                            wrong_thread |= this_thread::get_id() != io_thread;
+                            io_order[s].push_back(i);
+                        });
+                    });
+                }
+            }
+
+            size_t done = 0;
+            while (done < NSTRANDS * NJOBS) {
+                test_err_if(loop.wait_next_event(1000) == EventLoop::Result::Timeout, "completions stalled");
+                done = 0;
+                for (const auto &order : io_order) {
+                    done += order.size();
+                }
+            }
+
+            test_err_if(overlapped, "jobs of one strand ran concurrently");
+            test_err_if(wrong_thread, "completion ran off the EventLoop thread");
+            for (size_t s = 0; s < NSTRANDS; ++s) {
+                for (size_t i = 0; i < NJOBS; ++i) {
+                    test_err_if(worker_order[s][i] != i, "strand jobs ran out of order");
+                    test_err_if(io_order[s][i] != i, "completions of one strand out of order");
+                }
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return err_num;
+    }
+
+    return EXIT_SUCCESS;
+}